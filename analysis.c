@@ -0,0 +1,764 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+
+// Returns the first model that knows op
+static int opModel(int op)
+{
+    switch (op)
+    {
+        case OP_SCD: case OP_SCR: case OP_SCL: case OP_EXIT: case OP_LOWRES: case OP_HIGHRES:
+        case OP_LDHF: case OP_SAVEF: case OP_LOADF:
+            return CHIP_MODEL_SCHIP;
+
+        case OP_SCU: case OP_SAVER: case OP_LOADR: case OP_LDIL: case OP_PLANE: case OP_LDAUD: case OP_PITCH:
+            return CHIP_MODEL_XOCHIP;
+
+        default:
+            return CHIP_MODEL_CHIP8;
+    }
+}
+
+static int isSkip(int op)
+{
+    return op == OP_SE || op == OP_SNE || op == OP_SER || op == OP_SNER || op == OP_SKP || op == OP_SKPN;
+}
+
+static word readWord(const Analysis *analysis, int address)
+{
+    return analysis->memory[address & (RAM_SIZE - 1)] << 8 | analysis->memory[(address + 1) & (RAM_SIZE - 1)];
+}
+
+CHIP_Op ANALYSIS_Decode(const Analysis *analysis, int address)
+{
+    CHIP_Op op = CHIP_Decode(readWord(analysis, address));
+
+    if (opModel(op.op) > analysis->model)
+    {
+        op.op = OP_UNKNOWN;
+    }
+
+    return op;
+}
+
+int ANALYSIS_InstructionSize(const Analysis *analysis, int address)
+{
+    return (analysis->model == CHIP_MODEL_XOCHIP && readWord(analysis, address) == LDIL) ? 4 : 2;
+}
+
+// Returns 1 if op ends a basic block
+static int endsBlock(int op)
+{
+    return op == OP_JP || op == OP_JPV || op == OP_CALL || op == OP_RET || op == OP_EXIT || op == OP_UNKNOWN ||
+        isSkip(op);
+}
+
+// Returns number of successors of the instruction op at address and fills targets and kinds
+static int successors(const Analysis *analysis, int address, const CHIP_Op *op, int *targets, byte *kinds)
+{
+    int next = address + ANALYSIS_InstructionSize(analysis, address);
+
+    switch (op->op)
+    {
+        case OP_JP:
+            targets[0] = op->nnn;
+            kinds[0] = ANALYSIS_EDGE_JUMP;
+            return 1;
+
+        case OP_CALL:
+            targets[0] = op->nnn;
+            kinds[0] = ANALYSIS_EDGE_CALL;
+            targets[1] = next;
+            kinds[1] = ANALYSIS_EDGE_RETURN;
+            return 2;
+
+        case OP_JPV: case OP_RET: case OP_EXIT: case OP_UNKNOWN:
+            return 0;
+
+        default:
+            targets[0] = next;
+            kinds[0] = ANALYSIS_EDGE_NEXT;
+
+            if (!isSkip(op->op))
+            {
+                return 1;
+            }
+
+            // XO-CHIP skips both words of F000 nnnn
+            targets[1] = next + ANALYSIS_InstructionSize(analysis, next);
+            kinds[1] = ANALYSIS_EDGE_SKIP;
+            return 2;
+    }
+}
+
+static int addNote(Analysis *analysis, int *capacity, int address, int kind, int target)
+{
+    if (analysis->noteCount == *capacity)
+    {
+        int grownCapacity = *capacity ? *capacity * 2 : 64;
+        AnalysisNote *grown = realloc(analysis->notes, grownCapacity * sizeof(AnalysisNote));
+
+        if (grown == NULL)
+        {
+            return -1;
+        }
+
+        analysis->notes = grown;
+        *capacity = grownCapacity;
+    }
+
+    AnalysisNote *note = &analysis->notes[analysis->noteCount++];
+
+    note->address = address;
+    note->kind = kind;
+    note->target = target;
+
+    return 0;
+}
+
+// Decodes every instruction reachable from the entry, marking code and the leaders of basic blocks
+// an instruction reached by falling through into code decoded before starts a block, so blocks never overlap
+static int discover(Analysis *analysis, int *noteCapacity)
+{
+    int *pending = malloc(RAM_SIZE * sizeof(int));
+    int count = 0;
+    int status = 0;
+
+    if (pending == NULL)
+    {
+        return -1;
+    }
+
+    analysis->flags[analysis->entry] |= ANALYSIS_LEADER;
+    pending[count++] = analysis->entry;
+
+    while (count > 0 && status == 0)
+    {
+        int address = pending[--count];
+
+        while (status == 0)
+        {
+            if (analysis->flags[address] & ANALYSIS_CODE)
+            {
+                analysis->flags[address] |= ANALYSIS_LEADER;
+                break;
+            }
+
+            if (analysis->flags[address] & ANALYSIS_OPERAND)
+            {
+                status = addNote(analysis, noteCapacity, address, ANALYSIS_NOTE_OVERLAP, -1);
+            }
+
+            CHIP_Op op = ANALYSIS_Decode(analysis, address);
+            int size = ANALYSIS_InstructionSize(analysis, address);
+            int targets[2];
+            byte kinds[2];
+
+            analysis->flags[address] |= ANALYSIS_CODE;
+
+            for (int i = 1; i < size; i++)
+            {
+                analysis->flags[(address + i) & (RAM_SIZE - 1)] |= ANALYSIS_OPERAND;
+            }
+
+            if (op.op == OP_LDI)
+            {
+                analysis->flags[op.nnn] |= ANALYSIS_DATA;
+            }
+            else if (op.op == OP_LDIL)
+            {
+                analysis->flags[readWord(analysis, address + 2)] |= ANALYSIS_DATA;
+            }
+            else if (op.op == OP_UNKNOWN)
+            {
+                status = addNote(analysis, noteCapacity, address, ANALYSIS_NOTE_ILLEGAL_OPCODE, -1);
+            }
+            else if (op.op == OP_JPV)
+            {
+                status = addNote(analysis, noteCapacity, address, ANALYSIS_NOTE_INDIRECT_JUMP, op.nnn);
+            }
+
+            int edges = successors(analysis, address, &op, targets, kinds);
+            int fallsThrough = !endsBlock(op.op);
+
+            for (int i = 0; i < edges && status == 0; i++)
+            {
+                if (targets[i] + 1 >= analysis->memorySize)
+                {
+                    status = addNote(analysis, noteCapacity, address, ANALYSIS_NOTE_OUTSIDE, targets[i]);
+                    fallsThrough = 0;
+                    continue;
+                }
+
+                if (kinds[i] == ANALYSIS_EDGE_CALL)
+                {
+                    analysis->flags[targets[i]] |= ANALYSIS_CALLED;
+                }
+
+                if (!fallsThrough)
+                {
+                    analysis->flags[targets[i]] |= ANALYSIS_LEADER;
+                    pending[count++] = targets[i];
+                }
+            }
+
+            if (!fallsThrough)
+            {
+                break;
+            }
+
+            address = targets[0];
+        }
+    }
+
+    free(pending);
+
+    return status;
+}
+
+// Splits the code into blocks at the leaders
+static int buildBlocks(Analysis *analysis)
+{
+    int capacity = 0;
+
+    for (int address = 0; address < RAM_SIZE; address++)
+    {
+        capacity += (analysis->flags[address] & ANALYSIS_LEADER) != 0;
+    }
+
+    analysis->blocks = malloc((capacity + 1) * sizeof(AnalysisBlock));
+
+    if (analysis->blocks == NULL)
+    {
+        return -1;
+    }
+
+    for (int address = 0; address < RAM_SIZE; address++)
+    {
+        if (!(analysis->flags[address] & ANALYSIS_LEADER))
+        {
+            continue;
+        }
+
+        AnalysisBlock *block = &analysis->blocks[analysis->blockCount++];
+        int pc = address;
+        int targets[2];
+
+        memset(block, 0, sizeof(AnalysisBlock));
+        block->start = address;
+        block->I = ANALYSIS_I_UNSET;
+
+        while (1)
+        {
+            CHIP_Op op = ANALYSIS_Decode(analysis, pc);
+            int edges = successors(analysis, pc, &op, targets, block->kinds);
+
+            block->instructions++;
+            pc += ANALYSIS_InstructionSize(analysis, pc);
+
+            // successors past the memory of the model were left out by discover
+            if (endsBlock(op.op) || (analysis->flags[pc] & (ANALYSIS_LEADER | ANALYSIS_CODE)) != ANALYSIS_CODE)
+            {
+                for (int i = 0; i < edges; i++)
+                {
+                    if (targets[i] + 1 < analysis->memorySize)
+                    {
+                        block->kinds[block->edgeCount] = block->kinds[i];
+                        block->targets[block->edgeCount++] = targets[i];
+                    }
+                }
+
+                break;
+            }
+        }
+
+        block->end = pc;
+    }
+
+    return 0;
+}
+
+// Returns I after the instructions of block run with I on entry
+static int transferI(const Analysis *analysis, const AnalysisBlock *block, int I)
+{
+    for (int pc = block->start; pc < block->end; pc += ANALYSIS_InstructionSize(analysis, pc))
+    {
+        CHIP_Op op = ANALYSIS_Decode(analysis, pc);
+
+        switch (op.op)
+        {
+            case OP_LDI:
+                I = op.nnn;
+                break;
+
+            case OP_LDIL:
+                I = readWord(analysis, pc + 2);
+                break;
+
+            // Fx55 and Fx65 move I with some quirks profiles
+            case OP_ADDI: case OP_LDCH: case OP_LDHF: case OP_PUSHR: case OP_POPR:
+                I = ANALYSIS_I_VARIES;
+                break;
+        }
+    }
+
+    return I;
+}
+
+static int mergeI(int a, int b)
+{
+    if (a == ANALYSIS_I_UNSET)
+    {
+        return b;
+    }
+
+    return (b == ANALYSIS_I_UNSET || a == b) ? a : ANALYSIS_I_VARIES;
+}
+
+// Propagates I along the edges until no block changes, a CALL returns with any I
+static void propagateI(Analysis *analysis, int entryI)
+{
+    int changed = 1;
+
+    analysis->blocks[ANALYSIS_FindBlock(analysis, analysis->entry)].I = entryI;
+
+    while (changed)
+    {
+        changed = 0;
+
+        for (int n = 0; n < analysis->blockCount; n++)
+        {
+            AnalysisBlock *block = &analysis->blocks[n];
+
+            if (block->I == ANALYSIS_I_UNSET)
+            {
+                continue;
+            }
+
+            int I = transferI(analysis, block, block->I);
+
+            for (int i = 0; i < block->edgeCount; i++)
+            {
+                int index = ANALYSIS_FindBlock(analysis, block->targets[i]);
+                int merged = mergeI(analysis->blocks[index].I, block->kinds[i] == ANALYSIS_EDGE_RETURN ? ANALYSIS_I_VARIES : I);
+
+                if (merged != analysis->blocks[index].I)
+                {
+                    analysis->blocks[index].I = merged;
+                    changed = 1;
+                }
+            }
+        }
+    }
+}
+
+// Checks every store through I against code
+static int checkStores(Analysis *analysis, int *noteCapacity)
+{
+    for (int n = 0; n < analysis->blockCount; n++)
+    {
+        const AnalysisBlock *block = &analysis->blocks[n];
+        int I = block->I;
+
+        for (int pc = block->start; pc < block->end; pc += ANALYSIS_InstructionSize(analysis, pc))
+        {
+            CHIP_Op op = ANALYSIS_Decode(analysis, pc);
+            int size = 0;
+
+            if (op.op == OP_BCD)
+            {
+                size = 3;
+            }
+            else if (op.op == OP_PUSHR)
+            {
+                size = op.x + 1;
+            }
+            else if (op.op == OP_SAVER)
+            {
+                size = (op.x < op.y ? op.y - op.x : op.x - op.y) + 1;
+            }
+
+            if (size > 0 && I < 0)
+            {
+                if (addNote(analysis, noteCapacity, pc, ANALYSIS_NOTE_UNKNOWN_STORE, -1) != 0)
+                {
+                    return -1;
+                }
+            }
+            else if (size > 0)
+            {
+                int code = 0;
+
+                for (int i = 0; i < size; i++)
+                {
+                    analysis->flags[(I + i) & (RAM_SIZE - 1)] |= ANALYSIS_WRITTEN;
+                    code |= analysis->flags[(I + i) & (RAM_SIZE - 1)] & (ANALYSIS_CODE | ANALYSIS_OPERAND);
+                }
+
+                if (code && addNote(analysis, noteCapacity, pc, ANALYSIS_NOTE_SELF_MODIFYING, I) != 0)
+                {
+                    return -1;
+                }
+            }
+
+            AnalysisBlock step = { .start = pc, .end = pc + ANALYSIS_InstructionSize(analysis, pc) };
+
+            I = transferI(analysis, &step, I);
+        }
+    }
+
+    return 0;
+}
+
+static int compareNotes(const void *a, const void *b)
+{
+    const AnalysisNote *x = a;
+    const AnalysisNote *y = b;
+
+    return x->address != y->address ? x->address - y->address : x->kind - y->kind;
+}
+
+int ANALYSIS_Run(Analysis *analysis, const Chip8 *chip, int size)
+{
+    int noteCapacity = 0;
+
+    analysis->model = chip->model;
+    analysis->memorySize = chip->memorySize;
+    analysis->entry = chip->PC & (RAM_SIZE - 1);
+    analysis->programEnd = LOAD_ADDRESS + (size < CHIP_ProgramSize(chip) ? size : CHIP_ProgramSize(chip));
+    analysis->blocks = NULL;
+    analysis->blockCount = 0;
+    analysis->notes = NULL;
+    analysis->noteCount = 0;
+
+    CHIP_ReadMemory(chip, 0, analysis->memory, RAM_SIZE);
+    memset(analysis->flags, 0, sizeof(analysis->flags));
+
+    if (discover(analysis, &noteCapacity) != 0 || buildBlocks(analysis) != 0)
+    {
+        ANALYSIS_Free(analysis);
+        return -1;
+    }
+
+    propagateI(analysis, chip->I);
+
+    if (checkStores(analysis, &noteCapacity) != 0)
+    {
+        ANALYSIS_Free(analysis);
+        return -1;
+    }
+
+    if (analysis->noteCount > 0)
+    {
+        qsort(analysis->notes, analysis->noteCount, sizeof(AnalysisNote), compareNotes);
+    }
+
+    return 0;
+}
+
+void ANALYSIS_Free(Analysis *analysis)
+{
+    free(analysis->blocks);
+    free(analysis->notes);
+    analysis->blocks = NULL;
+    analysis->notes = NULL;
+    analysis->blockCount = 0;
+    analysis->noteCount = 0;
+}
+
+int ANALYSIS_FindBlock(const Analysis *analysis, int address)
+{
+    int low = 0, high = analysis->blockCount - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+
+        if (analysis->blocks[middle].start == address)
+        {
+            return middle;
+        }
+
+        if (analysis->blocks[middle].start < address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    return -1;
+}
+
+void ANALYSIS_Format(const Analysis *analysis, int address, char *text, int size)
+{
+    CHIP_Op op = ANALYSIS_Decode(analysis, address);
+    int x = op.x, y = op.y;
+
+    switch (op.op)
+    {
+        case OP_NOP:        snprintf(text, size, "SYS 0x%03x", op.nnn); break;
+        case OP_CLS:        snprintf(text, size, "CLS"); break;
+        case OP_RET:        snprintf(text, size, "RET"); break;
+        case OP_JP:         snprintf(text, size, "JP 0x%03x", op.nnn); break;
+        case OP_CALL:       snprintf(text, size, "CALL 0x%03x", op.nnn); break;
+        case OP_SE:         snprintf(text, size, "SE V%X, 0x%02x", x, op.kk); break;
+        case OP_SNE:        snprintf(text, size, "SNE V%X, 0x%02x", x, op.kk); break;
+        case OP_SER:        snprintf(text, size, "SE V%X, V%X", x, y); break;
+        case OP_LD:         snprintf(text, size, "LD V%X, 0x%02x", x, op.kk); break;
+        case OP_ADD:        snprintf(text, size, "ADD V%X, 0x%02x", x, op.kk); break;
+        case OP_LDR:        snprintf(text, size, "LD V%X, V%X", x, y); break;
+        case OP_OR:         snprintf(text, size, "OR V%X, V%X", x, y); break;
+        case OP_AND:        snprintf(text, size, "AND V%X, V%X", x, y); break;
+        case OP_XOR:        snprintf(text, size, "XOR V%X, V%X", x, y); break;
+        case OP_ADDR:       snprintf(text, size, "ADD V%X, V%X", x, y); break;
+        case OP_SUB:        snprintf(text, size, "SUB V%X, V%X", x, y); break;
+        case OP_SHR:        snprintf(text, size, "SHR V%X, V%X", x, y); break;
+        case OP_SUBN:       snprintf(text, size, "SUBN V%X, V%X", x, y); break;
+        case OP_SHL:        snprintf(text, size, "SHL V%X, V%X", x, y); break;
+        case OP_SNER:       snprintf(text, size, "SNE V%X, V%X", x, y); break;
+        case OP_LDI:        snprintf(text, size, "LD I, 0x%03x", op.nnn); break;
+        case OP_RND:        snprintf(text, size, "RND V%X, 0x%02x", x, op.kk); break;
+        case OP_DRW:        snprintf(text, size, "DRW V%X, V%X, %d", x, y, op.n); break;
+        case OP_SKP:        snprintf(text, size, "SKP V%X", x); break;
+        case OP_SKPN:       snprintf(text, size, "SKNP V%X", x); break;
+        case OP_LDDT:       snprintf(text, size, "LD V%X, DT", x); break;
+        case OP_LDK:        snprintf(text, size, "LD V%X, K", x); break;
+        case OP_SETDT:      snprintf(text, size, "LD DT, V%X", x); break;
+        case OP_SETST:      snprintf(text, size, "LD ST, V%X", x); break;
+        case OP_ADDI:       snprintf(text, size, "ADD I, V%X", x); break;
+        case OP_LDCH:       snprintf(text, size, "LD F, V%X", x); break;
+        case OP_BCD:        snprintf(text, size, "LD B, V%X", x); break;
+        case OP_PUSHR:      snprintf(text, size, "LD [I], V%X", x); break;
+        case OP_POPR:       snprintf(text, size, "LD V%X, [I]", x); break;
+        case OP_SCD:        snprintf(text, size, "SCD %d", op.n); break;
+        case OP_SCR:        snprintf(text, size, "SCR"); break;
+        case OP_SCL:        snprintf(text, size, "SCL"); break;
+        case OP_EXIT:       snprintf(text, size, "EXIT"); break;
+        case OP_LOWRES:     snprintf(text, size, "LOW"); break;
+        case OP_HIGHRES:    snprintf(text, size, "HIGH"); break;
+        case OP_LDHF:       snprintf(text, size, "LD HF, V%X", x); break;
+        case OP_SAVEF:      snprintf(text, size, "LD R, V%X", x); break;
+        case OP_LOADF:      snprintf(text, size, "LD V%X, R", x); break;
+        case OP_SCU:        snprintf(text, size, "SCU %d", op.n); break;
+        case OP_SAVER:      snprintf(text, size, "SAVE V%X - V%X", x, y); break;
+        case OP_LOADR:      snprintf(text, size, "LOAD V%X - V%X", x, y); break;
+        case OP_LDIL:       snprintf(text, size, "LD I, 0x%04x", readWord(analysis, address + 2)); break;
+        case OP_PLANE:      snprintf(text, size, "PLANE %d", x); break;
+        case OP_LDAUD:      snprintf(text, size, "AUDIO"); break;
+        case OP_PITCH:      snprintf(text, size, "PITCH V%X", x); break;
+        case OP_JPV:        snprintf(text, size, "JP V0, 0x%03x", op.nnn); break;
+        default:            snprintf(text, size, "DW 0x%04x", op.instruction); break;
+    }
+}
+
+const char *ANALYSIS_NoteName(int kind)
+{
+    switch (kind)
+    {
+        case ANALYSIS_NOTE_ILLEGAL_OPCODE:  return "illegal opcode";
+        case ANALYSIS_NOTE_SELF_MODIFYING:  return "self-modifying store";
+        case ANALYSIS_NOTE_UNKNOWN_STORE:   return "store through unknown I";
+        case ANALYSIS_NOTE_INDIRECT_JUMP:   return "indirect jump";
+        case ANALYSIS_NOTE_OVERLAP:         return "overlapping instruction";
+        case ANALYSIS_NOTE_OUTSIDE:         return "leaves memory";
+        default:                            return "unknown";
+    }
+}
+
+const char *ANALYSIS_EdgeName(int kind)
+{
+    switch (kind)
+    {
+        case ANALYSIS_EDGE_NEXT:    return "next";
+        case ANALYSIS_EDGE_SKIP:    return "skip";
+        case ANALYSIS_EDGE_JUMP:    return "jump";
+        case ANALYSIS_EDGE_CALL:    return "call";
+        case ANALYSIS_EDGE_RETURN:  return "return";
+        default:                    return "unknown";
+    }
+}
+
+// Writes label of the block starting at address, sub_ for CALL targets
+static void writeLabel(const Analysis *analysis, FILE *fp, int address)
+{
+    fprintf(fp, "%s_%03x", (analysis->flags[address] & ANALYSIS_CALLED) ? "sub" : "L", address);
+}
+
+int ANALYSIS_WriteListing(const Analysis *analysis, FILE *fp)
+{
+    char text[64];
+
+    fprintf(fp, "; %s program, entry 0x%03x, %d blocks\n", CHIP_ModelName(analysis->model), analysis->entry,
+        analysis->blockCount);
+
+    for (int address = 0; address < analysis->memorySize; )
+    {
+        byte flags = analysis->flags[address];
+
+        if (flags & ANALYSIS_CODE)
+        {
+            if (flags & ANALYSIS_LEADER)
+            {
+                fputc('\n', fp);
+                writeLabel(analysis, fp, address);
+                fprintf(fp, ":\n");
+            }
+
+            int size = ANALYSIS_InstructionSize(analysis, address);
+
+            ANALYSIS_Format(analysis, address, text, sizeof(text));
+            fprintf(fp, "    0x%03x  %04x  %s\n", address, readWord(analysis, address), text);
+
+            address += size;
+            continue;
+        }
+
+        if (address < LOAD_ADDRESS || address >= analysis->programEnd)
+        {
+            address++;
+            continue;
+        }
+
+        // data rows end at code and at addresses loaded into I, which start a new row
+        fprintf(fp, "    0x%03x  db", address);
+
+        for (int i = 0; i < 8 && address < analysis->programEnd; i++)
+        {
+            fprintf(fp, "%s0x%02x", i ? ", " : " ", analysis->memory[address++]);
+
+            if (analysis->flags[address] & (ANALYSIS_CODE | ANALYSIS_DATA))
+            {
+                break;
+            }
+        }
+
+        fputc('\n', fp);
+    }
+
+    if (analysis->noteCount > 0)
+    {
+        fprintf(fp, "\n; notes\n");
+    }
+
+    for (int i = 0; i < analysis->noteCount; i++)
+    {
+        const AnalysisNote *note = &analysis->notes[i];
+
+        fprintf(fp, ";   0x%03x  %s", note->address, ANALYSIS_NoteName(note->kind));
+
+        if (note->target >= 0)
+        {
+            fprintf(fp, " 0x%03x", note->target);
+        }
+
+        fputc('\n', fp);
+    }
+
+    return ferror(fp) ? -1 : 0;
+}
+
+int ANALYSIS_WriteDOT(const Analysis *analysis, FILE *fp)
+{
+    char text[64];
+
+    fprintf(fp, "digraph program {\n    node [shape=box, fontname=\"monospace\"];\n");
+
+    for (int n = 0; n < analysis->blockCount; n++)
+    {
+        const AnalysisBlock *block = &analysis->blocks[n];
+
+        fprintf(fp, "    b%03x [label=\"", block->start);
+        writeLabel(analysis, fp, block->start);
+        fprintf(fp, "\\l");
+
+        for (int pc = block->start; pc < block->end; pc += ANALYSIS_InstructionSize(analysis, pc))
+        {
+            ANALYSIS_Format(analysis, pc, text, sizeof(text));
+            fprintf(fp, "%03x  %s\\l", pc, text);
+        }
+
+        fprintf(fp, "\"];\n");
+
+        for (int i = 0; i < block->edgeCount; i++)
+        {
+            fprintf(fp, "    b%03x -> b%03x [label=\"%s\"%s];\n", block->start, block->targets[i],
+                ANALYSIS_EdgeName(block->kinds[i]), block->kinds[i] == ANALYSIS_EDGE_RETURN ? ", style=dashed" : "");
+        }
+    }
+
+    fprintf(fp, "}\n");
+
+    return ferror(fp) ? -1 : 0;
+}
+
+int ANALYSIS_WriteJSON(const Analysis *analysis, FILE *fp)
+{
+    int code = 0, data = 0;
+
+    for (int address = LOAD_ADDRESS; address < analysis->programEnd; address++)
+    {
+        if (analysis->flags[address] & (ANALYSIS_CODE | ANALYSIS_OPERAND))
+        {
+            code++;
+        }
+        else
+        {
+            data++;
+        }
+    }
+
+    fprintf(fp, "{\n  \"model\": \"%s\",\n  \"entry\": %d,\n  \"code_bytes\": %d,\n  \"data_bytes\": %d,\n  \"blocks\": [",
+        CHIP_ModelName(analysis->model), analysis->entry, code, data);
+
+    for (int n = 0; n < analysis->blockCount; n++)
+    {
+        const AnalysisBlock *block = &analysis->blocks[n];
+
+        fprintf(fp, "%s\n    {\"start\": %d, \"end\": %d, \"instructions\": %d, \"called\": %s, ",
+            n ? "," : "", block->start, block->end, block->instructions,
+            (analysis->flags[block->start] & ANALYSIS_CALLED) ? "true" : "false");
+
+        if (block->I >= 0)
+        {
+            fprintf(fp, "\"I\": %d, \"edges\": [", block->I);
+        }
+        else
+        {
+            fprintf(fp, "\"I\": null, \"edges\": [");
+        }
+
+        for (int i = 0; i < block->edgeCount; i++)
+        {
+            fprintf(fp, "%s{\"kind\": \"%s\", \"target\": %d}", i ? ", " : "", ANALYSIS_EdgeName(block->kinds[i]),
+                block->targets[i]);
+        }
+
+        fprintf(fp, "]}");
+    }
+
+    fprintf(fp, "\n  ],\n  \"notes\": [");
+
+    for (int i = 0; i < analysis->noteCount; i++)
+    {
+        const AnalysisNote *note = &analysis->notes[i];
+
+        fprintf(fp, "%s\n    {\"address\": %d, \"kind\": \"%s\"", i ? "," : "", note->address,
+            ANALYSIS_NoteName(note->kind));
+
+        if (note->target >= 0)
+        {
+            fprintf(fp, ", \"target\": %d", note->target);
+        }
+
+        fputc('}', fp);
+    }
+
+    fprintf(fp, "\n  ]\n}\n");
+
+    return ferror(fp) ? -1 : 0;
+}
@@ -0,0 +1,109 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdio.h>
+
+#include "chip8.h"
+
+// Static analysis
+// decodes the program of a machine from its PC into basic blocks, following jump, call and skip edges
+// bytes reached as instructions are code, the rest of the program is data
+// I is tracked as a constant along the control flow graph, so stores through I (Fx33, Fx55, 5xy2)
+// with a known target are checked against code, stores with an unknown target are reported as well
+// Analysis holds a copy of RAM and a flag byte per address, allocate it statically or on the heap
+
+// Flags of an address
+#define ANALYSIS_CODE       0x01    // first byte of an instruction
+#define ANALYSIS_OPERAND    0x02    // any other byte of an instruction
+#define ANALYSIS_LEADER     0x04    // first instruction of a basic block
+#define ANALYSIS_DATA       0x08    // loaded into I by LD I, addr
+#define ANALYSIS_WRITTEN    0x10    // stored to by an instruction with a known I
+#define ANALYSIS_CALLED     0x20    // target of a CALL
+
+// Edges between blocks
+#define ANALYSIS_EDGE_NEXT      0   // falls through, or a skip that is not taken
+#define ANALYSIS_EDGE_SKIP      1   // skip taken
+#define ANALYSIS_EDGE_JUMP      2
+#define ANALYSIS_EDGE_CALL      3
+#define ANALYSIS_EDGE_RETURN    4   // from a CALL to the instruction after it
+#define ANALYSIS_EDGE_COUNT     5
+
+// Findings
+#define ANALYSIS_NOTE_ILLEGAL_OPCODE    0   // reachable instruction unknown to the model
+#define ANALYSIS_NOTE_SELF_MODIFYING    1   // store through a known I overlaps code
+#define ANALYSIS_NOTE_UNKNOWN_STORE     2   // store through an I not known statically, may modify code
+#define ANALYSIS_NOTE_INDIRECT_JUMP     3   // JP V0, addr, its targets are not followed
+#define ANALYSIS_NOTE_OVERLAP           4   // instruction starts inside another instruction
+#define ANALYSIS_NOTE_OUTSIDE           5   // control flow leaves the memory of the model
+#define ANALYSIS_NOTE_COUNT             6
+
+// I value before the first instruction of a block is known, -1 if it varies, -2 if no path reached it yet
+#define ANALYSIS_I_VARIES   -1
+#define ANALYSIS_I_UNSET    -2
+
+typedef struct AnalysisBlock
+{
+    word start;             // address of the first instruction
+    int end;                // address after the last instruction, RAM_SIZE for a block ending at the top
+    int instructions;
+    int edgeCount;
+    word targets[2];        // successors, both ends of a skip or a CALL and its return
+    byte kinds[2];          // ANALYSIS_EDGE_ of every successor
+    int I;                  // I on entry, or ANALYSIS_I_
+} AnalysisBlock;
+
+typedef struct AnalysisNote
+{
+    word address;           // instruction the note is about
+    byte kind;              // ANALYSIS_NOTE_
+    int target;             // address stored to or jumped to, -1 if none
+} AnalysisNote;
+
+typedef struct Analysis
+{
+    int model;                  // CHIP_MODEL_ the program was decoded for
+    int memorySize;
+    word entry;                 // PC the analysis started from
+    int programEnd;             // address after the program
+    byte memory[RAM_SIZE];      // RAM of the machine when it was analysed
+    byte flags[RAM_SIZE];       // ANALYSIS_ flags by address
+
+    AnalysisBlock *blocks;      // sorted by start address
+    int blockCount;
+    AnalysisNote *notes;        // sorted by address
+    int noteCount;
+} Analysis;
+
+// Analyses the program of size bytes loaded at LOAD_ADDRESS of chip, starting from its PC
+// returns 0 or -1 if out of memory, analysis must be released with ANALYSIS_Free
+int ANALYSIS_Run(Analysis *analysis, const Chip8 *chip, int size);
+
+void ANALYSIS_Free(Analysis *analysis);
+
+// Returns index of the block starting at address, or -1
+int ANALYSIS_FindBlock(const Analysis *analysis, int address);
+
+// Returns instruction at address decoded for the model, OP_UNKNOWN for instructions the model does not know
+CHIP_Op ANALYSIS_Decode(const Analysis *analysis, int address);
+
+// Returns bytes of the instruction at address, 4 for F000 nnnn on XO-CHIP, else 2
+int ANALYSIS_InstructionSize(const Analysis *analysis, int address);
+
+// Writes instruction at address in assembler syntax, e.g. "LD V3, 0x1f"
+void ANALYSIS_Format(const Analysis *analysis, int address, char *text, int size);
+
+const char *ANALYSIS_NoteName(int kind);
+
+const char *ANALYSIS_EdgeName(int kind);
+
+// Exports, return 0 on success or -1 on error
+
+// Program as code with block labels and data as db rows, followed by the notes
+int ANALYSIS_WriteListing(const Analysis *analysis, FILE *fp);
+
+// Control flow graph for Graphviz, one node per block
+int ANALYSIS_WriteDOT(const Analysis *analysis, FILE *fp);
+
+int ANALYSIS_WriteJSON(const Analysis *analysis, FILE *fp);
+
+#endif
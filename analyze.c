@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "analysis.h"
+
+// Static analyzer
+// prints a disassembly of a ROM with its basic blocks, data and findings, optionally exports the control
+// flow graph as Graphviz DOT and the analysis as JSON
+
+void usage()
+{
+    fprintf(stderr,
+        "usage: chip8-analyze ROM [options]\n"
+        "  --model NAME     chip8, schip or xochip (default chip8)\n"
+        "  --dot F          write the control flow graph to F\n"
+        "  --json F         write blocks, edges and notes to F\n"
+        "  --quiet          do not print the listing\n"
+        "exits with 1 if the program has illegal opcodes or self-modifying stores\n");
+    exit(2);
+}
+
+// Prints that name is no known kind of setting and exits
+void unknown(const char *kind, const char *name)
+{
+    fprintf(stderr, "Unknown %s: %s\n", kind, name);
+    exit(2);
+}
+
+// Writes analysis to fname with write, returns 0 or -1 on error
+int writeFile(const char *fname, const Analysis *analysis, int (*write)(const Analysis *, FILE *))
+{
+    FILE *fp = fopen(fname, "w");
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    int status = write(analysis, fp);
+
+    return fclose(fp) != 0 ? -1 : status;
+}
+
+int main(int argc, char *argv[])
+{
+    char *rom = NULL, *dot = NULL, *json = NULL;
+    int model = CHIP_MODEL_CHIP8;
+    int quiet = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quiet") == 0)
+            quiet = 1;
+        else if (argv[i][0] != '-')
+            rom = argv[i];
+        else if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argv[i], "--model") == 0)
+        {
+            if ((model = CHIP_ModelByName(argv[++i])) < 0)
+                unknown("model", argv[i]);
+        }
+        else if (strcmp(argv[i], "--dot") == 0)
+            dot = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0)
+            json = argv[++i];
+        else
+            usage();
+    }
+
+    if (rom == NULL)
+    {
+        usage();
+    }
+
+    Chip8 *chip = calloc(1, sizeof(Chip8));
+    Analysis *analysis = calloc(1, sizeof(Analysis));
+
+    if (chip == NULL || analysis == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    CHIP_Initalize(chip);
+    CHIP_SetModel(chip, model);
+
+    int size = CHIP_LoadProgram(chip, rom);
+
+    if (size < 0)
+    {
+        fprintf(stderr, "%s: %s\n", rom, CHIP_LoadError(chip, size));
+        return 1;
+    }
+
+    if (size > CHIP_ProgramSize(chip))
+    {
+        fprintf(stderr, "%s: %s, loaded %d of %d bytes\n", rom, CHIP_LoadError(chip, size), CHIP_ProgramSize(chip),
+            size);
+    }
+
+    if (ANALYSIS_Run(analysis, chip, size) != 0)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (!quiet)
+    {
+        ANALYSIS_WriteListing(analysis, stdout);
+    }
+
+    if (dot != NULL && writeFile(dot, analysis, ANALYSIS_WriteDOT) != 0)
+    {
+        fprintf(stderr, "Unable to write %s\n", dot);
+        return 1;
+    }
+
+    if (json != NULL && writeFile(json, analysis, ANALYSIS_WriteJSON) != 0)
+    {
+        fprintf(stderr, "Unable to write %s\n", json);
+        return 1;
+    }
+
+    int findings = 0;
+
+    for (int i = 0; i < analysis->noteCount; i++)
+    {
+        int kind = analysis->notes[i].kind;
+        findings += kind == ANALYSIS_NOTE_ILLEGAL_OPCODE || kind == ANALYSIS_NOTE_SELF_MODIFYING;
+    }
+
+    ANALYSIS_Free(analysis);
+    free(analysis);
+    free(chip);
+
+    return findings ? 1 : 0;
+}
@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+#include "scheduler.h"
+
+// Native runner of a translated ROM
+// runs the program linked in as AOT_program headless, --verify runs the reference interpreter next to it
+// and compares the machines after every frame
+
+#define DEFAULT_FRAMES  3600
+#define DEFAULT_IPF     1000
+
+// Most instructions run on the backend before the translated code gets another chance
+#define AOT_BATCH       32
+
+int AOT_Create(AOT_Machine *machine, Chip8 *chip, const AOT_Program *program)
+{
+    machine->chip = chip;
+    machine->program = program;
+    machine->interpreted = 0;
+    machine->code = malloc(RAM_SIZE);
+    machine->stale = calloc(program->blockCount + 1, 1);
+
+    if (machine->code == NULL || machine->stale == NULL)
+    {
+        AOT_Free(machine);
+        return -1;
+    }
+
+    // the font below the ROM is part of RAM of chip, code outside the ROM comes from zeroed memory
+    CHIP_ReadMemory(chip, 0, machine->code, LOAD_ADDRESS);
+    memset(machine->code + LOAD_ADDRESS, 0, RAM_SIZE - LOAD_ADDRESS);
+    memcpy(machine->code + LOAD_ADDRESS, program->rom, program->size);
+
+    memset(machine->owner, 0xFF, sizeof(machine->owner));
+    memset(machine->length, 0, sizeof(machine->length));
+    memset(machine->pageBlocks, 0xFF, sizeof(machine->pageBlocks));
+
+    for (int n = 0; n < program->blockCount; n++)
+    {
+        const AOT_Block *block = &program->blocks[n];
+        int length;
+
+        for (int address = block->start; address < block->end; address += length)
+        {
+            const byte *code = machine->code + (address & (RAM_SIZE - 1));
+
+            // XO-CHIP F000 nnnn is the only instruction of 4 bytes
+            length = program->model == CHIP_MODEL_XOCHIP && address + 1 < RAM_SIZE && code[0] == 0xF0 &&
+                code[1] == 0x00 ? 4 : 2;
+
+            machine->owner[address & (RAM_SIZE - 1)] = n;
+            machine->length[address & (RAM_SIZE - 1)] = length;
+
+            for (int i = 0; i < length; i++)
+            {
+                int *range = machine->pageBlocks[((address + i) & (RAM_SIZE - 1)) / PAGE_SIZE];
+
+                range[0] = range[0] == -1 ? n : range[0];
+                range[1] = n;
+            }
+        }
+
+        AOT_Check(machine, n);
+    }
+
+    return 0;
+}
+
+void AOT_Free(AOT_Machine *machine)
+{
+    free(machine->code);
+    free(machine->stale);
+    machine->code = NULL;
+    machine->stale = NULL;
+}
+
+int AOT_Check(AOT_Machine *machine, int n)
+{
+    const AOT_Block *block = &machine->program->blocks[n];
+    int stale = 0;
+
+    for (int address = block->start; address < block->end && !stale; address++)
+    {
+        stale = CHIP_ReadByte(machine->chip, address) != machine->code[address & (RAM_SIZE - 1)];
+    }
+
+    int hit = stale && !machine->stale[n];
+    machine->stale[n] = stale;
+
+    return hit;
+}
+
+// Checks the blocks with instructions in the pages set in dirtyPages of the machine and moves the bits to dirty
+static void checkPages(AOT_Machine *machine, uint64_t *dirty)
+{
+    Chip8 *chip = machine->chip;
+
+    for (int word = 0; word < PAGE_COUNT / 64; word++)
+    {
+        uint64_t bits = chip->dirtyPages[word];
+
+        dirty[word] |= bits;
+        chip->dirtyPages[word] = 0;
+
+        for (; bits != 0; bits &= bits - 1)
+        {
+            const int *range = machine->pageBlocks[word * 64 + __builtin_ctzll(bits)];
+
+            for (int n = range[0]; n >= 0 && n <= range[1]; n++)
+            {
+                AOT_Check(machine, n);
+            }
+        }
+    }
+}
+
+long AOT_Interpret(AOT_Machine *machine, long cycles)
+{
+    Chip8 *chip = machine->chip;
+    uint64_t dirty[PAGE_COUNT / 64];
+    long done = 0;
+
+    // the pages the batches write are found in dirtyPages, the bits set before are put back afterwards
+    memcpy(dirty, chip->dirtyPages, sizeof(dirty));
+    memset(chip->dirtyPages, 0, sizeof(dirty));
+
+    while (done < cycles && !chip->halted)
+    {
+        long batch = cycles - done < AOT_BATCH ? cycles - done : AOT_BATCH;
+
+        CHIP_EmulateCycles(chip, batch);
+        done += batch;
+        checkPages(machine, dirty);
+
+        int n = machine->owner[chip->PC];
+
+        if (n >= 0 && !machine->stale[n])
+        {
+            break;
+        }
+    }
+
+    memcpy(chip->dirtyPages, dirty, sizeof(dirty));
+    machine->interpreted += done;
+
+    return done;
+}
+
+void AOT_Run(AOT_Machine *machine, long cycles)
+{
+    Chip8 *chip = machine->chip;
+    uint64_t start = chip->cycles;
+
+    if (chip->model != machine->program->model || chip->quirks != machine->program->quirks)
+    {
+        CHIP_EmulateCycles(chip, cycles);
+        return;
+    }
+
+    // running the halting instruction again would not change the machine, only time passes
+    if (!chip->halted)
+    {
+        machine->program->run(machine, cycles);
+    }
+
+    // batches run on the backend have counted their cycles already
+    chip->cycles = start + cycles;
+}
+
+void AOT_RunFrame(AOT_Machine *machine, int instructionsPerFrame)
+{
+    AOT_Run(machine, instructionsPerFrame);
+    CHIP_TickTimers(machine->chip);
+}
+
+void usage()
+{
+    fprintf(stderr,
+        "usage: chip8-aot [options]\n"
+        "  --frames N       run N frames (default %d)\n"
+        "  --ipf N          instructions per frame (default %d)\n"
+        "  --seed N         seed of the RND generator (default 1)\n"
+        "  --keys N         press random keys from seed N, 0 for none (default 0)\n"
+        "  --verify         run the interpreter alongside and compare the machines after every frame\n",
+        DEFAULT_FRAMES, DEFAULT_IPF);
+    exit(2);
+}
+
+// Presses or releases one key every few frames, same keys for every seed
+static void randomKey(Chip8 *chip, Chip8 *reference, uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+
+    if ((*state >> 16 & 3) != 0)
+    {
+        return;
+    }
+
+    int key = *state >> 20 & 0xF;
+    int pressed = *state >> 24 & 1;
+
+    CHIP_SetKey(chip, key, pressed);
+
+    if (reference != NULL)
+    {
+        CHIP_SetKey(reference, key, pressed);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const AOT_Program *program = &AOT_program;
+    long frames = DEFAULT_FRAMES;
+    int ipf = DEFAULT_IPF;
+    uint32_t seed = 1, keys = 0;
+    int verify = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--verify") == 0)
+            verify = 1;
+        else if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argv[i], "--frames") == 0)
+            frames = atol(argv[++i]);
+        else if (strcmp(argv[i], "--ipf") == 0)
+            ipf = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0)
+            seed = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--keys") == 0)
+            keys = strtoul(argv[++i], NULL, 0);
+        else
+            usage();
+    }
+
+    if (frames <= 0 || ipf <= 0)
+    {
+        usage();
+    }
+
+    Chip8 *chip = calloc(1, sizeof(Chip8));
+    Chip8 *reference = verify ? calloc(1, sizeof(Chip8)) : NULL;
+    AOT_Machine *machine = calloc(1, sizeof(AOT_Machine));
+
+    if (chip == NULL || machine == NULL || (verify && reference == NULL))
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    CHIP_Initalize(chip);
+    CHIP_SetModel(chip, program->model);
+    CHIP_SetQuirks(chip, program->quirks);
+    CHIP_LoadProgramMemory(chip, program->rom, program->size);
+    CHIP_Seed(chip, seed);
+
+    if (AOT_Create(machine, chip, program) != 0)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (verify)
+    {
+        CHIP_Fork(reference, chip);
+        CHIP_SetDispatch(reference, CHIP_DISPATCH_TABLE);
+    }
+
+    double translated = 0, interpreted = 0;
+
+    for (long frame = 0; frame < frames; frame++)
+    {
+        if (keys != 0)
+        {
+            randomKey(chip, reference, &keys);
+        }
+
+        double start = SCHED_Now();
+        AOT_RunFrame(machine, ipf);
+        translated += SCHED_Now() - start;
+
+        if (!verify)
+        {
+            continue;
+        }
+
+        start = SCHED_Now();
+        CHIP_RunFrame(reference, ipf);
+        interpreted += SCHED_Now() - start;
+
+        if (!CHIP_CompareState(chip, reference) || chip->halted != reference->halted ||
+            chip->fault != reference->fault || chip->cycles != reference->cycles)
+        {
+            fprintf(stderr, "%s: differs from the interpreter after frame %ld, PC 0x%03x, interpreter PC 0x%03x\n",
+                program->name, frame + 1, chip->PC, reference->PC);
+            return 1;
+        }
+    }
+
+    double instructions = (double) frames * ipf;
+
+    printf("%s: %ld frames, %.0f instructions, %.1f%% interpreted, %.2f ns/instruction", program->name, frames,
+        instructions, 100.0 * machine->interpreted / instructions, translated * 1e9 / instructions);
+
+    if (verify)
+    {
+        printf(", interpreter %.2f ns/instruction, %.1fx, matches frame for frame", interpreted * 1e9 / instructions,
+            translated > 0 ? interpreted / translated : 0);
+    }
+
+    printf("\n%s display hash %016llx", program->name, (unsigned long long) CHIP_HashDisplay(chip));
+
+    if (chip->halted)
+    {
+        printf(", halted at 0x%03x", chip->PC);
+    }
+
+    if (chip->fault != CHIP_FAULT_NONE)
+    {
+        printf(", %s", CHIP_FaultName(chip->fault));
+    }
+
+    printf("\n");
+
+    AOT_Free(machine);
+    CHIP_Free(chip);
+
+    if (reference != NULL)
+    {
+        CHIP_Free(reference);
+    }
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "chip8.h"
+
+// Ahead-of-time translated programs
+// chip8-translate writes a ROM as C source, every basic block found by the static analysis becomes a labeled
+// run of C statements on registers held in locals, a switch on PC dispatches returns, indirect jumps and
+// addresses the analysis did not reach
+// a store into the code of a block marks it stale until its bytes match the translated code again, stale blocks
+// and untranslated addresses run on the dispatch backend of the machine, so results are identical to
+// CHIP_EmulateCycles
+
+typedef struct AOT_Machine AOT_Machine;
+
+// Block of translated code
+typedef struct AOT_Block
+{
+    word start;     // address of the first instruction
+    int end;        // address after the last instruction, RAM_SIZE for a block ending at the top
+} AOT_Block;
+
+// Program written by chip8-translate
+typedef struct AOT_Program
+{
+    const char *name;           // file name of the ROM
+    int model;                  // CHIP_MODEL_ and CHIP_QUIRKS_ the code was translated for
+    int quirks;
+    const byte *rom;            // the ROM itself, loaded at LOAD_ADDRESS
+    int size;
+    const AOT_Block *blocks;    // sorted by start address
+    int blockCount;
+
+    // runs at most cycles instructions of a running machine, returns when the budget is spent or it halts
+    void (*run)(AOT_Machine *machine, long cycles);
+} AOT_Program;
+
+// Machine running a translated program
+struct AOT_Machine
+{
+    Chip8 *chip;
+    const AOT_Program *program;
+    int owner[RAM_SIZE];        // block of the translated instruction starting at every address, -1 for none
+    byte length[RAM_SIZE];      // size of that instruction
+    int pageBlocks[PAGE_COUNT][2];  // first and last block with an instruction reaching into every page, -1 for none
+    byte *code;                 // RAM the program was translated from
+    byte *stale;                // 1 for every block whose code differs from it
+    long interpreted;           // instructions run on the backend of the machine
+};
+
+// Program linked into the runner, defined by the generated source
+extern const AOT_Program AOT_program;
+
+// Attaches program to chip, blocks whose code differs from RAM of chip start stale
+// returns 0 or -1 if out of memory
+int AOT_Create(AOT_Machine *machine, Chip8 *chip, const AOT_Program *program);
+
+void AOT_Free(AOT_Machine *machine);
+
+// Runs cycles instructions like CHIP_EmulateCycles
+// a machine of another model or quirks profile than the program runs on its own dispatch backend
+void AOT_Run(AOT_Machine *machine, long cycles);
+
+// Runs one 60 Hz frame - instructionsPerFrame instructions followed by one timer tick
+void AOT_RunFrame(AOT_Machine *machine, int instructionsPerFrame);
+
+// Used by translated code
+
+// Compares the code of block n with RAM and sets its stale flag
+// returns 1 if the block went stale
+int AOT_Check(AOT_Machine *machine, int n);
+
+// Must be called after size bytes at address were stored, checks the blocks of the instructions holding them
+// returns 1 if a block went stale, the running block must then be left
+static inline int AOT_Written(AOT_Machine *machine, int address, int size)
+{
+    int hit = 0;
+
+    // most stores go to pages no instruction reaches into, size is at most one page
+    if (machine->pageBlocks[(address & (RAM_SIZE - 1)) / PAGE_SIZE][0] < 0 &&
+        machine->pageBlocks[((address + size - 1) & (RAM_SIZE - 1)) / PAGE_SIZE][0] < 0)
+    {
+        return 0;
+    }
+
+    // instructions are at most 4 bytes long, one starting up to 3 bytes before address may hold a written byte
+    for (int i = -3; i < size; i++)
+    {
+        int start = (address + i) & (RAM_SIZE - 1);
+
+        if (machine->owner[start] >= 0 && i + machine->length[start] > 0)
+        {
+            hit |= AOT_Check(machine, machine->owner[start]);
+        }
+    }
+
+    return hit;
+}
+
+// Runs at most cycles instructions from PC on the dispatch backend of the machine, in batches, until PC is on
+// a live translated instruction again, stores are checked against the blocks
+// returns number of instructions run
+long AOT_Interpret(AOT_Machine *machine, long cycles);
+
+#endif
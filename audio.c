@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+#include "scheduler.h"
+#include "audio.h"
+
+// Size of the WAV header written by AUDIO_OpenWAV
+#define WAV_HEADER_SIZE     44
+
+int AUDIO_Init(Audio *audio, int sampleRate, int latency)
+{
+    unsigned size = 1;
+
+    // one slot stays free to tell a full ring from an empty one
+    while (size < (unsigned) latency + 1)
+    {
+        size <<= 1;
+    }
+
+    audio->ring = malloc(size * sizeof(int16_t));
+
+    if (audio->ring == NULL)
+    {
+        return -1;
+    }
+
+    audio->sampleRate = sampleRate;
+    audio->latency = latency;
+    audio->volume = AUDIO_VOLUME;
+    audio->phase = 0;
+    audio->step = (uint32_t) ((uint64_t) AUDIO_FREQUENCY * 0x100000000ULL / sampleRate);
+    audio->remainder = 0;
+    audio->mask = size - 1;
+
+    atomic_store(&audio->head, 0);
+    atomic_store(&audio->tail, 0);
+    atomic_store(&audio->dropped, 0);
+    atomic_store(&audio->missing, 0);
+
+    return 0;
+}
+
+void AUDIO_Free(Audio *audio)
+{
+    free(audio->ring);
+    audio->ring = NULL;
+}
+
+void AUDIO_Frame(Audio *audio, const Chip8 *chip)
+{
+    // whole samples of this frame, fractions carry over to the next frame
+    int samples = (audio->remainder + audio->sampleRate) / SCHED_FRAME_RATE;
+    audio->remainder = (audio->remainder + audio->sampleRate) % SCHED_FRAME_RATE;
+
+    unsigned head = atomic_load_explicit(&audio->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&audio->tail, memory_order_acquire);
+    int queued = (head - tail) & audio->mask;
+    int room = audio->latency - queued;
+
+    if (room < samples)
+    {
+        atomic_fetch_add_explicit(&audio->dropped, samples - (room > 0 ? room : 0), memory_order_relaxed);
+        samples = room > 0 ? room : 0;
+    }
+
+    for (int i = 0; i < samples; i++)
+    {
+        int16_t sample = 0;
+
+        // the wave keeps running while silent so consecutive beeps join without clicks
+        if (chip->soundFlag)
+        {
+            sample = (audio->phase & 0x80000000) ? audio->volume : -audio->volume;
+        }
+
+        audio->phase += audio->step;
+        audio->ring[(head + i) & audio->mask] = sample;
+    }
+
+    atomic_store_explicit(&audio->head, (head + samples) & audio->mask, memory_order_release);
+}
+
+int AUDIO_Read(Audio *audio, int16_t *out, int count)
+{
+    unsigned tail = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&audio->head, memory_order_acquire);
+    int queued = (head - tail) & audio->mask;
+    int copied = queued < count ? queued : count;
+
+    for (int i = 0; i < copied; i++)
+    {
+        out[i] = audio->ring[(tail + i) & audio->mask];
+    }
+
+    if (copied < count)
+    {
+        memset(&out[copied], 0, (count - copied) * sizeof(int16_t));
+        atomic_fetch_add_explicit(&audio->missing, count - copied, memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&audio->tail, (tail + copied) & audio->mask, memory_order_release);
+
+    return copied;
+}
+
+// Writes value as size little endian bytes
+static void putInteger(FILE *fp, uint32_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        fputc(value >> (i * 8) & 0xFF, fp);
+    }
+}
+
+FILE *AUDIO_OpenWAV(const char *fname, int sampleRate)
+{
+    FILE *fp = fopen(fname, "wb");
+
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+
+    // RIFF and data sizes are patched by AUDIO_CloseWAV
+    fwrite("RIFF", 1, 4, fp);
+    putInteger(fp, 0, 4);
+    fwrite("WAVEfmt ", 1, 8, fp);
+    putInteger(fp, 16, 4);              // fmt chunk size
+    putInteger(fp, 1, 2);               // PCM
+    putInteger(fp, 1, 2);               // mono
+    putInteger(fp, sampleRate, 4);
+    putInteger(fp, sampleRate * 2, 4);  // bytes per second
+    putInteger(fp, 2, 2);               // bytes per sample
+    putInteger(fp, 16, 2);              // bits per sample
+    fwrite("data", 1, 4, fp);
+    putInteger(fp, 0, 4);
+
+    return fp;
+}
+
+int AUDIO_WriteWAV(FILE *fp, const int16_t *samples, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        putInteger(fp, (uint16_t) samples[i], 2);
+    }
+
+    return ferror(fp) ? -1 : 0;
+}
+
+int AUDIO_CloseWAV(FILE *fp)
+{
+    long size = ftell(fp);
+    int status = (size < WAV_HEADER_SIZE || ferror(fp)) ? -1 : 0;
+
+    if (status == 0)
+    {
+        fseek(fp, 4, SEEK_SET);
+        putInteger(fp, size - 8, 4);
+        fseek(fp, WAV_HEADER_SIZE - 4, SEEK_SET);
+        putInteger(fp, size - WAV_HEADER_SIZE, 4);
+    }
+
+    if (fclose(fp) != 0)
+    {
+        status = -1;
+    }
+
+    return status;
+}
@@ -0,0 +1,59 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+// Audio
+// the emulation thread turns every 60 Hz frame into a frame worth of square wave samples (silence while soundFlag is clear)
+// and queues them in a single producer single consumer ring, the output side drains it from an audio callback or a file sink
+// the ring is allocated once by AUDIO_Init, producing and consuming samples never allocates or locks
+
+#define AUDIO_SAMPLE_RATE   48000
+#define AUDIO_FREQUENCY     440     // tone in Hz
+#define AUDIO_VOLUME        3000    // peak amplitude of the 16-bit square wave
+
+typedef struct Audio
+{
+    int sampleRate;
+    int latency;            // most samples queued, samples of frames produced beyond it are dropped
+    int16_t volume;
+
+    uint32_t phase;         // square wave position, the top bit selects the half period
+    uint32_t step;          // phase advance per sample
+    int remainder;          // sampleRate * frames % SCHED_FRAME_RATE, carries fractional samples per frame
+
+    int16_t *ring;
+    unsigned mask;          // ring size - 1, ring size is a power of 2
+    atomic_uint head;       // next sample written by the emulation thread
+    atomic_uint tail;       // next sample read by the output
+
+    atomic_ulong dropped;   // samples produced while the ring was at latency
+    atomic_ulong missing;   // samples the output asked for while the ring was empty
+} Audio;
+
+// Allocates the ring for latency queued samples, returns 0 on success or -1 if out of memory
+// small latencies respond faster to the sound timer but underrun sooner when the emulation thread is late
+int AUDIO_Init(Audio *audio, int sampleRate, int latency);
+
+void AUDIO_Free(Audio *audio);
+
+// Producer side - queues the samples of the frame chip just ran, call once after every 60 Hz frame
+void AUDIO_Frame(Audio *audio, const Chip8 *chip);
+
+// Consumer side - copies count queued samples to out, missing samples are filled with silence
+// returns number of queued samples copied
+int AUDIO_Read(Audio *audio, int16_t *out, int count);
+
+// WAV sink - 16-bit mono PCM file, sizes in the header are filled in by AUDIO_CloseWAV
+FILE *AUDIO_OpenWAV(const char *fname, int sampleRate);
+
+// Appends count samples, returns 0 on success or -1 on error
+int AUDIO_WriteWAV(FILE *fp, const int16_t *samples, int count);
+
+// Finishes the header and closes the file, returns 0 on success or -1 on error
+int AUDIO_CloseWAV(FILE *fp);
+
+#endif
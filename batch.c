@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "batch.h"
+
+// Number of chunks each worker slice is split into
+// smaller chunks balance better, bigger chunks touch the shared counters less often
+#define CHUNKS_PER_WORKER   16
+
+// Slice of items owned by one worker
+// owner and thieves both take chunks from the front with an atomic add, so no lock is needed
+typedef struct Queue
+{
+    atomic_int next;    // first item not yet taken
+    int end;            // one past the last item of the slice
+    int chunk;          // number of items taken at once
+} Queue;
+
+typedef struct Pool
+{
+    Queue *queues;
+    int workers;
+    BATCH_Job job;
+    void *context;
+} Pool;
+
+typedef struct Worker
+{
+    Pool *pool;
+    int id;
+} Worker;
+
+typedef struct RunContext
+{
+    Chip8 *machines;
+    long frames;
+    int instructionsPerFrame;
+} RunContext;
+
+int BATCH_CPUCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int) count : 1;
+#endif
+}
+
+// Takes the next chunk from queue and runs job over it
+// returns 0 if queue is already empty
+static int runChunk(Pool *pool, Queue *queue)
+{
+    int start = atomic_fetch_add_explicit(&queue->next, queue->chunk, memory_order_relaxed);
+
+    if (start >= queue->end)
+    {
+        return 0;
+    }
+
+    int stop = (start + queue->chunk < queue->end) ? start + queue->chunk : queue->end;
+
+    for (int i = start; i < stop; i++)
+    {
+        pool->job(i, pool->context);
+    }
+
+    return 1;
+}
+
+static void *workerMain(void *arg)
+{
+    Worker *worker = arg;
+    Pool *pool = worker->pool;
+
+    // drain own slice first
+    while (runChunk(pool, &pool->queues[worker->id]))
+        ;
+
+    // then steal from the others, starting at the next worker so thieves spread out
+    for (int i = 1; i < pool->workers; i++)
+    {
+        Queue *victim = &pool->queues[(worker->id + i) % pool->workers];
+
+        while (runChunk(pool, victim))
+            ;
+    }
+
+    return NULL;
+}
+
+void BATCH_ForEach(int count, int threads, BATCH_Job job, void *context)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (threads <= 0)
+    {
+        threads = BATCH_CPUCount();
+    }
+
+    if (threads > count)
+    {
+        threads = count;
+    }
+
+    Pool pool;
+    pool.workers = threads;
+    pool.job = job;
+    pool.context = context;
+    pool.queues = malloc(sizeof(Queue) * threads);
+
+    Worker *workers = malloc(sizeof(Worker) * threads);
+    pthread_t *handles = malloc(sizeof(pthread_t) * threads);
+
+    // split items into equal contiguous slices
+    for (int i = 0; i < threads; i++)
+    {
+        int begin = (int) ((long long) count * i / threads);
+        int end = (int) ((long long) count * (i + 1) / threads);
+        int chunk = (end - begin) / CHUNKS_PER_WORKER;
+
+        atomic_init(&pool.queues[i].next, begin);
+        pool.queues[i].end = end;
+        pool.queues[i].chunk = chunk > 0 ? chunk : 1;
+
+        workers[i].pool = &pool;
+        workers[i].id = i;
+    }
+
+    // calling thread works as worker 0
+    for (int i = 1; i < threads; i++)
+    {
+        pthread_create(&handles[i], NULL, workerMain, &workers[i]);
+    }
+
+    workerMain(&workers[0]);
+
+    for (int i = 1; i < threads; i++)
+    {
+        pthread_join(handles[i], NULL);
+    }
+
+    free(handles);
+    free(workers);
+    free(pool.queues);
+}
+
+static void runMachine(int index, void *context)
+{
+    RunContext *run = context;
+    Chip8 *chip = &run->machines[index];
+
+    for (long i = 0; i < run->frames; i++)
+    {
+        CHIP_RunFrame(chip, run->instructionsPerFrame);
+    }
+}
+
+void BATCH_Run(Chip8 *machines, int count, long frames, int instructionsPerFrame, int threads)
+{
+    RunContext run;
+    run.machines = machines;
+    run.frames = frames;
+    run.instructionsPerFrame = instructionsPerFrame;
+
+    BATCH_ForEach(count, threads, runMachine, &run);
+}
@@ -0,0 +1,23 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "chip8.h"
+
+// Work item callback
+// @param index - index of the item to process, in range 0 to count - 1
+// @param context - pointer passed to BATCH_ForEach
+typedef void (*BATCH_Job)(int index, void *context);
+
+// Returns number of online processors (at least 1)
+int BATCH_CPUCount();
+
+// Calls job once for every index in 0 to count - 1 on a pool of worker threads
+// each worker owns a slice of the items and steals chunks from other workers once its slice is done
+// @param threads - number of workers, 0 or less uses BATCH_CPUCount()
+void BATCH_ForEach(int count, int threads, BATCH_Job job, void *context);
+
+// Runs frames unthrottled frames of instructionsPerFrame instructions on count independent machines
+// returns once every machine has finished
+void BATCH_Run(Chip8 *machines, int count, long frames, int instructionsPerFrame, int threads);
+
+#endif
@@ -0,0 +1,645 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "block.h"
+#include "lockstep.h"
+
+// Instructions executed per timed run
+#define BENCH_CYCLES    5000000L
+
+// Timed runs per case, after one untimed warm-up run
+#define BENCH_REPEATS   5
+
+// Copies of the measured instruction in an opcode loop
+#define OPCODE_BODY     31
+
+// Machines of the lockstep comparison
+#define BENCH_LANES     16
+
+// Mixed workload - ALU, skips, memory and a small sprite in one loop
+word mixedProgram[] =
+{
+    0x6000,     // LD   V0, 0
+    0x6101,     // LD   V1, 1
+    0xA300,     // LDI  0x300
+    0x7001,     // ADD  V0, 1           <- loop
+    0x8014,     // ADD  V0, V1
+    0x8215,     // SUB  V2, V1
+    0x8306,     // SHR  V3
+    0x3000,     // SE   V0, 0
+    0x4301,     // SNE  V3, 1
+    0xF31E,     // ADD  I, V3
+    0xD011,     // DRW  V0, V1, 1
+    0x1206,     // JP   loop
+};
+
+// Carry and borrow arithmetic only
+word aluProgram[] =
+{
+    0x6103,     // LD   V1, 3
+    0x6205,     // LD   V2, 5
+    0x8014,     // ADD  V0, V1          <- loop
+    0x8025,     // SUB  V0, V2
+    0x8134,     // ADD  V1, V3
+    0x8215,     // SUB  V2, V1
+    0x8324,     // ADD  V3, V2
+    0x8405,     // SUB  V4, V0
+    0x8544,     // ADD  V5, V4
+    0x8655,     // SUB  V6, V5
+    0x1204,     // JP   loop
+};
+
+// Recursion down to a full stack and back
+word callProgram[] =
+{
+    0x6000,     // LD   V0, 0           <- loop
+    0x2206,     // CALL recurse
+    0x1200,     // JP   loop
+    0x7001,     // ADD  V0, 1           <- recurse
+    0x3000 | (STACK_SIZE - 1),  // SE V0, depth
+    0x2206,     // CALL recurse
+    0x00EE,     // RET
+};
+
+// Font sprites scattered over the screen
+word drawProgram[] =
+{
+    0xA000,     // LDI  0x000
+    0x7007,     // ADD  V0, 7           <- loop
+    0x7103,     // ADD  V1, 3
+    0xD015,     // DRW  V0, V1, 5
+    0xD105,     // DRW  V1, V0, 5
+    0x7205,     // ADD  V2, 5
+    0xD20F,     // DRW  V2, V0, 15
+    0xD125,     // DRW  V1, V2, 5
+    0x1202,     // JP   loop
+};
+
+// Register file stored to and loaded from data memory
+word memoryProgram[] =
+{
+    0xA300,     // LDI  0x300           <- loop
+    0x7001,     // ADD  V0, 1
+    0xFF55,     // LD   [I], VF
+    0x7E01,     // ADD  VE, 1
+    0xFF65,     // LD   VF, [I]
+    0x1200,     // JP   loop
+};
+
+// Decimal conversion of a counter read back from memory
+word bcdProgram[] =
+{
+    0xA300,     // LDI  0x300           <- loop
+    0x7001,     // ADD  V0, 1
+    0xF033,     // BCD  V0
+    0xF265,     // LD   V2, [I]
+    0x8314,     // ADD  V3, V1
+    0xF333,     // BCD  V3
+    0x1200,     // JP   loop
+};
+
+// Random skips, machines seeded differently take different paths through the loop
+word randomProgram[] =
+{
+    0xC003,     // RND  V0, 3           <- loop
+    0x3000,     // SE   V0, 0
+    0x7101,     // ADD  V1, 1
+    0x8104,     // ADD  V1, V0
+    0x8216,     // SHR  V2, V1
+    0x8324,     // ADD  V3, V2
+    0x1200,     // JP   loop
+};
+
+typedef struct BenchCase
+{
+    const char *name;
+    const word *program;
+    int length;
+} BenchCase;
+
+#define BENCH_CASE(name, program)   { name, program, sizeof(program) / sizeof(word) }
+
+BenchCase cases[] =
+{
+    BENCH_CASE("mixed", mixedProgram),
+    BENCH_CASE("alu", aluProgram),
+    BENCH_CASE("call", callProgram),
+    BENCH_CASE("draw", drawProgram),
+    BENCH_CASE("memory", memoryProgram),
+    BENCH_CASE("bcd", bcdProgram),
+    BENCH_CASE("random", randomProgram),
+};
+
+#define CASE_COUNT  (int) (sizeof(cases) / sizeof(cases[0]))
+
+// One representative instruction per opcode, run in a loop of OPCODE_BODY copies.
+// Skips are chosen not to skip - V0 is 0, V1 is 1 and only key 0 is held.
+typedef struct BenchOpcode
+{
+    const char *name;
+    word instruction;
+} BenchOpcode;
+
+BenchOpcode opcodes[] =
+{
+    { "CLS",    0x00E0 },
+    { "SE",     0x3055 },
+    { "SNE",    0x4000 },
+    { "SER",    0x5010 },
+    { "SNER",   0x9000 },
+    { "LD",     0x6012 },
+    { "ADD",    0x7001 },
+    { "LDR",    0x8010 },
+    { "OR",     0x8011 },
+    { "AND",    0x8012 },
+    { "XOR",    0x8013 },
+    { "ADDR",   0x8014 },
+    { "SUB",    0x8015 },
+    { "SHR",    0x8016 },
+    { "SUBN",   0x8017 },
+    { "SHL",    0x801E },
+    { "LDI",    0xA300 },
+    { "RND",    0xC0FF },
+    { "DRW",    0xD015 },
+    { "SKP",    0xE19E },
+    { "SKPN",   0xE0A1 },
+    { "LDDT",   0xF007 },
+    { "SETDT",  0xF015 },
+    { "SETST",  0xF018 },
+    { "ADDI",   0xF01E },
+    { "LDCH",   0xF029 },
+    { "BCD",    0xF033 },
+    { "PUSHR",  0xF355 },
+    { "POPR",   0xF365 },
+};
+
+#define OPCODE_COUNT    (int) (sizeof(opcodes) / sizeof(opcodes[0]))
+
+typedef struct Statistics
+{
+    double min;
+    double median;
+    double mean;
+    double deviation;
+    int halted;         // a measured machine halted, the timings are not of the program
+} Statistics;
+
+Chip8 chip;
+
+double now()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// quirks profile of every benchmarked machine
+int quirks = CHIP_QUIRKS_SCHIP;
+
+void loadProgram(Chip8 *machine, const word *program, int length, int dispatch)
+{
+    byte image[RAM_SIZE - LOAD_ADDRESS];
+
+    for (int i = 0; i < length; i++)
+    {
+        image[i * 2] = program[i] >> 8;
+        image[i * 2 + 1] = program[i] & 0xFF;
+    }
+
+    CHIP_Initalize(machine);
+    CHIP_SetQuirks(machine, quirks);
+    CHIP_LoadProgramMemory(machine, image, length * 2);
+    CHIP_SetDispatch(machine, dispatch);
+    machine->Keyboard[0] = 1;
+}
+
+// Opcode loop - LD V1, 1, then LDI 0x300, OPCODE_BODY copies of instruction and a jump back to the LDI
+// I is reloaded every pass, so stores that increment it stay inside memory with every quirks profile
+int opcodeProgram(word *program, word instruction)
+{
+    int length = 0;
+
+    program[length++] = 0x6101;
+    program[length++] = 0xA300;
+
+    for (int i = 0; i < OPCODE_BODY; i++)
+    {
+        program[length++] = instruction;
+    }
+
+    program[length++] = 0x1202;
+
+    return length;
+}
+
+int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+Statistics summarize(double *samples, int count)
+{
+    Statistics statistics;
+    double sum = 0, squares = 0;
+
+    qsort(samples, count, sizeof(double), compareDouble);
+
+    for (int i = 0; i < count; i++)
+    {
+        sum += samples[i];
+    }
+
+    statistics.min = samples[0];
+    statistics.median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    statistics.mean = sum / count;
+
+    for (int i = 0; i < count; i++)
+    {
+        squares += (samples[i] - statistics.mean) * (samples[i] - statistics.mean);
+    }
+
+    statistics.deviation = count > 1 ? sqrt(squares / (count - 1)) : 0;
+    statistics.halted = 0;
+
+    return statistics;
+}
+
+// Nanoseconds per instruction over repeats fresh runs, after an untimed warm-up
+Statistics measure(const word *program, int length, int dispatch, long cycles, int repeats)
+{
+    double samples[repeats];
+    int halted = 0;
+
+    loadProgram(&chip, program, length, dispatch);
+    CHIP_EmulateCycles(&chip, cycles);
+
+    for (int i = 0; i < repeats; i++)
+    {
+        loadProgram(&chip, program, length, dispatch);
+
+        double start = now();
+        CHIP_EmulateCycles(&chip, cycles);
+        samples[i] = (now() - start) * 1e9 / cycles;
+        halted |= chip.halted != CHIP_RUNNING;
+    }
+
+    Statistics statistics = summarize(samples, repeats);
+    statistics.halted = halted;
+
+    return statistics;
+}
+
+// Prints a measurement of a machine that halted, returns 1 if it did
+int reportHalted(const char *name, const char *backend, Statistics statistics)
+{
+    if (statistics.halted)
+    {
+        printf("%s: %s machine halted during the timed runs\n", name, backend);
+    }
+
+    return statistics.halted;
+}
+
+// Every backend must leave the machine in the state the table backend does
+int checkBackends(const BenchCase *benchCase, long cycles)
+{
+    Chip8 reference = {0};
+    int status = 0;
+
+    loadProgram(&reference, benchCase->program, benchCase->length, CHIP_DISPATCH_TABLE);
+    CHIP_EmulateCycles(&reference, cycles);
+
+    for (int dispatch = 1; dispatch < CHIP_DISPATCH_COUNT; dispatch++)
+    {
+        loadProgram(&chip, benchCase->program, benchCase->length, dispatch);
+        CHIP_EmulateCycles(&chip, cycles);
+
+        if (!CHIP_CompareState(&reference, &chip))
+        {
+            printf("%s: %s final state differs from %s\n", benchCase->name, CHIP_DispatchName(dispatch), CHIP_DispatchName(0));
+            status = 1;
+        }
+    }
+
+    // block engine against the reference interpreter, instruction by instruction
+    loadProgram(&chip, benchCase->program, benchCase->length, CHIP_DISPATCH_TABLE);
+    long diverged = BLOCK_DiffTest(&chip, cycles);
+
+    if (diverged >= 0)
+    {
+        printf("%s: blocks diverged from interpreter at cycle %ld\n", benchCase->name, diverged);
+        status = 1;
+    }
+
+    CHIP_Free(&reference);
+
+    return status;
+}
+
+Chip8 lanes[LOCKSTEP_LANES];
+
+// Loads program into count machines, machine n is seeded with n + 1
+void loadLanes(const BenchCase *benchCase, int count, int dispatch)
+{
+    for (int i = 0; i < count; i++)
+    {
+        loadProgram(&lanes[i], benchCase->program, benchCase->length, dispatch);
+        CHIP_Seed(&lanes[i], i + 1);
+    }
+}
+
+// Nanoseconds per instruction of count machines sharing cycles instructions, after an untimed warm-up
+// dispatch -1 runs them in lockstep and sets vectorShare to the part of the instructions run as vector operations
+Statistics measureLanes(const BenchCase *benchCase, int count, int dispatch, long cycles, int repeats, double *vectorShare)
+{
+    double samples[repeats + 1];
+    long perLane = cycles / count;
+    Lockstep lockstep;
+    int halted = 0;
+
+    for (int i = 0; i <= repeats; i++)
+    {
+        loadLanes(benchCase, count, dispatch == -1 ? CHIP_DISPATCH_TABLE : dispatch);
+        LOCKSTEP_Init(&lockstep, lanes, count);
+
+        double start = now();
+
+        if (dispatch == -1)
+        {
+            LOCKSTEP_Run(&lockstep, perLane);
+        }
+        else
+        {
+            for (int lane = 0; lane < count; lane++)
+            {
+                CHIP_EmulateCycles(&lanes[lane], perLane);
+            }
+        }
+
+        samples[i] = (now() - start) * 1e9 / (perLane * count);
+
+        for (int lane = 0; lane < count; lane++)
+        {
+            halted |= lanes[lane].halted != CHIP_RUNNING;
+        }
+    }
+
+    *vectorShare = (double) lockstep.vectorLanes / (lockstep.vectorLanes + lockstep.scalarLanes + (dispatch != -1));
+
+    // the first run was the warm-up
+    Statistics statistics = summarize(samples + 1, repeats);
+    statistics.halted = halted;
+
+    return statistics;
+}
+
+// Machines run in lockstep must end in the state of machines run one by one
+int checkLockstep(const BenchCase *benchCase, int count, long cycles)
+{
+    Lockstep lockstep;
+    int status = 0;
+
+    // frames of 10 instructions also cover the timers
+    loadLanes(benchCase, count, CHIP_DISPATCH_TABLE);
+    LOCKSTEP_Init(&lockstep, lanes, count);
+    LOCKSTEP_RunFrames(&lockstep, cycles / 10, 10);
+
+    for (int i = 0; i < count; i++)
+    {
+        loadProgram(&chip, benchCase->program, benchCase->length, CHIP_DISPATCH_TABLE);
+        CHIP_Seed(&chip, i + 1);
+
+        for (long frame = 0; frame < cycles / 10; frame++)
+        {
+            CHIP_RunFrame(&chip, 10);
+        }
+
+        if (!CHIP_CompareState(&chip, &lanes[i]) || chip.cycles != lanes[i].cycles || chip.soundFlag != lanes[i].soundFlag)
+        {
+            printf("%s: lockstep lane %d final state differs from table\n", benchCase->name, i);
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+void usage()
+{
+    printf(
+        "usage: bench [options]\n"
+        "  --cycles N       instructions per timed run (default %ld)\n"
+        "  --repeats N      timed runs per measurement (default %d)\n"
+        "  --case NAME      run only this case\n"
+        "  --dispatch NAME  run only this backend\n"
+        "  --quirks NAME    quirks profile - vip, chip48, schip (default) or modern\n"
+        "  --no-opcodes     skip the per-opcode costs\n"
+        "  --no-check       skip the cross-backend state checks\n"
+        "  --lanes N        machines of the lockstep comparison, 1 to %d (default %d)\n"
+        "  --no-lockstep    skip the lockstep comparison\n",
+        BENCH_CYCLES, BENCH_REPEATS, LOCKSTEP_LANES, BENCH_LANES);
+
+    printf("cases:");
+
+    for (int i = 0; i < CASE_COUNT; i++)
+    {
+        printf(" %s", cases[i].name);
+    }
+
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    long cycles = BENCH_CYCLES;
+    int repeats = BENCH_REPEATS;
+    char *caseName = NULL;
+    int dispatchOnly = -1;
+    int opcodeCosts = 1;
+    int check = 1;
+    int laneCount = BENCH_LANES;
+    int lockstepCosts = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+            cycles = atol(argv[++i]);
+        else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc)
+            repeats = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc)
+            caseName = argv[++i];
+        else if (strcmp(argv[i], "--dispatch") == 0 && i + 1 < argc)
+        {
+            if ((dispatchOnly = CHIP_DispatchByName(argv[++i])) == -1)
+            {
+                printf("Unknown dispatch %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc)
+        {
+            if ((quirks = CHIP_QuirksByName(argv[++i])) == -1)
+            {
+                printf("Unknown quirks profile %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--no-opcodes") == 0)
+            opcodeCosts = 0;
+        else if (strcmp(argv[i], "--no-check") == 0)
+            check = 0;
+        else if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc)
+            laneCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-lockstep") == 0)
+            lockstepCosts = 0;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (cycles <= 0 || repeats <= 0 || laneCount < 1 || laneCount > LOCKSTEP_LANES)
+    {
+        usage();
+        return 1;
+    }
+
+    int firstDispatch = dispatchOnly == -1 ? 0 : dispatchOnly;
+    int lastDispatch = dispatchOnly == -1 ? CHIP_DISPATCH_COUNT - 1 : dispatchOnly;
+    int status = 0;
+
+    printf("%-8s %-10s %10s %10s %10s %10s\n", "case", "backend", "ns/instr", "min", "stddev", "MIPS");
+
+    for (int i = 0; i < CASE_COUNT; i++)
+    {
+        if (caseName != NULL && strcmp(caseName, cases[i].name) != 0)
+            continue;
+
+        for (int dispatch = firstDispatch; dispatch <= lastDispatch; dispatch++)
+        {
+            Statistics statistics = measure(cases[i].program, cases[i].length, dispatch, cycles, repeats);
+
+            printf("%-8s %-10s %10.3f %10.3f %10.3f %10.1f\n", cases[i].name, CHIP_DispatchName(dispatch),
+                statistics.median, statistics.min, statistics.deviation, 1e3 / statistics.median);
+            status |= reportHalted(cases[i].name, CHIP_DispatchName(dispatch), statistics);
+        }
+
+        if (check)
+        {
+            status |= checkBackends(&cases[i], cycles / 10);
+        }
+    }
+
+    if (lockstepCosts)
+    {
+        printf("\n%d machines, one after another or in lockstep\n", laneCount);
+        printf("%-8s %-10s %10s %10s %10s %10s %10s\n", "case", "backend", "ns/instr", "min", "stddev", "MIPS", "vector");
+
+        for (int i = 0; i < CASE_COUNT; i++)
+        {
+            if (caseName != NULL && strcmp(caseName, cases[i].name) != 0)
+                continue;
+
+            double vectorShare;
+
+            for (int dispatch = firstDispatch; dispatch <= lastDispatch; dispatch++)
+            {
+                Statistics statistics = measureLanes(&cases[i], laneCount, dispatch, cycles, repeats, &vectorShare);
+
+                printf("%-8s %-10s %10.3f %10.3f %10.3f %10.1f\n", cases[i].name, CHIP_DispatchName(dispatch),
+                    statistics.median, statistics.min, statistics.deviation, 1e3 / statistics.median);
+                status |= reportHalted(cases[i].name, CHIP_DispatchName(dispatch), statistics);
+            }
+
+            Statistics statistics = measureLanes(&cases[i], laneCount, -1, cycles, repeats, &vectorShare);
+
+            printf("%-8s %-10s %10.3f %10.3f %10.3f %10.1f %9.1f%%\n", cases[i].name, "lockstep",
+                statistics.median, statistics.min, statistics.deviation, 1e3 / statistics.median, vectorShare * 100);
+            status |= reportHalted(cases[i].name, "lockstep", statistics);
+
+            if (check)
+            {
+                status |= checkLockstep(&cases[i], laneCount, cycles / 10);
+            }
+        }
+    }
+
+    if (opcodeCosts && caseName == NULL)
+    {
+        long opcodeCycles = cycles / 5;
+        word program[OPCODE_BODY + 3];
+
+        // a loop of the LDI and the jump alone gives the loop overhead to take out of each opcode loop
+        word loopProgram[] = { 0x6101, 0xA300, 0x1202 };
+
+        printf("\n%-8s", "opcode");
+
+        for (int dispatch = firstDispatch; dispatch <= lastDispatch; dispatch++)
+        {
+            printf(" %10s", CHIP_DispatchName(dispatch));
+        }
+
+        printf("\n");
+
+        double overhead[CHIP_DISPATCH_COUNT];
+
+        for (int dispatch = firstDispatch; dispatch <= lastDispatch; dispatch++)
+        {
+            overhead[dispatch] = measure(loopProgram, 3, dispatch, opcodeCycles, repeats).median;
+        }
+
+        printf("%-8s", "LDI+JP");
+
+        for (int dispatch = firstDispatch; dispatch <= lastDispatch; dispatch++)
+        {
+            printf(" %10.3f", overhead[dispatch]);
+        }
+
+        printf("\n");
+
+        for (int i = 0; i < OPCODE_COUNT; i++)
+        {
+            int length = opcodeProgram(program, opcodes[i].instruction);
+
+            printf("%-8s", opcodes[i].name);
+
+            int halted = 0;
+
+            for (int dispatch = firstDispatch; dispatch <= lastDispatch; dispatch++)
+            {
+                Statistics statistics = measure(program, length, dispatch, opcodeCycles, repeats);
+
+                // one LDI and one jump for every OPCODE_BODY instructions
+                double cost = (statistics.median * (OPCODE_BODY + 2) - overhead[dispatch] * 2) / OPCODE_BODY;
+
+                printf(" %10.3f", cost);
+                halted |= statistics.halted;
+            }
+
+            printf("\n");
+
+            if (halted)
+            {
+                printf("%s: machine halted during the timed runs\n", opcodes[i].name);
+                status = 1;
+            }
+        }
+    }
+
+    CHIP_Free(&chip);
+
+    for (int i = 0; i < LOCKSTEP_LANES; i++)
+    {
+        CHIP_Free(&lanes[i]);
+    }
+
+    return status;
+}
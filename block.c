@@ -0,0 +1,555 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "block.h"
+#include "quirks.h"
+
+#define BLOCK_MAX       1024    // translated blocks kept before the cache is flushed
+#define BLOCK_LENGTH    64      // longest straight-line run translated into one block
+#define IR_MAX          8192    // IR instructions kept before the cache is flushed
+
+// IR instruction kinds
+enum
+{
+    IR_STEP,    // run instruction with the reference interpreter
+    IR_NOP,
+    IR_LD,      // Vx = imm
+    IR_ADD,     // Vx += imm
+    IR_LDR,     // Vx = Vy
+    IR_OR,      // Vx |= Vy, then VF &= imm
+    IR_AND,
+    IR_XOR,
+    IR_ADDR,
+    IR_SUB,
+    IR_SHR,     // Vx = Vy >> 1, y is x when the profile shifts Vx
+    IR_SUBN,
+    IR_SHL,
+    IR_LDI,     // I = arg
+    IR_ADDI,
+    IR_LDCH,
+    IR_RND,
+    IR_LDDT,
+    IR_SETDT,
+    IR_SETST,
+    IR_BCD,
+    IR_PUSHR,   // I += imm afterwards
+    IR_POPR,
+    IR_JP,      // pc = arg
+    IR_CALL,
+    IR_SE,      // skip if Vx == imm
+    IR_SNE,
+    IR_SER,     // skip if Vx == Vy
+    IR_SNER,
+    IR_SKP,
+    IR_SKPN,
+};
+
+typedef struct IRInstr
+{
+    byte kind;      // IR_ kind
+    byte x, y;      // register indexes
+    byte imm;       // 8-bit immediate
+    word pc;        // address of the CHIP8 instruction
+    word arg;       // 12-bit address for IR_LDI
+} IRInstr;
+
+typedef struct Block
+{
+    int ir;         // index of first instruction in BlockCache.ir
+    int length;     // number of instructions
+} Block;
+
+struct BlockCache
+{
+    short entry[RAM_SIZE];      // block starting at address, -1 if not translated
+    byte covered[RAM_SIZE];     // 1 if address belongs to a translated block
+    Block blocks[BLOCK_MAX];
+    int blockCount;
+    IRInstr ir[IR_MAX];
+    int irCount;
+    unsigned generation;        // incremented on every flush, lets a running block notice it was invalidated
+};
+
+// Drops every translated block
+static void flush(struct BlockCache *cache)
+{
+    memset(cache->entry, 0xFF, sizeof(cache->entry));
+    memset(cache->covered, 0, sizeof(cache->covered));
+    cache->blockCount = 0;
+    cache->irCount = 0;
+    cache->generation++;
+}
+
+void BLOCK_Create(Chip8 *chip)
+{
+    chip->blocks = malloc(sizeof(struct BlockCache));
+    chip->blocks->generation = 0;
+    flush(chip->blocks);
+}
+
+void BLOCK_Free(Chip8 *chip)
+{
+    free(chip->blocks);
+    chip->blocks = NULL;
+}
+
+// Self-modifying code is rare, so a write into translated code simply flushes the whole cache
+void BLOCK_Invalidate(Chip8 *chip, int address, int size)
+{
+    struct BlockCache *cache = chip->blocks;
+
+    // instruction starting one byte before address also contains a modified byte
+    int start = address > 0 ? address - 1 : 0;
+    int end = address + size < RAM_SIZE ? address + size : RAM_SIZE;
+
+    for (int i = start; i < end; i++)
+    {
+        if (cache->covered[i])
+        {
+            flush(cache);
+            return;
+        }
+    }
+}
+
+// Returns 1 if op has to end a block
+static int endsBlock(byte op)
+{
+    switch (op)
+    {
+        case OP_JP: case OP_CALL: case OP_RET:
+        case OP_SE: case OP_SNE: case OP_SER: case OP_SNER:
+        case OP_SKP: case OP_SKPN:
+        case OP_EXIT: case OP_LDIL: case OP_JPV:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// Returns 1 if op conditionally skips the next instruction
+static int isSkip(byte op)
+{
+    switch (op)
+    {
+        case OP_SE: case OP_SNE: case OP_SER: case OP_SNER:
+        case OP_SKP: case OP_SKPN:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// Maps decoded instruction to its IR kind
+static byte irKind(byte op)
+{
+    switch (op)
+    {
+        case OP_NOP:    return IR_NOP;
+        case OP_LD:     return IR_LD;
+        case OP_ADD:    return IR_ADD;
+        case OP_LDR:    return IR_LDR;
+        case OP_OR:     return IR_OR;
+        case OP_AND:    return IR_AND;
+        case OP_XOR:    return IR_XOR;
+        case OP_ADDR:   return IR_ADDR;
+        case OP_SUB:    return IR_SUB;
+        case OP_SHR:    return IR_SHR;
+        case OP_SUBN:   return IR_SUBN;
+        case OP_SHL:    return IR_SHL;
+        case OP_LDI:    return IR_LDI;
+        case OP_ADDI:   return IR_ADDI;
+        case OP_LDCH:   return IR_LDCH;
+        case OP_RND:    return IR_RND;
+        case OP_LDDT:   return IR_LDDT;
+        case OP_SETDT:  return IR_SETDT;
+        case OP_SETST:  return IR_SETST;
+        case OP_BCD:    return IR_BCD;
+        case OP_PUSHR:  return IR_PUSHR;
+        case OP_POPR:   return IR_POPR;
+        case OP_JP:     return IR_JP;
+        case OP_CALL:   return IR_CALL;
+        case OP_SE:     return IR_SE;
+        case OP_SNE:    return IR_SNE;
+        case OP_SER:    return IR_SER;
+        case OP_SNER:   return IR_SNER;
+        case OP_SKP:    return IR_SKP;
+        case OP_SKPN:   return IR_SKPN;
+        default:        return IR_STEP;
+    }
+}
+
+// Translates the run of instructions starting at pc
+// returns NULL if pc can not start a block
+static Block *translate(struct BlockCache *cache, Chip8 *chip, word start)
+{
+    // quirks become IR operands, so translated code never checks the profile
+    const Quirks *quirks = &QUIRKS_Profiles[chip->quirks];
+    word pc = start;
+
+    if (pc >= RAM_SIZE - 1)
+    {
+        return NULL;
+    }
+
+    if (cache->blockCount == BLOCK_MAX || cache->irCount + BLOCK_LENGTH > IR_MAX)
+    {
+        flush(cache);
+    }
+
+    Block *block = &cache->blocks[cache->blockCount];
+    block->ir = cache->irCount;
+    block->length = 0;
+
+    int skipped = 0;        // 1 if the previous instruction skips this one
+
+    while (block->length < BLOCK_LENGTH && pc < RAM_SIZE - 1)
+    {
+        CHIP_Op op = CHIP_Decode(CHIP_ReadByte(chip, pc) << 8 | CHIP_ReadByte(chip, pc + 1));
+        IRInstr *in = &cache->ir[cache->irCount++];
+
+        // XO-CHIP skips depend on the next instruction, the interpreter handles them
+        in->kind = (chip->model == CHIP_MODEL_XOCHIP && isSkip(op.op)) ? IR_STEP : irKind(op.op);
+        in->x = op.x;
+        in->y = op.y;
+        in->imm = op.kk;
+        in->pc = pc;
+        in->arg = op.nnn;
+
+        switch (op.op)
+        {
+            case OP_OR: case OP_AND: case OP_XOR:
+                in->imm = quirks->vfReset ? 0x00 : 0xFF;
+                break;
+
+            case OP_SHR: case OP_SHL:
+                in->y = quirks->shiftVy ? op.y : op.x;
+                break;
+
+            case OP_PUSHR: case OP_POPR:
+                in->imm = quirks->memoryI ? op.x + quirks->memoryI - 1 : 0;
+                break;
+        }
+
+        cache->covered[pc] = cache->covered[pc + 1] = 1;
+        block->length++;
+        pc += 2;
+
+        // a skip is a conditional branch over the next IR instruction, so neither it nor a branch it skips
+        // ends the block, the branch only leaves it when it runs
+        int skip = in->kind != IR_STEP && isSkip(op.op);
+
+        if (endsBlock(op.op) && !skip && !skipped)
+        {
+            break;
+        }
+
+        skipped = skip;
+    }
+
+    cache->entry[start] = cache->blockCount;
+
+    return &cache->blocks[cache->blockCount++];
+}
+
+// Runs translated blocks from PC until limit instructions ran or the machine halted
+// V is used in place and I and PC stay in locals from one block into the next, with chain 0 only the first block runs
+// returns number of instructions executed
+static long execBlocks(Chip8 *chip, long limit, int chain)
+{
+    struct BlockCache *cache = chip->blocks;
+    long done = 0;
+
+    byte *v = chip->V;
+    word I = chip->I;
+    word pc = chip->PC;
+
+    do
+    {
+        // PC is 16 bits wide, so it always indexes entry, translate refuses an instruction past the end of RAM
+        short index = cache->entry[pc];
+        Block *block = index >= 0 ? &cache->blocks[index] : translate(cache, chip, pc);
+
+        if (block == NULL)
+        {
+            chip->I = I;
+            chip->PC = pc;
+
+            CHIP_Step(chip);
+
+            I = chip->I;
+            pc = chip->PC;
+            done++;
+            continue;
+        }
+
+        const IRInstr *ir = &cache->ir[block->ir];
+        unsigned generation = cache->generation;
+
+        // a taken skip steps over the IR instruction of the next one
+        for (int n = 0; n < block->length && done < limit; n++)
+        {
+            const IRInstr *in = &ir[n];
+            byte flag;
+
+            pc = in->pc + 2;
+            done++;
+
+            switch (in->kind)
+            {
+                case IR_NOP:
+                    break;
+
+                case IR_LD:
+                    v[in->x] = in->imm;
+                    break;
+
+                case IR_ADD:
+                    v[in->x] += in->imm;
+                    break;
+
+                case IR_LDR:
+                    v[in->x] = v[in->y];
+                    break;
+
+                case IR_OR:
+                    v[in->x] |= v[in->y];
+                    v[15] &= in->imm;
+                    break;
+
+                case IR_AND:
+                    v[in->x] &= v[in->y];
+                    v[15] &= in->imm;
+                    break;
+
+                case IR_XOR:
+                    v[in->x] ^= v[in->y];
+                    v[15] &= in->imm;
+                    break;
+
+                case IR_ADDR:
+                    flag = (int) v[in->x] + (int) v[in->y] > 0xFF ? 1 : 0;
+                    v[in->x] += v[in->y];
+                    v[15] = flag;
+                    break;
+
+                case IR_SUB:
+                    flag = v[in->x] > v[in->y] ? 1 : 0;
+                    v[in->x] -= v[in->y];
+                    v[15] = flag;
+                    break;
+
+                case IR_SHR:
+                    flag = v[in->y] & 0x1;
+                    v[in->x] = v[in->y] >> 1;
+                    v[15] = flag;
+                    break;
+
+                case IR_SUBN:
+                    flag = v[in->y] > v[in->x] ? 1 : 0;
+                    v[in->x] = v[in->y] - v[in->x];
+                    v[15] = flag;
+                    break;
+
+                case IR_SHL:
+                    flag = v[in->y] >> 7;
+                    v[in->x] = v[in->y] << 1;
+                    v[15] = flag;
+                    break;
+
+                case IR_LDI:
+                    I = in->arg;
+                    break;
+
+                case IR_ADDI:
+                    I += v[in->x];
+                    break;
+
+                case IR_LDCH:
+                    I = v[in->x] * 5;
+                    break;
+
+                case IR_RND:
+                    v[in->x] = CHIP_Random(chip) & in->imm;
+                    break;
+
+                case IR_LDDT:
+                    v[in->x] = chip->DT;
+                    break;
+
+                case IR_SETDT:
+                    chip->DT = v[in->x];
+                    break;
+
+                case IR_SETST:
+                    chip->ST = v[in->x];
+                    break;
+
+                // accesses past the memory of the model and failed page copies are left to the interpreter to fault
+                case IR_BCD:
+                {
+                    byte digits[3] = { v[in->x] / 100, (v[in->x] % 100) / 10, v[in->x] % 10 };
+
+                    if (I + 3 > chip->memorySize || CHIP_StoreMemory(chip, I, digits, 3) < 0)
+                        goto step;
+                    CHIP_MemoryWritten(chip, I, 3);
+                    if (cache->generation != generation)
+                        goto leave;
+                    break;
+                }
+
+                case IR_PUSHR:
+                    if (I + in->x + 1 > chip->memorySize || CHIP_StoreMemory(chip, I, v, in->x + 1) < 0)
+                        goto step;
+                    CHIP_MemoryWritten(chip, I, in->x + 1);
+                    I += in->imm;
+                    if (cache->generation != generation)
+                        goto leave;
+                    break;
+
+                case IR_POPR:
+                    if (I + in->x + 1 > chip->memorySize)
+                        goto step;
+                    for (int i = 0; i <= in->x; i++)
+                    {
+                        v[i] = CHIP_ReadByte(chip, I + i);
+                    }
+                    I += in->imm;
+                    break;
+
+                case IR_JP:
+                    pc = in->arg;
+                    goto leave;
+
+                case IR_CALL:
+                    if (chip->SP >= STACK_SIZE)
+                        goto step;
+                    chip->Stack[chip->SP++] = pc;
+                    pc = in->arg;
+                    goto leave;
+
+                case IR_SE:
+                    if (v[in->x] == in->imm)
+                    {
+                        pc += 2;
+                        n++;
+                    }
+                    break;
+
+                case IR_SNE:
+                    if (v[in->x] != in->imm)
+                    {
+                        pc += 2;
+                        n++;
+                    }
+                    break;
+
+                case IR_SER:
+                    if (v[in->x] == v[in->y])
+                    {
+                        pc += 2;
+                        n++;
+                    }
+                    break;
+
+                case IR_SNER:
+                    if (v[in->x] != v[in->y])
+                    {
+                        pc += 2;
+                        n++;
+                    }
+                    break;
+
+                case IR_SKP:
+                    if (chip->Keyboard[ v[in->x] & 0xF ])
+                    {
+                        pc += 2;
+                        n++;
+                    }
+                    break;
+
+                case IR_SKPN:
+                    if ( ! chip->Keyboard[ v[in->x] & 0xF ])
+                    {
+                        pc += 2;
+                        n++;
+                    }
+                    break;
+
+                default:
+                step:
+                    // hand the machine over to the interpreter
+                    chip->I = I;
+                    chip->PC = in->pc;
+
+                    CHIP_Step(chip);
+
+                    I = chip->I;
+                    pc = chip->PC;
+
+                    // a faulted machine stops on the faulting instruction, a branch or a store into translated code
+                    // leaves the block
+                    if (chip->halted || pc != in->pc + 2 || cache->generation != generation)
+                        goto leave;
+                    break;
+            }
+        }
+
+    leave:;
+    }
+    while (chain && done < limit && !chip->halted);
+
+    chip->I = I;
+    chip->PC = pc;
+
+    return done;
+}
+
+void BLOCK_Run(Chip8 *chip, long cycles)
+{
+    // a halt leaves the block right after the instruction
+    if (cycles > 0 && !chip->halted)
+    {
+        execBlocks(chip, cycles, 1);
+    }
+}
+
+long BLOCK_DiffTest(Chip8 *chip, long cycles)
+{
+    Chip8 *reference = calloc(1, sizeof(Chip8));
+    long cycle = 0;
+
+    if (chip->blocks == NULL)
+    {
+        BLOCK_Create(chip);
+    }
+
+    CHIP_Fork(reference, chip);
+    CHIP_SetDispatch(reference, CHIP_DISPATCH_TABLE);
+
+    while (cycle < cycles)
+    {
+        long done = execBlocks(chip, cycles - cycle, 0);
+
+        for (long i = 0; i < done; i++)
+        {
+            CHIP_Step(reference);
+        }
+
+        if (!CHIP_CompareState(chip, reference))
+        {
+            CHIP_Free(reference);
+            free(reference);
+            return cycle;
+        }
+
+        cycle += done;
+    }
+
+    CHIP_Free(reference);
+    free(reference);
+
+    return -1;
+}
@@ -0,0 +1,31 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "chip8.h"
+
+// Block engine
+// straight-line runs of CHIP8 code are translated once into a compact IR and executed with I and PC held in locals
+// a run starts wherever execution enters it (reset, JP/CALL/RET target, instruction after a skip)
+// and ends with the first branch, a skip jumps over the next IR instruction and the run goes on after it
+// execution chains from one run into the next without leaving the engine
+// instructions without an IR form (DRW, CLS, RET...) run on the reference interpreter
+// memory-write invalidation and results are identical to CHIP_EmulateCycle
+
+// Allocates block cache of the machine, called by CHIP_SetDispatch
+void BLOCK_Create(Chip8 *chip);
+
+// Releases block cache of the machine, called by CHIP_Free
+void BLOCK_Free(Chip8 *chip);
+
+// Drops translated blocks covering size bytes starting at address, called by CHIP_MemoryWritten
+void BLOCK_Invalidate(Chip8 *chip, int address, int size);
+
+// Runs cycles instructions through translated blocks
+void BLOCK_Run(Chip8 *chip, long cycles);
+
+// Differential test mode
+// runs chip with the block engine and a copy of it with the reference interpreter in lockstep, comparing state after every block
+// returns cycle at which the machines diverged or -1 if they stayed equal for cycles cycles
+long BLOCK_DiffTest(Chip8 *chip, long cycles);
+
+#endif
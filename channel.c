@@ -0,0 +1,79 @@
+#include <string.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+#include "channel.h"
+
+void CHANNEL_InitFrames(FrameChannel *channel)
+{
+    memset(channel->frames, 0, sizeof(channel->frames));
+
+    channel->back = 0;
+    channel->front = 1;
+    atomic_store(&channel->middle, 2);
+}
+
+void CHANNEL_PublishFrame(FrameChannel *channel, const Chip8 *chip, uint64_t number)
+{
+    Frame *frame = &channel->frames[channel->back];
+
+    memcpy(frame->Display, chip->Display, sizeof(frame->Display));
+    frame->hires = chip->hires;
+    frame->number = number;
+
+    // release makes the copy visible before the consumer can take the buffer
+    int previous = atomic_exchange_explicit(&channel->middle, channel->back | CHANNEL_FRESH, memory_order_acq_rel);
+    channel->back = previous & ~CHANNEL_FRESH;
+}
+
+const Frame *CHANNEL_AcquireFrame(FrameChannel *channel)
+{
+    if (!(atomic_load_explicit(&channel->middle, memory_order_relaxed) & CHANNEL_FRESH))
+    {
+        return NULL;
+    }
+
+    int previous = atomic_exchange_explicit(&channel->middle, channel->front, memory_order_acq_rel);
+    channel->front = previous & ~CHANNEL_FRESH;
+
+    return &channel->frames[channel->front];
+}
+
+void CHANNEL_InitKeys(KeyChannel *channel)
+{
+    atomic_store(&channel->head, 0);
+    atomic_store(&channel->tail, 0);
+}
+
+int CHANNEL_PushKey(KeyChannel *channel, byte key, byte pressed)
+{
+    unsigned head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&channel->tail, memory_order_acquire);
+
+    if (((head + 1) & (KEY_RING_SIZE - 1)) == tail)
+    {
+        return 0;
+    }
+
+    channel->events[head].key = key;
+    channel->events[head].pressed = pressed;
+    atomic_store_explicit(&channel->head, (head + 1) & (KEY_RING_SIZE - 1), memory_order_release);
+
+    return 1;
+}
+
+int CHANNEL_PopKey(KeyChannel *channel, ChannelKey *event)
+{
+    unsigned tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&channel->head, memory_order_acquire);
+
+    if (tail == head)
+    {
+        return 0;
+    }
+
+    *event = channel->events[tail];
+    atomic_store_explicit(&channel->tail, (tail + 1) & (KEY_RING_SIZE - 1), memory_order_release);
+
+    return 1;
+}
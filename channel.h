@@ -0,0 +1,66 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+// Lock-free channels between the emulation thread and the render thread
+// both have exactly one producer and one consumer and never block either side
+
+// Completed display published by the emulation thread
+typedef struct Frame
+{
+    uint64_t Display[PLANE_COUNT][HEIGHT][ROW_WORDS];
+    byte hires;             // Display is in 128x64 mode
+    uint64_t number;        // scheduler frame the display was taken after
+} Frame;
+
+// Triple buffer - the producer always has a free buffer to fill and the consumer always reads the latest complete frame
+// frames published while the consumer is busy replace each other instead of queueing up
+typedef struct FrameChannel
+{
+    Frame frames[3];
+    atomic_int middle;      // buffer last published, with CHANNEL_FRESH set until the consumer takes it
+    int back;               // buffer owned by the producer
+    int front;              // buffer owned by the consumer
+} FrameChannel;
+
+#define CHANNEL_FRESH   4
+
+// Key press or release for the emulation thread
+typedef struct ChannelKey
+{
+    byte key;
+    byte pressed;
+} ChannelKey;
+
+// Must be a power of 2, one slot is always kept free
+#define KEY_RING_SIZE   256
+
+// Single producer single consumer ring of key events
+typedef struct KeyChannel
+{
+    ChannelKey events[KEY_RING_SIZE];
+    atomic_uint head;       // next slot written by the producer
+    atomic_uint tail;       // next slot read by the consumer
+} KeyChannel;
+
+void CHANNEL_InitFrames(FrameChannel *channel);
+
+// Producer side - copies the display of chip into the back buffer and swaps it with the middle one
+void CHANNEL_PublishFrame(FrameChannel *channel, const Chip8 *chip, uint64_t number);
+
+// Consumer side - returns the latest frame if one was published since the last call, else NULL
+// the frame stays valid until the next call
+const Frame *CHANNEL_AcquireFrame(FrameChannel *channel);
+
+void CHANNEL_InitKeys(KeyChannel *channel);
+
+// Producer side - returns 0 if the ring is full and the event was dropped
+int CHANNEL_PushKey(KeyChannel *channel, byte key, byte pressed);
+
+// Consumer side - returns 0 if the ring is empty
+int CHANNEL_PopKey(KeyChannel *channel, ChannelKey *event);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
+#include <stdint.h>
+#include <stdatomic.h>
+
 typedef unsigned char   byte;
 typedef unsigned short  word;
 
@@ -42,32 +45,310 @@ typedef unsigned short  word;
 #define PUSHR   0xF055     // LD       [I], Vx         Fx55            - copy (V0, V1 ... to Vx) into memory starting at address I
 #define POPR    0xF065     // LD       Vx, [I]         Fx65            - copy value stored at memory location starting at address I into (V0, V1 ... to Vx)
 
+// SUPER-CHIP opcodes
+#define SCD     0x00C0     // SCD      nibble          00Cn            - scroll display down n rows
+#define SCR     0x00FB     // SCR                      00FB            - scroll display right 4 pixels
+#define SCL     0x00FC     // SCL                      00FC            - scroll display left 4 pixels
+#define EXIT    0x00FD     // EXIT                     00FD            - stop the program
+#define LOWRES  0x00FE     // LOW                      00FE            - 64x32 display mode
+#define HIGHRES 0x00FF     // HIGH                     00FF            - 128x64 display mode
+#define LDHF    0xF030     // LD       HF, Vx          Fx30            - I = location of 8x10 sprite for digit Vx
+#define SAVEF   0xF075     // LD       R, Vx           Fx75            - copy V0 ... Vx to the flag registers
+#define LOADF   0xF085     // LD       Vx, R           Fx85            - copy flag registers to V0 ... Vx
+
+// XO-CHIP opcodes
+#define SCU     0x00D0     // SCU      nibble          00Dn            - scroll display up n rows
+#define SAVER   0x5002     // SAVE     Vx - Vy         5xy2            - copy Vx ... Vy into memory starting at address I
+#define LOADR   0x5003     // LOAD     Vx - Vy         5xy3            - copy memory starting at address I into Vx ... Vy
+#define LDIL    0xF000     // LD       I, long addr    F000 nnnn       - I = 16-bit address in the next word
+#define PLANE   0xF001     // PLANE    n               Fn01            - select bitplanes n for drawing, clearing and scrolling
+#define LDAUD   0xF002     // AUDIO                    F002            - load 16 byte audio pattern from address I
+#define PITCH   0xF03A     // PITCH    Vx              Fx3A            - set audio pattern playback rate
+
+#define JPV     0xB000     // JP       V0, addr        Bnnn            - jump to nnn + V0 (xnn + Vx with CHIP-48 and SCHIP quirks)
+
+// Handler ids produced by the instruction decoder, one per opcode above
+enum
+{
+    OP_UNKNOWN,
+    OP_NOP, OP_CLS, OP_RET, OP_JP, OP_CALL, OP_SE, OP_SNE, OP_SER, OP_LD, OP_ADD,
+    OP_LDR, OP_OR, OP_AND, OP_XOR, OP_ADDR, OP_SUB, OP_SHR, OP_SUBN, OP_SHL, OP_SNER,
+    OP_LDI, OP_RND, OP_DRW, OP_SKP, OP_SKPN,
+    OP_LDDT, OP_LDK, OP_SETDT, OP_SETST, OP_ADDI, OP_LDCH, OP_BCD, OP_PUSHR, OP_POPR,
+    OP_SCD, OP_SCR, OP_SCL, OP_EXIT, OP_LOWRES, OP_HIGHRES, OP_LDHF, OP_SAVEF, OP_LOADF,
+    OP_SCU, OP_SAVER, OP_LOADR, OP_LDIL, OP_PLANE, OP_LDAUD, OP_PITCH,
+    OP_JPV,
+    OP_COUNT
+};
+
+// Instruction with its operand fields already extracted
+typedef struct CHIP_Op
+{
+    word instruction;   // raw 16-bit instruction
+    word nnn;           // lowest 12 bits - address
+    byte op;            // OP_ handler id
+    byte x, y;          // register indexes from second and third nibble
+    byte n;             // lowest nibble
+    byte kk;            // lowest byte
+} CHIP_Op;
+
+// Instruction dispatch backends
+#define CHIP_DISPATCH_TABLE     0   // 64K-entry table of pre-decoded instructions
+#define CHIP_DISPATCH_NIBBLE    1   // 16-way table on the first nibble with secondary tables for 0/8/E/F groups
+#define CHIP_DISPATCH_THREADED  2   // computed goto threaded code, same as CHIP_DISPATCH_TABLE on compilers without labels as values
+#define CHIP_DISPATCH_CACHED    3   // per-address cache of decoded instructions, invalidated when RAM is written
+#define CHIP_DISPATCH_BLOCKS    4   // straight-line runs translated to IR, see block.h
+#define CHIP_DISPATCH_COUNT     5
+
+// Machine models, selected with CHIP_SetModel
+#define CHIP_MODEL_CHIP8    0   // 64x32 display, 4 KiB RAM
+#define CHIP_MODEL_SCHIP    1   // SUPER-CHIP - 128x64 mode, scrolling, 16x16 sprites, big font, flag registers
+#define CHIP_MODEL_XOCHIP   2   // XO-CHIP - SUPER-CHIP with 2 bitplanes, 64 KiB RAM, long I loads and register ranges
+#define CHIP_MODEL_COUNT    3
+
+// Quirks profiles, selected with CHIP_SetQuirks
+// behavior of instructions that differ between interpreters, every profile is a separately compiled interpreter
+//                              shift source    Fx55/Fx65 I     VF reset    sprites     Bnnn
+#define CHIP_QUIRKS_VIP     0   // Vy              I += x + 1      yes         clipped     nnn + V0
+#define CHIP_QUIRKS_CHIP48  1   // Vx              I += x          no          clipped     xnn + Vx
+#define CHIP_QUIRKS_SCHIP   2   // Vx              unchanged       no          clipped     xnn + Vx
+#define CHIP_QUIRKS_MODERN  3   // Vy              I += x + 1      no          wrapped     nnn + V0
+#define CHIP_QUIRKS_COUNT   4
+
+// Halt states
+// a halted machine does not run instructions, CHIP_EmulateCycles only counts its cycles
+#define CHIP_RUNNING        0
+#define CHIP_HALT_KEY       1   // Fx0A waits for a key, CHIP_SetKey wakes the machine
+#define CHIP_HALT_EXIT      2   // 00FD ended the program
+#define CHIP_HALT_FAULT     3   // an instruction faulted, see fault
+
+// Faults - the machine halts with PC on the faulting instruction
+#define CHIP_FAULT_NONE             0
+#define CHIP_FAULT_STACK_OVERFLOW   1   // CALL with a full stack
+#define CHIP_FAULT_STACK_UNDERFLOW  2   // RET with an empty stack
+#define CHIP_FAULT_ILLEGAL_OPCODE   3   // instruction unknown to the model
+#define CHIP_FAULT_MEMORY           4   // register load or store past the memory of the model
+#define CHIP_FAULT_OUT_OF_MEMORY    5   // store into a shared page the host had no memory to copy
+#define CHIP_FAULT_COUNT            6
+
+// Faults of one kind, counted by the machine instead of printed
+typedef struct CHIP_Diagnostic
+{
+    uint32_t count;         // faults since CHIP_Initalize
+    word address;           // PC of the first one
+    word instruction;       // instruction at address
+} CHIP_Diagnostic;
+
 // Programs are loaded at this memory address 
 #define LOAD_ADDRESS    0x200
 
 // Memory
-#define RAM_SIZE        4096    // byte
+#define RAM_SIZE        65536   // byte - address space of every model, CHIP-8 and SUPER-CHIP programs see the first 4 KiB
+#define CHIP8_RAM_SIZE  4096    // byte
 #define STACK_SIZE      32      // word
 
+// Fonts in RAM - 5 byte digits 0 to F, then 10 byte digits 0 to F for LDHF
+#define FONT_ADDRESS        0x000
+#define BIG_FONT_ADDRESS    0x050
+
+// RAM is split into pages shared between forked machines and copied on the first write
+#define PAGE_SIZE       256     // byte
+#define PAGE_COUNT      (RAM_SIZE / PAGE_SIZE)
+
+// CHIP_LoadProgram errors
+#define CHIP_LOAD_OPEN_ERROR    -1
+#define CHIP_LOAD_READ_ERROR    -2
+
+typedef struct CHIP_Page
+{
+    atomic_int refs;            // number of machines using the page
+    byte data[PAGE_SIZE];
+} CHIP_Page;
+
 // Display
-// Each pixle will be represented by 1 byte (0 Black, 1 White)
-#define WIDTH           64
-#define HEIGHT          32
+// every bitplane holds HEIGHT rows of 128 pixels packed into ROW_WORDS 64-bit words
+// the most significant bit of the first word is the leftmost pixel (0 Black, 1 White)
+// in 64x32 mode only the first word of the first LORES_HEIGHT rows is used
+#define WIDTH           128
+#define HEIGHT          64
+#define LORES_WIDTH     64
+#define LORES_HEIGHT    32
+#define ROW_WORDS       (WIDTH / 64)
+#define PLANE_COUNT     2
+
+// Save states
+#define CHIP_STATE_VERSION  3
+#define CHIP_STATE_HEADER   (4 + 2 + 1 + 16 + 3 + 4 + STACK_SIZE * 2 + 3 + 16 + 16)
+#define CHIP_STATE_TAIL     (PLANE_COUNT * HEIGHT * ROW_WORDS * 8 + 16 + 4 + 8)
+#define CHIP_STATE_SIZE     (CHIP_STATE_HEADER + RAM_SIZE + CHIP_STATE_TAIL)   // largest state, see CHIP_StateSize
+
+// Complete state of one CHIP8 machine
+// every CHIP_ function takes the machine it operates on, so any number of machines can live in one process
+// a machine must be zeroed before its first CHIP_Initalize (static, calloc or = {0}) and released with CHIP_Free
+typedef struct Chip8
+{
+    // Registers
+    byte V[16];         // general purpose registers V[0] to V[14] (8-bits)
+                        // flag-register V[15] (8-bits)
+    byte DT, ST;        // delay timer register, sound timer register (8-bits)
+    byte SP;            // stack pointer register (8-bits) - not accessible for programs running on the emulator
+    word PC;            // program counter register (16-bits) - not accessible for programs running on the emulator
+    word I;             // index-register (16-bits)
+
+    CHIP_Page *pages[PAGE_COUNT];   // RAM, read with CHIP_ReadByte and written with CHIP_WriteByte, CHIP_StoreMemory or CHIP_WriteMemory
+    uint64_t dirtyPages[PAGE_COUNT / 64];   // bit n is set when page n of RAM was written, cleared by the rewind buffer
+    word Stack[STACK_SIZE];
+
+    byte model;             // CHIP_MODEL_ the machine emulates
+    byte quirks;            // CHIP_QUIRKS_ profile
+    int memorySize;         // RAM visible to programs of the model
+
+    byte drawFlag;
+    uint64_t Display[PLANE_COUNT][HEIGHT][ROW_WORDS];
+    uint64_t dirtyRows;     // bit n is set when row n of Display changed, cleared by the renderer
+    byte hires;             // 128x64 mode (SUPER-CHIP and XO-CHIP)
+    byte planes;            // bitplanes drawn, cleared and scrolled, bit n selects plane n (XO-CHIP)
+
+    byte flags[16];         // flag registers of FX75 and FX85, kept across CHIP_Initalize
+    byte pattern[16];       // XO-CHIP audio pattern, 128 one-bit samples
+    byte pitch;             // XO-CHIP pattern playback rate, 4000 * 2 ^ ((pitch - 64) / 48) samples per second
+
+    byte soundFlag;
+
+    byte halted;            // CHIP_RUNNING or the CHIP_HALT_ reason, PC stays on the halting instruction
+    byte fault;             // CHIP_FAULT_ that halted the machine, CHIP_FAULT_NONE if it did not fault
+    CHIP_Diagnostic diagnostics[CHIP_FAULT_COUNT];  // faults by CHIP_FAULT_, entry CHIP_FAULT_NONE stays empty
+
+    // Keyboard
+    byte Keyboard[16];
+
+    byte dispatch;      // CHIP_DISPATCH_ backend used by CHIP_EmulateCycle
+
+    uint32_t random;    // state of the RND generator, set with CHIP_Seed
+    uint64_t cycles;    // instructions executed since CHIP_Initalize
+
+    CHIP_Op *decodeCache;       // RAM_SIZE decoded instructions indexed by address, allocated for CHIP_DISPATCH_CACHED
+    struct BlockCache *blocks;  // translated blocks, allocated for CHIP_DISPATCH_BLOCKS
+
+#ifdef CHIP_PROFILE
+    struct Profile *profile;    // attached with PROFILE_Attach, not owned by the machine
+#endif
+} Chip8;
+
+void CHIP_Initalize(Chip8 *chip);
+
+void CHIP_Free(Chip8 *chip);
+
+// Selects the machine model, should be called after CHIP_Initalize and before loading a program
+void CHIP_SetModel(Chip8 *chip, int model);
+
+const char *CHIP_ModelName(int model);
+
+// Returns the CHIP_MODEL_ called name by CHIP_ModelName, -1 if there is none
+int CHIP_ModelByName(const char *name);
+
+// Selects the quirks profile, should be called after CHIP_SetModel, which resets it to the default of the model
+void CHIP_SetQuirks(Chip8 *chip, int quirks);
+
+const char *CHIP_QuirksName(int quirks);
+
+// Returns the CHIP_QUIRKS_ profile called name by CHIP_QuirksName, -1 if there is none
+int CHIP_QuirksByName(const char *name);
+
+// Returns size of the largest program the model of chip can load
+static inline int CHIP_ProgramSize(const Chip8 *chip)
+{
+    return chip->memorySize - LOAD_ADDRESS;
+}
+
+// Current display size in pixels
+static inline int CHIP_Width(const Chip8 *chip)
+{
+    return chip->hires ? WIDTH : LORES_WIDTH;
+}
+
+static inline int CHIP_Height(const Chip8 *chip)
+{
+    return chip->hires ? HEIGHT : LORES_HEIGHT;
+}
+
+// Loads ROM file at LOAD_ADDRESS, only the first CHIP_ProgramSize bytes of bigger files are loaded
+// returns size of the file or a negative CHIP_LOAD_ error
+int CHIP_LoadProgram(Chip8 *chip, const char *fname);
+
+// Describes a CHIP_LoadProgram result of chip - an error, a truncated program or "no error"
+const char *CHIP_LoadError(const Chip8 *chip, int status);
+
+int CHIP_LoadProgramMemory(Chip8 *chip, const byte *data, int size);
+
+void CHIP_Seed(Chip8 *chip, uint32_t seed);
+
+byte CHIP_Random(Chip8 *chip);
+
+void CHIP_SetDispatch(Chip8 *chip, int dispatch);
+
+const char *CHIP_DispatchName(int dispatch);
+
+// Returns the CHIP_DISPATCH_ backend called name by CHIP_DispatchName, -1 if there is none
+int CHIP_DispatchByName(const char *name);
+
+// Returns mnemonic of OP_ id op
+const char *CHIP_OpName(int op);
+
+CHIP_Op CHIP_Decode(word instruction);
+
+void CHIP_MemoryWritten(Chip8 *chip, int address, int size);
+
+// Returns byte of RAM at address, addresses wrap around RAM_SIZE
+static inline byte CHIP_ReadByte(const Chip8 *chip, int address)
+{
+    address &= RAM_SIZE - 1;
+    return chip->pages[address / PAGE_SIZE]->data[address % PAGE_SIZE];
+}
+
+void CHIP_WriteByte(Chip8 *chip, int address, byte value);
+
+int CHIP_StoreMemory(Chip8 *chip, int address, const byte *data, int size);
+
+void CHIP_ReadMemory(const Chip8 *chip, int address, byte *data, int size);
+
+void CHIP_WriteMemory(Chip8 *chip, int address, const byte *data, int size);
+
+void CHIP_Fork(Chip8 *child, Chip8 *parent);
+
+void CHIP_EmulateCycle(Chip8 *chip);
+
+void CHIP_EmulateCycles(Chip8 *chip, long cycles);
+
+void CHIP_TickTimers(Chip8 *chip);
+
+void CHIP_RunFrame(Chip8 *chip, int instructionsPerFrame);
+
+void CHIP_Step(Chip8 *chip);
+
+const char *CHIP_FaultName(int fault);
+
+// Presses or releases key, a press wakes a machine waiting in Fx0A
+void CHIP_SetKey(Chip8 *chip, int key, int pressed);
+
+// Returns color of pixel x, y of the current display mode - bit n is the pixel of plane n
+byte CHIP_GetPixel(Chip8 *chip, int x, int y);
+
+uint64_t CHIP_HashDisplay(Chip8 *chip);
 
-byte drawFlag;
-byte Display[WIDTH * HEIGHT];
+int CHIP_CompareState(Chip8 *a, Chip8 *b);
 
-byte soundFlag;
+// Returns size of the save state of chip, which depends on its model
+int CHIP_StateSize(const Chip8 *chip);
 
-// Keyboard
-byte Keyboard[16];
+int CHIP_SaveState(Chip8 *chip, byte *buffer, int size);
 
-void CHIP_Initalize();
+int CHIP_LoadState(Chip8 *chip, const byte *buffer, int size);
 
-int CHIP_LoadProgram(char *fname);
+int CHIP_SaveStateFile(Chip8 *chip, const char *fname);
 
-void CHIP_EmulateCycle();
+int CHIP_LoadStateFile(Chip8 *chip, const char *fname);
 
-void print_chip_content();
+void print_chip_content(Chip8 *chip);
 
-#endif
\ No newline at end of file
+#endif
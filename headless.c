@@ -0,0 +1,667 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "batch.h"
+#include "block.h"
+#include "scheduler.h"
+#include "input.h"
+#include "audio.h"
+#include "library.h"
+#include "rewind.h"
+
+#ifdef CHIP_PROFILE
+#include "profile.h"
+#endif
+
+// Instructions per frame when --ipf is not given
+#define DEFAULT_IPF     10
+
+// Most key events read from a key script
+#define MAX_KEY_EVENTS  4096
+
+// Samples of the longest frame, --audio-latency must hold at least one frame
+#define FRAME_SAMPLES   ((AUDIO_SAMPLE_RATE + SCHED_FRAME_RATE - 1) / SCHED_FRAME_RATE)
+
+// Frames between keyframes and average arena bytes per frame of --rewind
+#define REWIND_INTERVAL     60
+#define REWIND_FRAME_BYTES  1024
+
+// Key script entry - set key to state at the start of frame
+typedef struct KeyEvent
+{
+    long frame;
+    byte key;
+    byte state;
+} KeyEvent;
+
+typedef struct Options
+{
+    char *rom;          // ROM file, or hash of the ROM with --library
+    char *library;      // ROM pack built by romlib
+    char *keys;
+    char *loadState;    // state restored after loading the ROM
+    char *saveState;    // state written after the run
+    char *record;       // input log written for the first instance
+    char *replay;       // input log to replay instead of running the budget
+    char *profile;      // prefix of the profile files of the first instance
+    char *audio;        // WAV file for the sound of the first instance, "null" to discard it
+    double rewind;      // seconds kept in the rewind buffer of the first instance, 0 for none
+    int audioLatency;   // samples queued between the core and the sink
+    uint32_t seed;
+    int seedGiven;      // --seed was given, it then replaces the generator of a loaded state
+    int checkpoint;     // frames between recorded display hashes
+    long cycles;        // cycle budget, 0 if frame budget is used
+    long frames;        // frame budget
+    int ipf;            // instructions per frame
+    int dispatch;
+    int model;          // CHIP_MODEL_ of every instance
+    int quirks;         // CHIP_QUIRKS_ profile, -1 for the default of the model
+    int instances;
+    int threads;
+    int realtime;       // pace frames to 60 Hz instead of running unthrottled
+    int print;          // print final display as text
+    int diff;           // run block engine against the interpreter instead
+} Options;
+
+typedef struct Run
+{
+    Options *options;
+    Chip8 *machines;
+    KeyEvent *events;
+    int eventCount;
+    InputLog *log;      // records the first instance if not NULL
+    Audio *audio;       // sound of the first instance if not NULL
+    Rewind *rewind;     // frames of the first instance if not NULL
+    FILE *wav;          // sink of audio, NULL for the null sink
+} Run;
+
+void usage()
+{
+    fprintf(stderr,
+        "usage: chip8-headless ROM [options]\n"
+        "  --library PACK   load the ROM whose hash is given instead of a file from PACK\n"
+        "  --cycles N       run N instructions\n"
+        "  --frames N       run N frames (default 600)\n"
+        "  --ipf N          instructions per frame (default %d)\n"
+        "  --keys FILE      key script, one \"frame key state\" per line, key in hex, state 1 or 0\n"
+        "  --dispatch NAME  table, nibble, threaded, cached or blocks\n"
+        "  --model NAME     chip8, schip or xochip (default chip8)\n"
+        "  --quirks NAME    vip, chip48, schip or modern (default schip, modern for xochip)\n"
+        "  --instances N    run N copies of the machine\n"
+        "  --threads N      worker threads for --instances (default all cores)\n"
+        "  --realtime       pace frames to 60 Hz instead of running unthrottled\n"
+        "  --load-state F   start from save state F instead of reset\n"
+        "  --save-state F   write state of the first instance to F after the run\n"
+        "  --seed N         seed of the RND generator (default 1, a loaded state keeps its own)\n"
+        "  --record F       write input log of the first instance to F\n"
+        "  --checkpoint N   frames between display hashes in the input log (default 60)\n"
+        "  --replay F       replay input log F at full speed and check its display hashes\n"
+        "  --profile P      profile the first instance, write P.csv, P.json and P.folded\n"
+        "                   (builds made with -DCHIP_PROFILE only)\n"
+        "  --audio F        write sound of the first instance to WAV file F, \"null\" to discard it\n"
+        "  --audio-latency N  samples queued between emulation and sink, at least %d (default %d)\n"
+        "  --rewind S       keep the last S seconds of the first instance, then rerun them from the oldest frame\n"
+        "  --print          print final display\n"
+        "  --diff           check block engine against the interpreter for the cycle budget\n",
+        DEFAULT_IPF, FRAME_SAMPLES, AUDIO_SAMPLE_RATE / 30);
+    exit(2);
+}
+
+// Prints that name is no known kind of setting and exits
+void unknown(const char *kind, const char *name)
+{
+    fprintf(stderr, "Unknown %s: %s\n", kind, name);
+    exit(2);
+}
+
+// Reads key script into events
+// returns number of events or -1 if file can not be opened
+int loadKeys(char *fname, KeyEvent *events)
+{
+    FILE *fp = fopen(fname, "r");
+    char line[256];
+    int count = 0;
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    while (count < MAX_KEY_EVENTS && fgets(line, sizeof(line), fp) != NULL)
+    {
+        long frame;
+        unsigned key, state;
+
+        if (line[0] == '#' || sscanf(line, "%ld %x %u", &frame, &key, &state) != 3 || key > 0xF)
+        {
+            continue;
+        }
+
+        events[count].frame = frame;
+        events[count].key = key;
+        events[count].state = state != 0;
+        count++;
+    }
+
+    fclose(fp);
+
+    return count;
+}
+
+// Runs remaining instructions of chip from frame on, applying key events at frame boundaries
+// events before frame are applied at once, so the keyboard is the one the frame started with
+// a budget that is not a multiple of the frame size ends with a partial frame without timer tick
+void runFrames(Run *run, Chip8 *chip, long frame, long remaining, InputLog *log, Audio *audio, Rewind *rewind)
+{
+    Options *options = run->options;
+    int next = 0;
+    int16_t samples[FRAME_SAMPLES];
+    Scheduler scheduler;
+
+    SCHED_Init(&scheduler, options->ipf, options->realtime ? SCHED_SLEEP : SCHED_UNTHROTTLED);
+
+    for (; remaining > 0; frame++)
+    {
+        while (next < run->eventCount && run->events[next].frame <= frame)
+        {
+            CHIP_SetKey(chip, run->events[next].key, run->events[next].state);
+            next++;
+        }
+
+        if (remaining < options->ipf)
+        {
+            CHIP_EmulateCycles(chip, remaining);
+            break;
+        }
+
+        if (log != NULL)
+        {
+            INPUT_RecordFrame(log, chip);
+        }
+
+        SCHED_RunFrame(&scheduler, chip);
+
+        if (log != NULL)
+        {
+            INPUT_EndFrame(log, chip);
+        }
+
+        if (rewind != NULL)
+        {
+            REWIND_Push(rewind, chip);
+        }
+
+        if (audio != NULL)
+        {
+            AUDIO_Frame(audio, chip);
+
+            // the sink drains the ring after every frame, and the latency holds at least one frame, so nothing is
+            // dropped and one read empties the ring
+            int count = AUDIO_Read(audio, samples, sizeof(samples) / sizeof(samples[0]));
+
+            if (run->wav != NULL)
+            {
+                AUDIO_WriteWAV(run->wav, samples, count);
+            }
+        }
+
+        SCHED_WaitFrame(&scheduler);
+        remaining -= options->ipf;
+    }
+}
+
+// Runs one machine for the whole budget
+void runInstance(int index, void *context)
+{
+    Run *run = context;
+    Options *options = run->options;
+    long total = options->cycles > 0 ? options->cycles : options->frames * options->ipf;
+
+    if (index == 0)
+    {
+        runFrames(run, &run->machines[0], 0, total, run->log, run->audio, run->rewind);
+    }
+    else
+    {
+        runFrames(run, &run->machines[index], 0, total, NULL, NULL, NULL);
+    }
+}
+
+// Seeks the first instance to the oldest frame of the rewind buffer and runs the rest of the budget again
+// returns the frame the rerun started from, or -1 if it did not end in the same state
+long checkRewind(Run *run, long total)
+{
+    Chip8 *chip = &run->machines[0];
+    Chip8 end = {0};
+    int held = REWIND_Frames(run->rewind);
+
+    if (held == 0)
+    {
+        return 0;
+    }
+
+    // frame n is pushed after frame n ran
+    long frame = total / run->options->ipf - held + 1;
+
+    CHIP_Fork(&end, chip);
+    REWIND_Seek(run->rewind, chip, held - 1);
+    runFrames(run, chip, frame, total - frame * run->options->ipf, NULL, NULL, NULL);
+
+    int same = CHIP_CompareState(&end, chip) && end.cycles == chip->cycles;
+
+    CHIP_Free(&end);
+
+    return same ? frame : -1;
+}
+
+void printDisplay(Chip8 *chip)
+{
+    // colors 1 to 3 of XO-CHIP are the pixels of the first, the second or both planes
+    for (int y = 0; y < CHIP_Height(chip); y++)
+    {
+        for (int x = 0; x < CHIP_Width(chip); x++)
+        {
+            putchar(".#o@"[CHIP_GetPixel(chip, x, y)]);
+        }
+        putchar('\n');
+    }
+}
+
+#ifdef CHIP_PROFILE
+
+// Writes prefix.csv, prefix.json and prefix.folded, returns 0 on success or -1 on error
+int writeProfile(Profile *profile, const char *prefix)
+{
+    int (*writers[3])(const Profile *, FILE *) = { PROFILE_WriteCSV, PROFILE_WriteJSON, PROFILE_WriteFolded };
+    const char *extensions[3] = { "csv", "json", "folded" };
+    char fname[1024];
+
+    for (int i = 0; i < 3; i++)
+    {
+        snprintf(fname, sizeof(fname), "%s.%s", prefix, extensions[i]);
+
+        FILE *fp = fopen(fname, "w");
+
+        if (fp == NULL)
+        {
+            return -1;
+        }
+
+        int status = writers[i](profile, fp);
+
+        if (fclose(fp) != 0 || status == -1)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#endif
+
+int main(int argc, char *argv[])
+{
+    Options options = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, AUDIO_SAMPLE_RATE / 30, 1, 0, 60, 0, 600, DEFAULT_IPF, CHIP_DISPATCH_TABLE, CHIP_MODEL_CHIP8, -1, 1, 0, 0, 0, 0 };
+    static KeyEvent events[MAX_KEY_EVENTS];
+    Run run;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--print") == 0)
+            options.print = 1;
+        else if (strcmp(argv[i], "--realtime") == 0)
+            options.realtime = 1;
+        else if (strcmp(argv[i], "--diff") == 0)
+            options.diff = 1;
+        else if (argv[i][0] != '-')
+            options.rom = argv[i];
+        else if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argv[i], "--cycles") == 0)
+            options.cycles = atol(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0)
+            options.frames = atol(argv[++i]);
+        else if (strcmp(argv[i], "--ipf") == 0)
+            options.ipf = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--library") == 0)
+            options.library = argv[++i];
+        else if (strcmp(argv[i], "--keys") == 0)
+            options.keys = argv[++i];
+        else if (strcmp(argv[i], "--load-state") == 0)
+            options.loadState = argv[++i];
+        else if (strcmp(argv[i], "--save-state") == 0)
+            options.saveState = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0)
+        {
+            options.seed = strtoul(argv[++i], NULL, 0);
+            options.seedGiven = 1;
+        }
+        else if (strcmp(argv[i], "--record") == 0)
+            options.record = argv[++i];
+        else if (strcmp(argv[i], "--checkpoint") == 0)
+            options.checkpoint = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--replay") == 0)
+            options.replay = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0)
+            options.profile = argv[++i];
+        else if (strcmp(argv[i], "--audio") == 0)
+            options.audio = argv[++i];
+        else if (strcmp(argv[i], "--audio-latency") == 0)
+            options.audioLatency = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rewind") == 0)
+            options.rewind = atof(argv[++i]);
+        else if (strcmp(argv[i], "--dispatch") == 0)
+        {
+            if ((options.dispatch = CHIP_DispatchByName(argv[++i])) < 0)
+                unknown("dispatch backend", argv[i]);
+        }
+        else if (strcmp(argv[i], "--model") == 0)
+        {
+            if ((options.model = CHIP_ModelByName(argv[++i])) < 0)
+                unknown("model", argv[i]);
+        }
+        else if (strcmp(argv[i], "--quirks") == 0)
+        {
+            if ((options.quirks = CHIP_QuirksByName(argv[++i])) < 0)
+                unknown("quirks profile", argv[i]);
+        }
+        else if (strcmp(argv[i], "--instances") == 0)
+            options.instances = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0)
+            options.threads = atoi(argv[++i]);
+        else
+            usage();
+    }
+
+    if (options.rom == NULL || options.ipf <= 0 || options.instances <= 0)
+    {
+        usage();
+    }
+
+    run.options = &options;
+    run.events = events;
+    run.eventCount = 0;
+    run.log = NULL;
+    run.audio = NULL;
+    run.rewind = NULL;
+    run.wav = NULL;
+    run.machines = calloc(options.instances, sizeof(Chip8));
+
+    if (options.keys != NULL && (run.eventCount = loadKeys(options.keys, events)) < 0)
+    {
+        fprintf(stderr, "Unable to open key script %s\n", options.keys);
+        return 1;
+    }
+
+    Library library;
+    uint64_t hash = 0;
+
+    if (options.library != NULL)
+    {
+        if (LIBRARY_Open(&library, options.library) != 0)
+        {
+            fprintf(stderr, "Unable to open ROM pack %s\n", options.library);
+            return 1;
+        }
+
+        hash = strtoull(options.rom, NULL, 16);
+    }
+
+    for (int i = 0; i < options.instances; i++)
+    {
+        CHIP_Initalize(&run.machines[i]);
+        CHIP_SetModel(&run.machines[i], options.model);
+
+        if (options.quirks != -1)
+        {
+            CHIP_SetQuirks(&run.machines[i], options.quirks);
+        }
+
+        int size;
+
+        if (options.library != NULL && (size = LIBRARY_Load(&library, &run.machines[i], hash)) == -1)
+        {
+            fprintf(stderr, "%s: no ROM with hash %s\n", options.library, options.rom);
+            return 1;
+        }
+
+        if (options.library == NULL)
+        {
+            size = CHIP_LoadProgram(&run.machines[i], options.rom);
+        }
+
+        if (size < 0)
+        {
+            fprintf(stderr, "%s: %s\n", options.rom, CHIP_LoadError(&run.machines[i], size));
+            return 1;
+        }
+
+        if (size > CHIP_ProgramSize(&run.machines[i]) && i == 0)
+        {
+            fprintf(stderr, "%s: %s, loaded %d of %d bytes\n", options.rom, CHIP_LoadError(&run.machines[i], size),
+                CHIP_ProgramSize(&run.machines[i]), size);
+        }
+
+        if (options.loadState != NULL && CHIP_LoadStateFile(&run.machines[i], options.loadState) == -1)
+        {
+            fprintf(stderr, "Unable to load state %s\n", options.loadState);
+            return 1;
+        }
+
+        CHIP_SetDispatch(&run.machines[i], options.dispatch);
+
+        // a loaded state continues with its own generator
+        if (options.loadState == NULL || options.seedGiven)
+        {
+            CHIP_Seed(&run.machines[i], options.seed);
+        }
+    }
+
+    if (options.library != NULL)
+    {
+        LIBRARY_Close(&library);
+    }
+
+    if (options.replay != NULL)
+    {
+        InputLog log;
+
+        if (INPUT_Load(&log, options.replay) == -1)
+        {
+            fprintf(stderr, "Unable to read input log %s\n", options.replay);
+            return 1;
+        }
+
+        double start = SCHED_Now();
+        long mismatch = INPUT_Replay(&log, &run.machines[0]);
+        double elapsed = SCHED_Now() - start;
+
+        if (mismatch >= 0)
+        {
+            printf("replay diverged at frame %ld\n", mismatch);
+            return 1;
+        }
+
+        printf("replay matched %d checkpoints, %llu cycles in %.6f seconds\n",
+            log.checkpointCount, (unsigned long long) run.machines[0].cycles, elapsed);
+
+        INPUT_Free(&log);
+        return 0;
+    }
+
+#ifdef CHIP_PROFILE
+    Profile *profile = NULL;
+
+    if (options.profile != NULL)
+    {
+        profile = PROFILE_Create();
+        PROFILE_Attach(&run.machines[0], profile);
+    }
+#else
+    if (options.profile != NULL)
+    {
+        fprintf(stderr, "--profile needs a build made with -DCHIP_PROFILE (make profile)\n");
+        return 1;
+    }
+#endif
+
+    Audio audio;
+
+    if (options.audio != NULL)
+    {
+        if (options.audioLatency < FRAME_SAMPLES || AUDIO_Init(&audio, AUDIO_SAMPLE_RATE, options.audioLatency) == -1)
+        {
+            fprintf(stderr, "Unable to set up audio with latency %d, at least %d samples are needed\n",
+                options.audioLatency, FRAME_SAMPLES);
+            return 1;
+        }
+
+        if (strcmp(options.audio, "null") != 0 && (run.wav = AUDIO_OpenWAV(options.audio, AUDIO_SAMPLE_RATE)) == NULL)
+        {
+            fprintf(stderr, "Unable to open %s\n", options.audio);
+            return 1;
+        }
+
+        run.audio = &audio;
+    }
+
+    InputLog record;
+
+    if (options.record != NULL)
+    {
+        // the log starts from the generator the instance runs with, the one of a loaded state unless --seed was given
+        uint32_t seed = options.loadState != NULL && !options.seedGiven ? run.machines[0].random : options.seed;
+
+        INPUT_Init(&record, &run.machines[0], seed, options.ipf, options.checkpoint);
+        run.log = &record;
+    }
+
+    if (options.rewind > 0)
+    {
+        // the oldest frames are dropped a keyframe group at a time, a ring one group larger keeps the whole span
+        int frames = (int) (options.rewind * SCHED_FRAME_RATE) + 1 + REWIND_INTERVAL;
+
+        if ((run.rewind = REWIND_Create(frames, REWIND_INTERVAL, REWIND_RECORD_MAX + frames * REWIND_FRAME_BYTES)) == NULL)
+        {
+            fprintf(stderr, "Unable to set up rewind buffer of %g seconds\n", options.rewind);
+            return 1;
+        }
+    }
+
+    long total = options.cycles > 0 ? options.cycles : options.frames * options.ipf;
+
+    if (options.diff)
+    {
+        long diverged = BLOCK_DiffTest(&run.machines[0], total);
+
+        if (diverged >= 0)
+        {
+            printf("diverged at cycle %ld\n", diverged);
+            return 1;
+        }
+
+        printf("no divergence in %ld cycles\n", total);
+        return 0;
+    }
+
+    double start = SCHED_Now();
+    BATCH_ForEach(options.instances, options.threads, runInstance, &run);
+    double elapsed = SCHED_Now() - start;
+
+    printf("hash %016llx\n", (unsigned long long) CHIP_HashDisplay(&run.machines[0]));
+
+    if (run.machines[0].fault != CHIP_FAULT_NONE)
+    {
+        printf("fault %s at 0x%03x\n", CHIP_FaultName(run.machines[0].fault), run.machines[0].PC);
+    }
+
+    for (int i = 1; i < options.instances; i++)
+    {
+        if (CHIP_HashDisplay(&run.machines[i]) != CHIP_HashDisplay(&run.machines[0]))
+        {
+            printf("instance %d hash %016llx\n", i, (unsigned long long) CHIP_HashDisplay(&run.machines[i]));
+        }
+    }
+
+    printf("dispatch %s\ninstances %d\ncycles %ld\nseconds %.6f\nMIPS %.2f\n",
+        CHIP_DispatchName(options.dispatch), options.instances, total * options.instances,
+        elapsed, total * options.instances / elapsed / 1e6);
+
+    if (options.print)
+    {
+        printDisplay(&run.machines[0]);
+    }
+
+#ifdef CHIP_PROFILE
+    if (profile != NULL)
+    {
+        if (writeProfile(profile, options.profile) == -1)
+        {
+            fprintf(stderr, "Unable to write profile %s\n", options.profile);
+            return 1;
+        }
+
+        PROFILE_Attach(&run.machines[0], NULL);
+        PROFILE_Free(profile);
+    }
+#endif
+
+    if (run.rewind != NULL)
+    {
+        int held = REWIND_Frames(run.rewind);
+        long full = (long) held * (run.machines[0].memorySize + sizeof(run.machines[0].Display));
+
+        printf("rewind %d frames in %d bytes, %ld as full copies\n", held, run.rewind->used, full);
+
+        long frame = checkRewind(&run, total);
+
+        if (frame < 0)
+        {
+            printf("rewind rerun diverged\n");
+            return 1;
+        }
+
+        printf("rewind rerun from frame %ld matched\n", frame);
+        REWIND_Free(run.rewind);
+    }
+
+    if (run.audio != NULL)
+    {
+        if (run.wav != NULL && AUDIO_CloseWAV(run.wav) == -1)
+        {
+            fprintf(stderr, "Unable to write %s\n", options.audio);
+            return 1;
+        }
+
+        AUDIO_Free(run.audio);
+    }
+
+    if (run.log != NULL)
+    {
+        if (INPUT_Save(run.log, options.record) == -1)
+        {
+            fprintf(stderr, "Unable to write input log %s\n", options.record);
+            return 1;
+        }
+
+        INPUT_Free(run.log);
+    }
+
+    if (options.saveState != NULL && CHIP_SaveStateFile(&run.machines[0], options.saveState) == -1)
+    {
+        fprintf(stderr, "Unable to save state %s\n", options.saveState);
+        return 1;
+    }
+
+    for (int i = 0; i < options.instances; i++)
+    {
+        CHIP_Free(&run.machines[i]);
+    }
+
+    free(run.machines);
+
+    return 0;
+}
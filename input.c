@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "input.h"
+
+#define INPUT_VERSION   1
+
+// Log file layout, all values little endian
+//  "C8IN", version (2 bytes), seed (4), instructions per frame (4), checkpoint interval (4)
+//  event count (4), events - cycle (8) keys (2)
+//  checkpoint count (4), checkpoints - frame (8) hash (8)
+
+static void putInteger(FILE *fp, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        fputc((value >> (i * 8)) & 0xFF, fp);
+    }
+}
+
+// returns 0 if the file ended before size bytes were read
+static int getInteger(FILE *fp, uint64_t *value, int size)
+{
+    *value = 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        int c = fgetc(fp);
+
+        if (c == EOF)
+        {
+            return 0;
+        }
+
+        *value |= (uint64_t) c << (i * 8);
+    }
+
+    return 1;
+}
+
+void INPUT_Init(InputLog *log, Chip8 *chip, uint32_t seed, int instructionsPerFrame, int checkpointInterval)
+{
+    memset(log, 0, sizeof(InputLog));
+
+    log->seed = seed;
+    log->instructionsPerFrame = instructionsPerFrame;
+    log->checkpointInterval = checkpointInterval > 0 ? checkpointInterval : 1;
+
+    CHIP_Seed(chip, seed);
+}
+
+void INPUT_Free(InputLog *log)
+{
+    free(log->events);
+    free(log->checkpoints);
+    memset(log, 0, sizeof(InputLog));
+}
+
+word INPUT_KeyMask(Chip8 *chip)
+{
+    word keys = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        if (chip->Keyboard[i])
+        {
+            keys |= 1 << i;
+        }
+    }
+
+    return keys;
+}
+
+void INPUT_RecordFrame(InputLog *log, Chip8 *chip)
+{
+    word keys = INPUT_KeyMask(chip);
+
+    if (keys == log->keys)
+    {
+        return;
+    }
+
+    if (log->eventCount == log->eventCapacity)
+    {
+        log->eventCapacity = log->eventCapacity ? log->eventCapacity * 2 : 64;
+        log->events = realloc(log->events, sizeof(InputEvent) * log->eventCapacity);
+    }
+
+    log->events[log->eventCount].cycle = chip->cycles;
+    log->events[log->eventCount].keys = keys;
+    log->eventCount++;
+    log->keys = keys;
+}
+
+void INPUT_EndFrame(InputLog *log, Chip8 *chip)
+{
+    log->frames++;
+
+    if (log->frames % log->checkpointInterval != 0)
+    {
+        return;
+    }
+
+    if (log->checkpointCount == log->checkpointCapacity)
+    {
+        log->checkpointCapacity = log->checkpointCapacity ? log->checkpointCapacity * 2 : 64;
+        log->checkpoints = realloc(log->checkpoints, sizeof(Checkpoint) * log->checkpointCapacity);
+    }
+
+    log->checkpoints[log->checkpointCount].frame = log->frames;
+    log->checkpoints[log->checkpointCount].hash = CHIP_HashDisplay(chip);
+    log->checkpointCount++;
+}
+
+int INPUT_Save(InputLog *log, const char *fname)
+{
+    FILE *fp = fopen(fname, "wb");
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    fwrite("C8IN", 1, 4, fp);
+    putInteger(fp, INPUT_VERSION, 2);
+    putInteger(fp, log->seed, 4);
+    putInteger(fp, log->instructionsPerFrame, 4);
+    putInteger(fp, log->checkpointInterval, 4);
+
+    putInteger(fp, log->eventCount, 4);
+    for (int i = 0; i < log->eventCount; i++)
+    {
+        putInteger(fp, log->events[i].cycle, 8);
+        putInteger(fp, log->events[i].keys, 2);
+    }
+
+    putInteger(fp, log->checkpointCount, 4);
+    for (int i = 0; i < log->checkpointCount; i++)
+    {
+        putInteger(fp, log->checkpoints[i].frame, 8);
+        putInteger(fp, log->checkpoints[i].hash, 8);
+    }
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int INPUT_Load(InputLog *log, const char *fname)
+{
+    FILE *fp = fopen(fname, "rb");
+    char magic[4];
+    uint64_t version, seed, ipf, interval, count, keys;
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    memset(log, 0, sizeof(InputLog));
+
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, "C8IN", 4) != 0 ||
+        !getInteger(fp, &version, 2) || version != INPUT_VERSION ||
+        !getInteger(fp, &seed, 4) || !getInteger(fp, &ipf, 4) || !getInteger(fp, &interval, 4) ||
+        !getInteger(fp, &count, 4))
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    log->seed = seed;
+    log->instructionsPerFrame = ipf;
+    log->checkpointInterval = interval;
+
+    log->eventCount = log->eventCapacity = count;
+    log->events = malloc(sizeof(InputEvent) * (count ? count : 1));
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (!getInteger(fp, &log->events[i].cycle, 8) || !getInteger(fp, &keys, 2))
+        {
+            fclose(fp);
+            INPUT_Free(log);
+            return -1;
+        }
+        log->events[i].keys = keys;
+    }
+
+    if (!getInteger(fp, &count, 4))
+    {
+        fclose(fp);
+        INPUT_Free(log);
+        return -1;
+    }
+
+    log->checkpointCount = log->checkpointCapacity = count;
+    log->checkpoints = malloc(sizeof(Checkpoint) * (count ? count : 1));
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (!getInteger(fp, &log->checkpoints[i].frame, 8) || !getInteger(fp, &log->checkpoints[i].hash, 8))
+        {
+            fclose(fp);
+            INPUT_Free(log);
+            return -1;
+        }
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+// Sets Keyboard of chip from key mask
+static void applyKeys(Chip8 *chip, word keys)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        CHIP_SetKey(chip, i, (keys >> i) & 1);
+    }
+}
+
+long INPUT_Replay(InputLog *log, Chip8 *chip)
+{
+    uint64_t frames = log->checkpointCount ? log->checkpoints[log->checkpointCount - 1].frame : 0;
+    int event = 0, checkpoint = 0;
+
+    CHIP_Seed(chip, log->seed);
+    applyKeys(chip, 0);
+
+    for (uint64_t frame = 1; frame <= frames; frame++)
+    {
+        uint64_t end = chip->cycles + log->instructionsPerFrame;
+
+        // events are recorded at frame starts, but any cycle inside the frame is honored
+        while (chip->cycles < end)
+        {
+            while (event < log->eventCount && log->events[event].cycle <= chip->cycles)
+            {
+                applyKeys(chip, log->events[event++].keys);
+            }
+
+            uint64_t until = (event < log->eventCount && log->events[event].cycle < end) ? log->events[event].cycle : end;
+
+            CHIP_EmulateCycles(chip, until - chip->cycles);
+        }
+
+        CHIP_TickTimers(chip);
+
+        if (checkpoint < log->checkpointCount && log->checkpoints[checkpoint].frame == frame)
+        {
+            if (log->checkpoints[checkpoint].hash != CHIP_HashDisplay(chip))
+            {
+                return frame;
+            }
+
+            checkpoint++;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,62 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "chip8.h"
+
+// Input log
+// records RND seed and key state changes (cycle, pressed keys) of a session together with periodic display hashes
+// replaying the log re-drives the machine at full speed and stops at the first checkpoint whose hash differs
+
+typedef struct InputEvent
+{
+    uint64_t cycle;     // chip->cycles when the keys changed
+    word keys;          // bit n set when key n is pressed
+} InputEvent;
+
+typedef struct Checkpoint
+{
+    uint64_t frame;     // frames run before the hash was taken
+    uint64_t hash;      // CHIP_HashDisplay after that frame
+} Checkpoint;
+
+typedef struct InputLog
+{
+    uint32_t seed;
+    int instructionsPerFrame;
+    int checkpointInterval;     // frames between checkpoints
+
+    InputEvent *events;
+    int eventCount, eventCapacity;
+
+    Checkpoint *checkpoints;
+    int checkpointCount, checkpointCapacity;
+
+    uint64_t frames;            // frames recorded so far
+    word keys;                  // key state of the last recorded event
+} InputLog;
+
+// Starts an empty log and seeds chip with seed, chip->random as seed keeps the generator of chip
+void INPUT_Init(InputLog *log, Chip8 *chip, uint32_t seed, int instructionsPerFrame, int checkpointInterval);
+
+void INPUT_Free(InputLog *log);
+
+// Returns Keyboard of chip as a bit mask
+word INPUT_KeyMask(Chip8 *chip);
+
+// Records key state of chip if it changed, call before every frame
+void INPUT_RecordFrame(InputLog *log, Chip8 *chip);
+
+// Counts the finished frame and adds a checkpoint every checkpointInterval frames, call after every frame
+void INPUT_EndFrame(InputLog *log, Chip8 *chip);
+
+// Writes log to file, returns 0 on success or -1 on error
+int INPUT_Save(InputLog *log, const char *fname);
+
+// Reads log from file, returns 0 on success or -1 on error
+int INPUT_Load(InputLog *log, const char *fname);
+
+// Replays log on chip, which must be freshly initialized with the recorded ROM loaded
+// returns frame of the first checkpoint that does not match or -1 if all of them matched
+long INPUT_Replay(InputLog *log, Chip8 *chip);
+
+#endif
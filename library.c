@@ -0,0 +1,359 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "chip8.h"
+#include "mapfile.h"
+#include "library.h"
+
+// Pack layout, all multi-byte values little endian
+//  0   magic "C8LB"
+//  4   version (2 bytes)
+//  6   ROM count (4 bytes)
+//  10  index sorted by hash, ENTRY_SIZE bytes per ROM:
+//        hash (8 bytes), data offset, size, name offset, name length (4 bytes each)
+//  ..  ROM data and file names, offsets are from the start of the pack
+
+#define HEADER_SIZE     10
+#define ENTRY_SIZE      24
+
+static const byte libraryMagic[4] = { 'C', '8', 'L', 'B' };
+
+// ROM collected while building a pack
+typedef struct BuildEntry
+{
+    uint64_t hash;
+    size_t offset;      // offset of data in the build buffer
+    int size;
+    char *name;
+} BuildEntry;
+
+static uint64_t getInteger(const byte *p, int size)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        value |= (uint64_t) p[i] << (i * 8);
+    }
+
+    return value;
+}
+
+static void putInteger(FILE *fp, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        fputc(value >> (i * 8) & 0xFF, fp);
+    }
+}
+
+uint64_t LIBRARY_Hash(const byte *data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static int compareEntries(const void *a, const void *b)
+{
+    const BuildEntry *x = a, *y = b;
+
+    return (x->hash > y->hash) - (x->hash < y->hash);
+}
+
+// Writes the sorted, deduplicated entries with their data from buffer to pack fname
+static int writePack(const char *fname, BuildEntry *entries, int count, const byte *buffer)
+{
+    FILE *fp = fopen(fname, "wb");
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    fwrite(libraryMagic, 1, 4, fp);
+    putInteger(fp, LIBRARY_VERSION, 2);
+    putInteger(fp, count, 4);
+
+    uint64_t offset = HEADER_SIZE + (uint64_t) count * ENTRY_SIZE;
+
+    for (int i = 0; i < count; i++)
+    {
+        int nameLength = strlen(entries[i].name);
+
+        putInteger(fp, entries[i].hash, 8);
+        putInteger(fp, offset, 4);
+        putInteger(fp, entries[i].size, 4);
+        putInteger(fp, offset + entries[i].size, 4);
+        putInteger(fp, nameLength, 4);
+
+        offset += entries[i].size + nameLength;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        fwrite(buffer + entries[i].offset, 1, entries[i].size, fp);
+        fputs(entries[i].name, fp);
+    }
+
+    int status = ferror(fp) || offset > 0xFFFFFFFFULL ? -1 : 0;
+
+    if (fclose(fp) != 0)
+    {
+        status = -1;
+    }
+
+    return status;
+}
+
+int LIBRARY_Build(const char *directory, const char *fname)
+{
+    DIR *dir = opendir(directory);
+
+    if (dir == NULL)
+    {
+        return -1;
+    }
+
+    BuildEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    byte *buffer = NULL;
+    size_t used = 0, bufferCapacity = 0;
+    int status = 0;
+    struct dirent *item;
+
+    // ROM contents are copied into one buffer so no file stays open or mapped while indexing
+    while (status == 0 && (item = readdir(dir)) != NULL)
+    {
+        char path[4096];
+        MappedFile file;
+
+        if (item->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", directory, item->d_name);
+
+        // directories and other special files cannot be mapped and are skipped
+        if (MAP_Open(&file, path) != 0)
+        {
+            continue;
+        }
+
+        if (file.size > 0x7FFFFFFF)
+        {
+            MAP_Close(&file);
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            BuildEntry *grown = realloc(entries, capacity * sizeof(BuildEntry));
+
+            if (grown == NULL)
+            {
+                status = -1;
+                MAP_Close(&file);
+                break;
+            }
+
+            entries = grown;
+        }
+
+        if (used + file.size > bufferCapacity)
+        {
+            size_t grownCapacity = bufferCapacity ? bufferCapacity : 65536;
+
+            while (used + file.size > grownCapacity)
+            {
+                grownCapacity *= 2;
+            }
+
+            byte *grown = realloc(buffer, grownCapacity);
+
+            if (grown == NULL)
+            {
+                status = -1;
+                MAP_Close(&file);
+                break;
+            }
+
+            buffer = grown;
+            bufferCapacity = grownCapacity;
+        }
+
+        if (file.size > 0)
+        {
+            memcpy(buffer + used, file.data, file.size);
+        }
+
+        entries[count].hash = LIBRARY_Hash(file.data, file.size);
+        entries[count].offset = used;
+        entries[count].size = (int) file.size;
+        entries[count].name = malloc(strlen(item->d_name) + 1);
+
+        if (entries[count].name == NULL)
+        {
+            status = -1;
+            MAP_Close(&file);
+            break;
+        }
+
+        strcpy(entries[count].name, item->d_name);
+
+        used += file.size;
+        count++;
+
+        MAP_Close(&file);
+    }
+
+    closedir(dir);
+
+    int unique = 0;
+
+    if (status == 0)
+    {
+        qsort(entries, count, sizeof(BuildEntry), compareEntries);
+
+        // equal hashes are equal ROMs, only the first of them is kept
+        for (int i = 0; i < count; i++)
+        {
+            if (unique > 0 && entries[unique - 1].hash == entries[i].hash)
+            {
+                free(entries[i].name);
+                continue;
+            }
+
+            entries[unique++] = entries[i];
+        }
+
+        status = writePack(fname, entries, unique, buffer);
+    }
+    else
+    {
+        unique = count;
+    }
+
+    for (int i = 0; i < unique; i++)
+    {
+        free(entries[i].name);
+    }
+
+    free(entries);
+    free(buffer);
+
+    return status == 0 ? unique : -1;
+}
+
+int LIBRARY_Open(Library *library, const char *fname)
+{
+    int status = MAP_Open(&library->file, fname);
+
+    if (status != 0)
+    {
+        return status;
+    }
+
+    const byte *data = library->file.data;
+    size_t size = library->file.size;
+
+    if (size < HEADER_SIZE || memcmp(data, libraryMagic, 4) != 0 || getInteger(data + 4, 2) != LIBRARY_VERSION)
+    {
+        MAP_Close(&library->file);
+        return -2;
+    }
+
+    library->count = (int) getInteger(data + 6, 4);
+    library->entries = data + HEADER_SIZE;
+
+    if (library->count < 0 || (size - HEADER_SIZE) / ENTRY_SIZE < (size_t) library->count)
+    {
+        MAP_Close(&library->file);
+        return -2;
+    }
+
+    // every ROM and name must lie inside the pack
+    for (int i = 0; i < library->count; i++)
+    {
+        const byte *entry = library->entries + i * ENTRY_SIZE;
+
+        if (getInteger(entry + 8, 4) + getInteger(entry + 12, 4) > size ||
+            getInteger(entry + 16, 4) + getInteger(entry + 20, 4) > size)
+        {
+            MAP_Close(&library->file);
+            return -2;
+        }
+    }
+
+    return 0;
+}
+
+void LIBRARY_Close(Library *library)
+{
+    MAP_Close(&library->file);
+    library->count = 0;
+    library->entries = NULL;
+}
+
+void LIBRARY_Get(const Library *library, int index, LibraryROM *rom)
+{
+    const byte *entry = library->entries + index * ENTRY_SIZE;
+
+    rom->hash = getInteger(entry, 8);
+    rom->data = library->file.data + getInteger(entry + 8, 4);
+    rom->size = (int) getInteger(entry + 12, 4);
+    rom->name = (const char *) library->file.data + getInteger(entry + 16, 4);
+    rom->nameLength = (int) getInteger(entry + 20, 4);
+}
+
+int LIBRARY_Find(const Library *library, uint64_t hash, LibraryROM *rom)
+{
+    int low = 0, high = library->count - 1;
+
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+        uint64_t key = getInteger(library->entries + middle * ENTRY_SIZE, 8);
+
+        if (key == hash)
+        {
+            LIBRARY_Get(library, middle, rom);
+            return middle;
+        }
+
+        if (key < hash)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+
+    return -1;
+}
+
+int LIBRARY_Load(const Library *library, Chip8 *chip, uint64_t hash)
+{
+    LibraryROM rom;
+
+    if (LIBRARY_Find(library, hash, &rom) == -1)
+    {
+        return -1;
+    }
+
+    CHIP_LoadProgramMemory(chip, rom.data, rom.size);
+
+    return rom.size;
+}
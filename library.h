@@ -0,0 +1,52 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "chip8.h"
+#include "mapfile.h"
+
+// ROM library
+// a directory of ROMs is indexed once into a single pack file keyed by a hash of the ROM contents
+// opening a pack maps it whole, so looking a ROM up and loading it costs no file opens and no per-byte reads
+
+#define LIBRARY_VERSION     1
+
+// Pack written by LIBRARY_Build and mapped by LIBRARY_Open
+typedef struct Library
+{
+    MappedFile file;
+    int count;                  // number of ROMs
+    const byte *entries;        // index sorted by hash
+} Library;
+
+// One ROM of a pack, data and name point into the mapped pack
+typedef struct LibraryROM
+{
+    uint64_t hash;
+    const byte *data;
+    int size;
+    const char *name;           // file name the ROM was indexed from, not terminated
+    int nameLength;
+} LibraryROM;
+
+// Returns 64-bit FNV-1a hash of size bytes of data, the key of a ROM in a pack
+uint64_t LIBRARY_Hash(const byte *data, size_t size);
+
+// Indexes every regular file of directory into pack fname, ROMs with equal contents are stored once
+// returns number of ROMs stored or -1 on error
+int LIBRARY_Build(const char *directory, const char *fname);
+
+// Maps pack fname, returns 0 on success, -1 if it cannot be opened or -2 if it is not a valid pack
+int LIBRARY_Open(Library *library, const char *fname);
+
+void LIBRARY_Close(Library *library);
+
+// Reads ROM index of the pack into rom, index runs from 0 to count - 1
+void LIBRARY_Get(const Library *library, int index, LibraryROM *rom);
+
+// Looks ROM hash up, returns its index and fills rom or returns -1 if the pack does not hold it
+int LIBRARY_Find(const Library *library, uint64_t hash, LibraryROM *rom);
+
+// Loads ROM hash into chip like CHIP_LoadProgram, returns size of the ROM or -1 if the pack does not hold it
+int LIBRARY_Load(const Library *library, Chip8 *chip, uint64_t hash);
+
+#endif
@@ -0,0 +1,516 @@
+#include <string.h>
+
+#include "lockstep.h"
+#include "quirks.h"
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+
+int LOCKSTEP_Init(Lockstep *lockstep, Chip8 *machines, int lanes)
+{
+    if (lanes < 1 || lanes > LOCKSTEP_LANES)
+    {
+        return -1;
+    }
+
+    // lanes share one decoded instruction, so they must decode and execute it the same way
+    for (int lane = 1; lane < lanes; lane++)
+    {
+        if (machines[lane].model != machines[0].model || machines[lane].quirks != machines[0].quirks)
+        {
+            return -1;
+        }
+    }
+
+    memset(lockstep, 0, sizeof(Lockstep));
+    lockstep->machines = machines;
+    lockstep->lanes = lanes;
+
+    return 0;
+}
+
+#if defined(__GNUC__)
+
+// Lanes are split into vectors of the widest registers the build targets, 32 bytes with AVX2 and 16 with SSE2
+#if defined(__AVX2__)
+#define VECTOR_SIZE     32
+#else
+#define VECTOR_SIZE     16
+#endif
+
+#define VECTOR_COUNT    (LOCKSTEP_LANES / VECTOR_SIZE)
+
+// One byte element per lane
+typedef byte Lanes __attribute__((vector_size(VECTOR_SIZE)));
+
+// Lane selections, -1 in selected lanes and 0 in the others, as produced by vector compares
+typedef signed char LaneMask __attribute__((vector_size(VECTOR_SIZE)));
+
+// Same bytes seen as 16-bit elements, for shifts
+typedef word LanePairs __attribute__((vector_size(VECTOR_SIZE)));
+
+// Element of lane n in an array of VECTOR_COUNT vectors
+// accessed as a byte in memory, subscripting the vector with a lane not known at compile time rewrites all of it
+#define LANE(vectors, n)    ((byte *) (vectors))[n]
+
+// Registers of all lanes, lanes past Lockstep.lanes stay 0 and are never selected
+// 16-bit registers are split into low and high bytes, so every register has one byte per lane
+typedef struct Registers
+{
+    Lanes V[16][VECTOR_COUNT];
+    Lanes I[VECTOR_COUNT], IHigh[VECTOR_COUNT];
+    Lanes PC[VECTOR_COUNT], PCHigh[VECTOR_COUNT];
+    Lanes DT[VECTOR_COUNT], ST[VECTOR_COUNT];
+    Lanes sound[VECTOR_COUNT];      // soundFlag
+} Registers;
+
+typedef struct Selection
+{
+    LaneMask mask[VECTOR_COUNT];
+} Selection;
+
+// Byte operations are written with the ones SSE2 and AVX2 have, the compiler falls back to one lane at a time
+// for the others (unsigned compares, byte shifts)
+
+// a in the lanes selected by mask and b in the others
+#define SELECT(mask, a, b)      (((a) & (Lanes) (mask)) | ((b) & ~(Lanes) (mask)))
+
+// -1 in the lanes where a < b unsigned, compared as signed bytes with the sign bits flipped
+#define BELOW(a, b)             ((Lanes) ((LaneMask) ((a) ^ 0x80) < (LaneMask) ((b) ^ 0x80)))
+
+// Carry out of low + addend, low being the sum already, as -1 in the lanes that carry
+// subtracting it from the high byte adds the carry
+#define CARRY(low, addend)      BELOW(low, addend)
+
+// a >> n in every lane, shifted as 16-bit elements with the bits coming from the next byte masked off
+#define SHIFT_RIGHT(a, n)       ((Lanes) ((LanePairs) (a) >> (n)) & (0xFF >> (n)))
+
+// Returns bit n set for every selected lane n of one vector
+static inline uint32_t vectorBits(LaneMask mask)
+{
+#if defined(__AVX2__)
+    return (uint32_t) _mm256_movemask_epi8((__m256i) mask);
+#elif defined(__SSE2__)
+    return (uint32_t) _mm_movemask_epi8((__m128i) mask);
+#else
+    uint32_t bits = 0;
+
+    for (int i = 0; i < VECTOR_SIZE; i++)
+    {
+        bits |= (uint32_t) (mask[i] < 0) << i;
+    }
+
+    return bits;
+#endif
+}
+
+// Returns bit n set for every selected lane n
+static inline uint32_t laneBits(const Selection *selection)
+{
+    uint32_t bits = 0;
+
+    for (int i = 0; i < VECTOR_COUNT; i++)
+    {
+        bits |= vectorBits(selection->mask[i]) << (i * VECTOR_SIZE);
+    }
+
+    return bits;
+}
+
+// Copies registers of machine to lane
+static void loadLane(Registers *r, const Chip8 *chip, int lane)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        LANE(r->V[i], lane) = chip->V[i];
+    }
+
+    LANE(r->I, lane) = chip->I & 0xFF;
+    LANE(r->IHigh, lane) = chip->I >> 8;
+    LANE(r->PC, lane) = chip->PC & 0xFF;
+    LANE(r->PCHigh, lane) = chip->PC >> 8;
+    LANE(r->DT, lane) = chip->DT;
+    LANE(r->ST, lane) = chip->ST;
+}
+
+// Copies registers of lane to machine
+static void storeLane(const Registers *r, Chip8 *chip, int lane)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        chip->V[i] = LANE(r->V[i], lane);
+    }
+
+    chip->I = LANE(r->IHigh, lane) << 8 | LANE(r->I, lane);
+    chip->PC = LANE(r->PCHigh, lane) << 8 | LANE(r->PC, lane);
+    chip->DT = LANE(r->DT, lane);
+    chip->ST = LANE(r->ST, lane);
+}
+
+// Gathers registers of every machine, active selects the lanes that are not halted
+static void load(Lockstep *lockstep, Registers *r, Selection *active)
+{
+    memset(r, 0, sizeof(Registers));
+    memset(active, 0, sizeof(Selection));
+
+    for (int lane = 0; lane < lockstep->lanes; lane++)
+    {
+        loadLane(r, &lockstep->machines[lane], lane);
+        LANE(r->sound, lane) = lockstep->machines[lane].soundFlag;
+        LANE(active->mask, lane) = lockstep->machines[lane].halted ? 0 : -1;
+    }
+
+    // machines may have been written since the last run
+    memset(lockstep->codeState, 0, sizeof(lockstep->codeState));
+}
+
+static void store(Lockstep *lockstep, const Registers *r)
+{
+    for (int lane = 0; lane < lockstep->lanes; lane++)
+    {
+        storeLane(r, &lockstep->machines[lane], lane);
+        lockstep->machines[lane].soundFlag = LANE(r->sound, lane);
+    }
+}
+
+// Returns 1 if every lane holds the same bytes in page
+// pages of forked machines are compared by pointer, pages loaded separately by content, once until the next write
+static int pageShared(Lockstep *lockstep, int page)
+{
+    if (lockstep->codeState[page] == 0)
+    {
+        const CHIP_Page *first = lockstep->machines[0].pages[page];
+
+        lockstep->codeState[page] = 1;
+
+        for (int lane = 1; lane < lockstep->lanes; lane++)
+        {
+            const CHIP_Page *other = lockstep->machines[lane].pages[page];
+
+            if (other != first && memcmp(other->data, first->data, PAGE_SIZE) != 0)
+            {
+                lockstep->codeState[page] = 2;
+                break;
+            }
+        }
+    }
+
+    return lockstep->codeState[page] == 1;
+}
+
+// Drops the selected lanes whose instruction at pc differs from instruction
+static void sameInstruction(Lockstep *lockstep, Selection *group, word pc, word instruction)
+{
+    for (int lane = 0; lane < lockstep->lanes; lane++)
+    {
+        const Chip8 *chip = &lockstep->machines[lane];
+
+        if (LANE(group->mask, lane) && (CHIP_ReadByte(chip, pc) << 8 | CHIP_ReadByte(chip, pc + 1)) != instruction)
+        {
+            LANE(group->mask, lane) = 0;
+        }
+    }
+}
+
+// Returns 1 if op has a vector form for machines of model
+static int isVector(int op, int model)
+{
+    switch (op)
+    {
+        case OP_LD: case OP_ADD: case OP_LDR: case OP_OR: case OP_AND: case OP_XOR:
+        case OP_ADDR: case OP_SUB: case OP_SUBN: case OP_SHR: case OP_SHL:
+        case OP_LDI: case OP_ADDI: case OP_LDCH: case OP_LDDT: case OP_SETDT: case OP_SETST:
+        case OP_JP:
+            return 1;
+
+        // skips over F000 nnnn are 4 bytes on XO-CHIP, left to the interpreter
+        case OP_SE: case OP_SNE: case OP_SER: case OP_SNER:
+            return model != CHIP_MODEL_XOCHIP;
+
+        default:
+            return 0;
+    }
+}
+
+// Runs op on the lanes of vector v selected by group
+static void execVector(const Quirks *quirks, Registers *r, const CHIP_Op *op, int v, LaneMask group)
+{
+    Lanes zero = {0};
+    Lanes vx = r->V[op->x][v];
+    Lanes vy = r->V[op->y][v];
+    Lanes source = quirks->shiftVy ? vy : vx;
+    Lanes next = r->PC[v] + 2;
+    Lanes nextHigh = r->PCHigh[v] - CARRY(next, zero + 2);
+    Lanes low, skip;
+
+    switch (op->op)
+    {
+        case OP_LD:
+            r->V[op->x][v] = SELECT(group, zero + op->kk, vx);
+            break;
+
+        case OP_ADD:
+            r->V[op->x][v] = SELECT(group, vx + op->kk, vx);
+            break;
+
+        case OP_LDR:
+            r->V[op->x][v] = SELECT(group, vy, vx);
+            break;
+
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+            low = op->op == OP_OR ? vx | vy : op->op == OP_AND ? vx & vy : vx ^ vy;
+            r->V[op->x][v] = SELECT(group, low, vx);
+
+            if (quirks->vfReset)
+            {
+                r->V[15][v] = SELECT(group, zero, r->V[15][v]);
+            }
+            break;
+
+        // VF is written last, so it holds the flag when x is F
+        case OP_ADDR:
+            low = vx + vy;
+            r->V[op->x][v] = SELECT(group, low, vx);
+            r->V[15][v] = SELECT(group, CARRY(low, vx) & 1, r->V[15][v]);
+            break;
+
+        case OP_SUB:
+            r->V[op->x][v] = SELECT(group, vx - vy, vx);
+            r->V[15][v] = SELECT(group, BELOW(vy, vx) & 1, r->V[15][v]);
+            break;
+
+        case OP_SUBN:
+            r->V[op->x][v] = SELECT(group, vy - vx, vx);
+            r->V[15][v] = SELECT(group, BELOW(vx, vy) & 1, r->V[15][v]);
+            break;
+
+        case OP_SHR:
+            r->V[op->x][v] = SELECT(group, SHIFT_RIGHT(source, 1), vx);
+            r->V[15][v] = SELECT(group, source & 1, r->V[15][v]);
+            break;
+
+        case OP_SHL:
+            r->V[op->x][v] = SELECT(group, source + source, vx);
+            r->V[15][v] = SELECT(group, SHIFT_RIGHT(source, 7), r->V[15][v]);
+            break;
+
+        case OP_LDI:
+            r->I[v] = SELECT(group, zero + (byte) op->nnn, r->I[v]);
+            r->IHigh[v] = SELECT(group, zero + (byte) (op->nnn >> 8), r->IHigh[v]);
+            break;
+
+        case OP_ADDI:
+            low = r->I[v] + vx;
+            r->IHigh[v] = SELECT(group, r->IHigh[v] - CARRY(low, vx), r->IHigh[v]);
+            r->I[v] = SELECT(group, low, r->I[v]);
+            break;
+
+        // Vx * 5 as Vx * 4 + Vx, the high byte gets the bits shifted out and the carry
+        case OP_LDCH:
+            low = vx + vx;
+            low = low + low + vx;
+            r->I[v] = SELECT(group, low, r->I[v]);
+            r->IHigh[v] = SELECT(group, SHIFT_RIGHT(vx, 6) - CARRY(low, vx), r->IHigh[v]);
+            break;
+
+        case OP_LDDT:
+            r->V[op->x][v] = SELECT(group, r->DT[v], vx);
+            break;
+
+        case OP_SETDT:
+            r->DT[v] = SELECT(group, vx, r->DT[v]);
+            break;
+
+        case OP_SETST:
+            r->ST[v] = SELECT(group, vx, r->ST[v]);
+            break;
+
+        case OP_JP:
+            next = zero + (byte) op->nnn;
+            nextHigh = zero + (byte) (op->nnn >> 8);
+            break;
+
+        case OP_SE:
+        case OP_SNE:
+        case OP_SER:
+        case OP_SNER:
+            skip = (Lanes) ((op->op == OP_SE || op->op == OP_SNE) ? vx == op->kk : vx == vy);
+
+            if (op->op == OP_SNE || op->op == OP_SNER)
+            {
+                skip = ~skip;
+            }
+
+            low = next + (skip & 2);
+            nextHigh -= CARRY(low, next);
+            next = low;
+            break;
+    }
+
+    r->PC[v] = SELECT(group, next, r->PC[v]);
+    r->PCHigh[v] = SELECT(group, nextHigh, r->PCHigh[v]);
+}
+
+// Runs one instruction on every lane of members with the reference interpreter
+static void stepLanes(Lockstep *lockstep, Registers *r, Selection *active, uint32_t members, int op)
+{
+    for (; members != 0; members &= members - 1)
+    {
+        int lane = __builtin_ctz(members);
+        Chip8 *chip = &lockstep->machines[lane];
+
+        storeLane(r, chip, lane);
+        CHIP_Step(chip);
+        loadLane(r, chip, lane);
+
+        if (chip->halted)
+        {
+            LANE(active->mask, lane) = 0;
+        }
+
+        lockstep->scalarLanes++;
+    }
+
+    // a lane wrote memory, code may no longer be the same in every lane
+    if (op == OP_BCD || op == OP_PUSHR || op == OP_SAVER)
+    {
+        memset(lockstep->codeState, 0, sizeof(lockstep->codeState));
+    }
+}
+
+// Runs cycles rounds, every active lane runs one instruction per round
+// lanes at the PC of the first lane not run yet in the round form a group that runs the instruction together
+// a halted lane would only run its halting instruction again, so it drops out until the next call
+static void runCycles(Lockstep *lockstep, Registers *r, Selection *active, long cycles)
+{
+    const Quirks *quirks = &QUIRKS_Profiles[lockstep->machines[0].quirks];
+    int model = lockstep->machines[0].model;
+
+    for (long cycle = 0; cycle < cycles && laneBits(active) != 0; cycle++)
+    {
+        Selection remaining = *active;
+        uint32_t bits;
+
+        while ((bits = laneBits(&remaining)) != 0)
+        {
+            int leader = __builtin_ctz(bits);
+            byte pcLow = LANE(r->PC, leader);
+            byte pcHigh = LANE(r->PCHigh, leader);
+            word pc = pcHigh << 8 | pcLow;
+            const Chip8 *chip = &lockstep->machines[leader];
+            word instruction = CHIP_ReadByte(chip, pc) << 8 | CHIP_ReadByte(chip, pc + 1);
+            Selection group;
+
+            for (int v = 0; v < VECTOR_COUNT; v++)
+            {
+                group.mask[v] = (r->PC[v] == pcLow) & (r->PCHigh[v] == pcHigh) & remaining.mask[v];
+            }
+
+            if (!pageShared(lockstep, pc / PAGE_SIZE) || !pageShared(lockstep, (word) (pc + 1) / PAGE_SIZE))
+            {
+                sameInstruction(lockstep, &group, pc, instruction);
+            }
+
+            for (int v = 0; v < VECTOR_COUNT; v++)
+            {
+                remaining.mask[v] &= ~group.mask[v];
+            }
+
+            CHIP_Op op = CHIP_Decode(instruction);
+
+            if (!isVector(op.op, model))
+            {
+                stepLanes(lockstep, r, active, laneBits(&group), op.op);
+                continue;
+            }
+
+            for (int v = 0; v < VECTOR_COUNT; v++)
+            {
+                if (vectorBits(group.mask[v]) != 0)
+                {
+                    execVector(quirks, r, &op, v, group.mask[v]);
+                    lockstep->vectorGroups++;
+                }
+            }
+
+            lockstep->vectorLanes += __builtin_popcount(laneBits(&group));
+        }
+    }
+}
+
+// Counts cycles on every machine, halted ones included, as CHIP_EmulateCycles does
+static void addCycles(Lockstep *lockstep, long cycles)
+{
+    for (int lane = 0; lane < lockstep->lanes; lane++)
+    {
+        lockstep->machines[lane].cycles += cycles;
+    }
+}
+
+void LOCKSTEP_Run(Lockstep *lockstep, long cycles)
+{
+    Registers r;
+    Selection active;
+
+    load(lockstep, &r, &active);
+
+    runCycles(lockstep, &r, &active, cycles);
+
+    store(lockstep, &r);
+    addCycles(lockstep, cycles);
+}
+
+void LOCKSTEP_RunFrames(Lockstep *lockstep, long frames, int instructionsPerFrame)
+{
+    Registers r;
+    Selection active;
+
+    load(lockstep, &r, &active);
+
+    for (long frame = 0; frame < frames; frame++)
+    {
+        runCycles(lockstep, &r, &active, instructionsPerFrame);
+
+        // CHIP_TickTimers on every lane, compares give -1 in lanes whose timer is running
+        for (int v = 0; v < VECTOR_COUNT; v++)
+        {
+            r.DT[v] += (Lanes) (r.DT[v] != 0);
+            r.sound[v] = (Lanes) (r.ST[v] != 0) & 1;
+            r.ST[v] += (Lanes) (r.ST[v] != 0);
+        }
+    }
+
+    store(lockstep, &r);
+    addCycles(lockstep, frames * instructionsPerFrame);
+}
+
+#else
+
+// Without vector extensions every machine runs on its own
+void LOCKSTEP_Run(Lockstep *lockstep, long cycles)
+{
+    for (int lane = 0; lane < lockstep->lanes; lane++)
+    {
+        CHIP_EmulateCycles(&lockstep->machines[lane], cycles);
+    }
+
+    lockstep->scalarLanes += (uint64_t) cycles * lockstep->lanes;
+}
+
+void LOCKSTEP_RunFrames(Lockstep *lockstep, long frames, int instructionsPerFrame)
+{
+    for (int lane = 0; lane < lockstep->lanes; lane++)
+    {
+        for (long frame = 0; frame < frames; frame++)
+        {
+            CHIP_RunFrame(&lockstep->machines[lane], instructionsPerFrame);
+        }
+    }
+
+    lockstep->scalarLanes += (uint64_t) frames * instructionsPerFrame * lockstep->lanes;
+}
+
+#endif
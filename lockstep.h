@@ -0,0 +1,40 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "chip8.h"
+
+// Lockstep engine
+// runs up to LOCKSTEP_LANES machines of one model and quirks profile together, one instruction per machine per round
+// V, I, PC, DT and ST of all machines are held in structure-of-arrays form, one vector lane per machine
+// machines whose PC and code agree run ALU, load, skip and jump instructions as one vector operation,
+// every other instruction runs on the reference interpreter lane by lane
+// results are identical to running every machine with CHIP_EmulateCycles
+
+// Most machines run by one Lockstep, 32 byte lanes fill one AVX2 register or two SSE registers
+#define LOCKSTEP_LANES  32
+
+typedef struct Lockstep
+{
+    Chip8 *machines;            // machine of every lane, owned by the caller
+    int lanes;                  // number of machines
+
+    byte codeState[PAGE_COUNT]; // 1 if every lane holds the same bytes in the page, 2 if not, 0 if not known yet
+
+    // Instruction counts since LOCKSTEP_Init
+    uint64_t vectorGroups;      // vector operations
+    uint64_t vectorLanes;       // lane instructions run by vector operations
+    uint64_t scalarLanes;       // lane instructions run by the reference interpreter
+} Lockstep;
+
+// Sets up lockstep to run lanes machines starting at machines
+// returns 0, or -1 if lanes is not in range 1 to LOCKSTEP_LANES or the machines differ in model or quirks profile
+int LOCKSTEP_Init(Lockstep *lockstep, Chip8 *machines, int lanes);
+
+// Runs cycles instructions on every machine
+// machines are read on entry and written back on return, so keys may be set between calls
+void LOCKSTEP_Run(Lockstep *lockstep, long cycles);
+
+// Runs frames frames of instructionsPerFrame instructions followed by one timer tick on every machine
+void LOCKSTEP_RunFrames(Lockstep *lockstep, long frames, int instructionsPerFrame);
+
+#endif
@@ -2,15 +2,78 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
 
 #include "chip8.h"
+#include "scheduler.h"
+#include "input.h"
+#include "channel.h"
+#include "audio.h"
+#include "rewind.h"
 
-// scale factor to scale window size
-#define SCALE   10
+// scale factor to scale window size, 64x32 displays are drawn with 2x2 texture pixels
+#define SCALE   5
+
+// instructions run per 60 Hz frame unless given as second argument
+#define INSTRUCTIONS_PER_FRAME  10
+
+// frames between display hashes when recording input (third argument)
+#define CHECKPOINT_FRAMES       60
+
+// samples the audio device asks for at once, and samples queued ahead of it
+// smaller values follow the sound timer more closely but underrun sooner under host load
+#define AUDIO_DEVICE_SAMPLES    512
+#define AUDIO_LATENCY           (AUDIO_DEVICE_SAMPLES + 2 * AUDIO_SAMPLE_RATE / SCHED_FRAME_RATE)
+
+// frames kept for rewinding with Backspace, frames between keyframes and arena bytes per frame
+#define REWIND_FRAMES           (30 * SCHED_FRAME_RATE)
+#define REWIND_INTERVAL         60
+#define REWIND_FRAME_BYTES      1024
+
+// Emulation thread state
+// chip is only touched by the emulation thread while it runs, input and frames go through the channels
+typedef struct Core
+{
+    Chip8 *chip;
+    Scheduler scheduler;
+    InputLog *log;          // session being recorded, NULL if not recording
+    Audio *audio;           // sound output, NULL without an audio device
+    Rewind *rewind;         // last frames of the machine, NULL if there is no memory for them
+    atomic_int rewinding;   // set while Backspace is held
+    int back;               // frames the machine was rewound from the newest frame
+    FrameChannel frames;
+    KeyChannel keys;
+    atomic_int running;
+    SDL_sem *wake;          // posted on key presses and on stop, an idle core waits on it
+    SDL_Thread *thread;
+} Core;
 
 // display
-void drawPixel(SDL_Renderer *renderer, int x, int y);
-void renderDisplay(SDL_Renderer *renderer);
+void renderDisplay(SDL_Renderer *renderer, SDL_Texture *texture, const Frame *frame);
+
+// audio
+void playAudio(void *data, Uint8 *stream, int length);
+
+void startCore(Core *core);
+void stopCore(Core *core);
+
+int modelFromName(const char *fname);
+
+Chip8 chip;
+Core core;
+
+// display converted to texture pixels (ARGB8888)
+Uint32 pixels[WIDTH * HEIGHT];
+
+// colors of pixels with no plane, plane 1, plane 2 and both planes set
+Uint32 palette[4] = { 0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555 };
+
+// display currently in the texture
+uint64_t shown[PLANE_COUNT][HEIGHT][ROW_WORDS];
+byte shownHires;
+int textureValid = 0;
 
 byte keymap[16] = {
     SDLK_x,
@@ -33,14 +96,27 @@ byte keymap[16] = {
 
 int main(int argc, char *argv[])
 {       
-    CHIP_Initalize();    
+    int instructionsPerFrame = argc > 2 ? atoi(argv[2]) : INSTRUCTIONS_PER_FRAME;
+    char *recordFile = argc > 3 ? argv[3] : NULL;
+    InputLog log;
+
+    CHIP_Initalize(&chip);
+    CHIP_SetModel(&chip, argc > 1 ? modelFromName(argv[1]) : CHIP_MODEL_CHIP8);
+    CHIP_Seed(&chip, (uint32_t) time(NULL));
 
-    if (argc > 1 && CHIP_LoadProgram(argv[1]) == -1)
+    int size = argc > 1 ? CHIP_LoadProgram(&chip, argv[1]) : 0;
+
+    if (size < 0)
     {
-        fprintf(stderr, "Unable to open file. %s", SDL_GetError());
+        fprintf(stderr, "%s: %s\n", argv[1], CHIP_LoadError(&chip, size));
         exit(-1);
     }
 
+    if (size > CHIP_ProgramSize(&chip))
+    {
+        fprintf(stderr, "%s: %s\n", argv[1], CHIP_LoadError(&chip, size));
+    }
+
     if (SDL_Init(SDL_INIT_EVENTS | SDL_INIT_VIDEO | SDL_INIT_AUDIO) == -1)
     {
         fprintf(stderr, "Initialization failed. %s", SDL_GetError());
@@ -51,105 +127,395 @@ int main(int argc, char *argv[])
 
     SDL_Window *window;
     SDL_Renderer *renderer;
+    SDL_Texture *texture;
     SDL_Event event;
 
     window = SDL_CreateWindow("CHIP8 Emulator : Drag and drop CHIP8 ROM", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH*SCALE, HEIGHT*SCALE, SDL_WINDOW_OPENGL);
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    // vsync only blocks this thread, the emulation thread is paced by the scheduler
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+    if (renderer == NULL)
+    {
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
 
+    // display sized texture, the renderer scales it to the window
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
 
 
-    for(;;)
-    {   
-        CHIP_EmulateCycle();
-        
-        if (SDL_PollEvent(&event))
+
+    int running = 1;
+    Audio audio;
+    SDL_AudioDeviceID device = 0;
+
+    core.chip = &chip;
+    core.log = NULL;
+    core.audio = NULL;
+    // the oldest frames are dropped a keyframe group at a time, a ring one group larger keeps at least REWIND_FRAMES
+    core.rewind = REWIND_Create(REWIND_FRAMES + REWIND_INTERVAL, REWIND_INTERVAL,
+        REWIND_RECORD_MAX + (REWIND_FRAMES + REWIND_INTERVAL) * REWIND_FRAME_BYTES);
+    core.wake = SDL_CreateSemaphore(0);
+
+    if (AUDIO_Init(&audio, AUDIO_SAMPLE_RATE, AUDIO_LATENCY) == 0)
+    {
+        SDL_AudioSpec spec = {0};
+
+        spec.freq = AUDIO_SAMPLE_RATE;
+        spec.format = AUDIO_S16SYS;
+        spec.channels = 1;
+        spec.samples = AUDIO_DEVICE_SAMPLES;
+        spec.callback = playAudio;
+        spec.userdata = &audio;
+
+        // the emulator runs without sound if there is no device
+        device = SDL_OpenAudioDevice(NULL, 0, &spec, NULL, 0);
+
+        if (device != 0)
+        {
+            core.audio = &audio;
+            SDL_PauseAudioDevice(device, 0);
+        }
+    }
+    SCHED_Init(&core.scheduler, instructionsPerFrame, SCHED_SPIN_SLEEP);
+
+    if (recordFile != NULL)
+    {
+        INPUT_Init(&log, &chip, (uint32_t) time(NULL), instructionsPerFrame, CHECKPOINT_FRAMES);
+        core.log = &log;
+    }
+
+    startCore(&core);
+
+    while (running)
+    {
+        // wake up at least every few ms to pick up new frames
+        if (SDL_WaitEventTimeout(&event, 2))
         {
-            if (event.type == SDL_QUIT)
-                break;
-            
-            if (event.type == SDL_KEYDOWN)
-            {   
-                if (event.key.keysym.sym == SDLK_ESCAPE)
-                    break;
+            do
+            {
+                if (event.type == SDL_QUIT)
+                    running = 0;
 
-                // Singnal Keyboard press
-                for (int i=0; i < 16; i++)
+                if (event.type == SDL_KEYDOWN)
                 {
-                    if (event.key.keysym.sym == keymap[i])
+                    if (event.key.keysym.sym == SDLK_ESCAPE)
+                        running = 0;
+
+                    if (event.key.keysym.sym == SDLK_BACKSPACE)
                     {
-                        Keyboard[i] = 1;
+                        atomic_store(&core.rewinding, 1);
+                        SDL_SemPost(core.wake);
+                    }
+
+                    // Singnal Keyboard press
+                    for (int i=0; i < 16; i++)
+                    {
+                        if (event.key.keysym.sym == keymap[i] && !event.key.repeat)
+                        {
+                            CHANNEL_PushKey(&core.keys, i, 1);
+                            SDL_SemPost(core.wake);
+                        }
                     }
                 }
-            }
 
-            // Reset released keys to 0
-            if (event.type == SDL_KEYUP)
-            {
-                for (int i=0; i < 16; i++)
+                // Reset released keys to 0
+                if (event.type == SDL_KEYUP)
                 {
-                    if (event.key.keysym.sym == keymap[i])
+                    if (event.key.keysym.sym == SDLK_BACKSPACE)
+                        atomic_store(&core.rewinding, 0);
+
+                    for (int i=0; i < 16; i++)
                     {
-                        Keyboard[i] = 0;
+                        if (event.key.keysym.sym == keymap[i])
+                        {
+                            CHANNEL_PushKey(&core.keys, i, 0);
+                        }
                     }
                 }
-            }
 
-            if (event.type == SDL_DROPFILE)
-            {   
-                CHIP_Initalize();
-                CHIP_LoadProgram(event.drop.file);
+                if (event.type == SDL_DROPFILE)
+                {
+                    stopCore(&core);
+
+                    // recording covers the ROM given on the command line only
+                    if (recordFile != NULL)
+                    {
+                        INPUT_Save(&log, recordFile);
+                        INPUT_Free(&log);
+                        recordFile = NULL;
+                        core.log = NULL;
+                    }
+
+                    CHIP_Initalize(&chip);
+                    CHIP_SetModel(&chip, modelFromName(event.drop.file));
+                    CHIP_Seed(&chip, (uint32_t) time(NULL));
+                    size = CHIP_LoadProgram(&chip, event.drop.file);
+
+                    if (size < 0 || size > CHIP_ProgramSize(&chip))
+                    {
+                        fprintf(stderr, "%s: %s\n", event.drop.file, CHIP_LoadError(&chip, size));
+                    }
+
+                    SDL_free(event.drop.file);
+
+                    startCore(&core);
+                }
             }
+            while (SDL_PollEvent(&event));
         }
-        else
-        {               
-            if (drawFlag)
-            {   
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-                SDL_RenderClear(renderer);
 
-                SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-                renderDisplay(renderer);                
+        // unchanged frames keep the last presented image
+        const Frame *frame = CHANNEL_AcquireFrame(&core.frames);
 
-                SDL_RenderPresent(renderer);
+        if (frame != NULL)
+        {
+            renderDisplay(renderer, texture, frame);
+        }
+    }
 
-                drawFlag = 0;
-            }                
+    stopCore(&core);
 
-            
-            SDL_UpdateWindowSurface(window);
-            
-            
-        }
+    if (device != 0)
+    {
+        SDL_CloseAudioDevice(device);
+    }
+
+    AUDIO_Free(&audio);
+
+    if (recordFile != NULL && INPUT_Save(&log, recordFile) == -1)
+    {
+        fprintf(stderr, "Unable to write input log %s\n", recordFile);
     }
 
+    REWIND_Free(core.rewind);
+    SDL_DestroySemaphore(core.wake);
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
     SDL_Quit();
+
+    CHIP_Free(&chip);
     
     return 0;
 }
 
-void drawPixel(SDL_Renderer *renderer, int x, int y)
-{       
-    for (int h=0; h < SCALE; h++)
+// Emulation thread - drains key events, runs 60 Hz frames and publishes the ones that changed the display
+int runCore(void *data)
+{
+    Core *core = data;
+    Chip8 *chip = core->chip;
+    ChannelKey key;
+
+    while (atomic_load_explicit(&core->running, memory_order_relaxed))
+    {
+        // wake-ups of keys that are read below are dropped, a key pushed after this still wakes the wait
+        while (SDL_SemTryWait(core->wake) == 0)
+            ;
+
+        while (CHANNEL_PopKey(&core->keys, &key))
+        {
+            CHIP_SetKey(chip, key.key, key.pressed);
+        }
+
+        // rewinding steps one frame back per frame, a recorded session only runs forward
+        if (atomic_load_explicit(&core->rewinding, memory_order_relaxed) && core->rewind != NULL && core->log == NULL)
+        {
+            if (core->back + 1 < REWIND_Frames(core->rewind))
+            {
+                REWIND_Seek(core->rewind, chip, ++core->back);
+                CHANNEL_PublishFrame(&core->frames, chip, core->scheduler.frames);
+                chip->dirtyRows = 0;
+                chip->drawFlag = 0;
+            }
+
+            SCHED_WaitFrame(&core->scheduler);
+            continue;
+        }
+
+        // a machine waiting for a key with stopped timers would run empty frames, so the thread sleeps instead
+        if (SCHED_Idle(chip))
+        {
+            SDL_SemWait(core->wake);
+            continue;
+        }
+
+        if (core->log != NULL)
+        {
+            INPUT_RecordFrame(core->log, chip);
+        }
+
+        SCHED_RunFrame(&core->scheduler, chip);
+
+        if (core->log != NULL)
+        {
+            INPUT_EndFrame(core->log, chip);
+        }
+
+        // frames after a rewind are dropped by the push
+        if (core->rewind != NULL)
+        {
+            REWIND_Push(core->rewind, chip);
+            core->back = 0;
+        }
+
+        if (core->audio != NULL)
+        {
+            AUDIO_Frame(core->audio, chip);
+        }
+
+        if (chip->dirtyRows)
+        {
+            CHANNEL_PublishFrame(&core->frames, chip, core->scheduler.frames);
+            chip->dirtyRows = 0;
+            chip->drawFlag = 0;
+        }
+
+        // sleep until the next 60 Hz frame is due
+        SCHED_WaitFrame(&core->scheduler);
+    }
+
+    return 0;
+}
+
+// Audio device callback, runs on the SDL audio thread
+void playAudio(void *data, Uint8 *stream, int length)
+{
+    AUDIO_Read(data, (int16_t *) stream, length / sizeof(int16_t));
+}
+
+// Starts the emulation thread on a freshly loaded or reset machine
+void startCore(Core *core)
+{
+    CHANNEL_InitFrames(&core->frames);
+    CHANNEL_InitKeys(&core->keys);
+    SCHED_Init(&core->scheduler, core->scheduler.instructionsPerFrame, core->scheduler.mode);
+
+    // frames of an earlier program can not be rewound to
+    if (core->rewind != NULL)
+    {
+        REWIND_Reset(core->rewind);
+        core->back = 0;
+    }
+
+    // first frame of the machine is uploaded in full
+    core->chip->dirtyRows = ~0ULL;
+    textureValid = 0;
+
+    atomic_store(&core->running, 1);
+    core->thread = SDL_CreateThread(runCore, "chip8-core", core);
+
+    if (core->thread == NULL)
+    {
+        fprintf(stderr, "Unable to start emulation thread. %s", SDL_GetError());
+        exit(-1);
+    }
+}
+
+// Stops the emulation thread, the machine may be modified afterwards
+void stopCore(Core *core)
+{
+    if (core->thread == NULL)
     {
-        for (int w=0; w < SCALE; w++)
+        return;
+    }
+
+    atomic_store(&core->running, 0);
+    SDL_SemPost(core->wake);
+    SDL_WaitThread(core->thread, NULL);
+    core->thread = NULL;
+}
+
+// Returns model of a ROM from its extension - .sc8 for SUPER-CHIP, .xo8 for XO-CHIP, CHIP-8 otherwise
+int modelFromName(const char *fname)
+{
+    const char *extension = strrchr(fname, '.');
+
+    if (extension != NULL && strcmp(extension, ".sc8") == 0)
+        return CHIP_MODEL_SCHIP;
+
+    if (extension != NULL && strcmp(extension, ".xo8") == 0)
+        return CHIP_MODEL_XOCHIP;
+
+    return CHIP_MODEL_CHIP8;
+}
+
+// Returns 1 if row of the display differs from the row in the texture
+static int rowChanged(const Frame *frame, int row)
+{
+    for (int plane = 0; plane < PLANE_COUNT; plane++)
+    {
+        for (int w = 0; w < ROW_WORDS; w++)
         {
-            SDL_RenderDrawPoint(renderer,(x * SCALE) + w, (y * SCALE) + h);
+            if (frame->Display[plane][row][w] != shown[plane][row][w])
+            {
+                return 1;
+            }
         }
     }
-    
+
+    return 0;
 }
 
-void renderDisplay(SDL_Renderer *renderer)
+// Uploads rows that differ from the displayed frame and presents it
+// frames may be skipped when presenting is slow, so rows are compared instead of using dirtyRows
+// the texture is always 128x64, a 64x32 display row fills two texture rows with pixels doubled
+void renderDisplay(SDL_Renderer *renderer, SDL_Texture *texture, const Frame *frame)
 {
-    for (int h = 0; h < HEIGHT; h++)
+    int first = -1, last = -1;
+    int scale = frame->hires ? 1 : 2;
+
+    if (frame->hires != shownHires)
+    {
+        textureValid = 0;
+    }
+
+    for (int h = 0; h < HEIGHT / scale; h++)
     {
+        if (textureValid && !rowChanged(frame, h))
+        {
+            continue;
+        }
+
+        if (first < 0)
+        {
+            first = h * scale;
+        }
+        last = h * scale + scale - 1;
+
         for (int w = 0; w < WIDTH; w++)
         {
-            if (Display[h * WIDTH + w] == 1)
+            int x = w / scale;
+            int color = 0;
+
+            for (int plane = 0; plane < PLANE_COUNT; plane++)
+            {
+                color |= (frame->Display[plane][h][x / 64] >> (63 - x % 64) & 1) << plane;
+            }
+
+            for (int i = 0; i < scale; i++)
             {
-                drawPixel(renderer, w, h);
+                pixels[(h * scale + i) * WIDTH + w] = palette[color];
             }
         }
+
+        for (int plane = 0; plane < PLANE_COUNT; plane++)
+        {
+            memcpy(shown[plane][h], frame->Display[plane][h], sizeof(shown[plane][h]));
+        }
     }
-}
 
+    textureValid = 1;
+    shownHires = frame->hires;
+
+    if (first < 0)
+    {
+        return;
+    }
+
+    // one upload covering the span of changed rows
+    SDL_Rect span = { 0, first, WIDTH, last - first + 1 };
+    SDL_UpdateTexture(texture, &span, &pixels[first * WIDTH], WIDTH * sizeof(Uint32));
+
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
@@ -0,0 +1,119 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mapfile.h"
+
+#if !defined(_WIN32)
+
+int MAP_Open(MappedFile *file, const char *fname)
+{
+    struct stat info;
+    int fd = open(fname, O_RDONLY);
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return -2;
+    }
+
+    // mmap rejects empty mappings, an empty file is simply empty
+    if (info.st_size > 0)
+    {
+        void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return -2;
+        }
+
+        file->data = data;
+        file->size = info.st_size;
+        file->mapped = 1;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    return 0;
+}
+
+#else
+
+int MAP_Open(MappedFile *file, const char *fname)
+{
+    FILE *fp = fopen(fname, "rb");
+    long size;
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    if (fseek(fp, 0L, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0L, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return -2;
+    }
+
+    if (size > 0)
+    {
+        unsigned char *data = malloc(size);
+
+        if (data == NULL || fread(data, 1, size, fp) != (size_t) size)
+        {
+            free(data);
+            fclose(fp);
+            return -2;
+        }
+
+        file->data = data;
+        file->size = size;
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+#endif
+
+void MAP_Close(MappedFile *file)
+{
+#if !defined(_WIN32)
+    if (file->mapped)
+    {
+        munmap((void *) file->data, file->size);
+    }
+#else
+    free((void *) file->data);
+#endif
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+}
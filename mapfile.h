@@ -0,0 +1,20 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+
+// Read-only view of a whole file
+// mapped with mmap where available, elsewhere read into one buffer with a single fread
+typedef struct MappedFile
+{
+    const unsigned char *data;  // NULL for an empty file
+    size_t size;
+    int mapped;                 // data is a mapping rather than a heap buffer
+} MappedFile;
+
+// Opens fname, returns 0 on success, -1 if it cannot be opened or -2 if it cannot be mapped or read
+int MAP_Open(MappedFile *file, const char *fname);
+
+void MAP_Close(MappedFile *file);
+
+#endif
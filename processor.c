@@ -1,18 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
 
 #include "chip8.h"
+#include "block.h"
+#include "mapfile.h"
+#include "quirks.h"
 
-// Registers
-byte V[16];         // general purpose registers V[0] to V[14] (8-bits)
-                    // flag-register V[15] (8-bits)
-byte DT, ST;        // delay timer register, sound timer register (8-bits)
-byte SP;            // stack pointer register (8-bits) - not accessible for programs running on the emulator
-word PC;            // program counter register (16-bits) - not accessible for programs running on the emulator
-word I;             // index-register (16-bits)
-
-byte RAM[RAM_SIZE];
-word Stack[STACK_SIZE];
+#ifdef CHIP_PROFILE
+#include "profile.h"
+#endif
 
 byte CHIP_Fontset[80] =
 {
@@ -34,472 +33,1591 @@ byte CHIP_Fontset[80] =
     0xF0, 0x80, 0xF0, 0x80, 0x80  //F
 };
 
+// 8x10 digits of LDHF, SUPER-CHIP has 0 to 9, XO-CHIP adds A to F
+byte CHIP_BigFontset[160] =
+{
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, //0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, //1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, //4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, //6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, //7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, //8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, //A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, //B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, //C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, //D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  //F
+};
+
+
+// Pages shared by every machine, never freed
+// memory that was never written points to zeroPage, page 0 starts as fontPage
+static CHIP_Page zeroPage;
+static CHIP_Page fontPage;
+
+static int isStaticPage(CHIP_Page *page)
+{
+    return page == &zeroPage || page == &fontPage;
+}
 
-// Sets all pixels of Display to BLACK
-void clearScreen()
+static void retainPage(CHIP_Page *page)
 {
-    for (int i=0; i < WIDTH*HEIGHT; i++)
+    if (!isStaticPage(page))
     {
-        Display[i] = 0;
-    } 
+        atomic_fetch_add_explicit(&page->refs, 1, memory_order_relaxed);
+    }
 }
 
-// pushes address to CHIP8 Stack
-// @param address - address to store in stack usually value of PC of caller routine
-void push(word address)
+// Drops one reference to page and frees it if it was the last one
+static void releasePage(CHIP_Page *page)
 {
-    if (SP < STACK_SIZE)
-    {           
-        Stack[SP] = address;
-        SP++;
+    if (page != NULL && !isStaticPage(page) && atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1)
+    {
+        free(page);
     }
 }
 
-// pops and returns address from CHIP8 Stack
-// returns -1 if Stack is empty
-word pop()
-{   
-    word address;
-    if (SP > 0)
+// Returns page index of RAM ready to be written, NULL if a shared page could not be copied
+// a page shared with other machines is copied first
+static CHIP_Page *writablePage(Chip8 *chip, int index)
+{
+    CHIP_Page *page = chip->pages[index];
+
+    if (!isStaticPage(page) && atomic_load_explicit(&page->refs, memory_order_acquire) == 1)
     {
-        address = Stack[SP - 1];
-        SP--;
+        return page;
     }
 
-    return address;
+    CHIP_Page *copy = malloc(sizeof(CHIP_Page));
+
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    atomic_init(&copy->refs, 1);
+    memcpy(copy->data, page->data, PAGE_SIZE);
+
+    releasePage(page);
+    chip->pages[index] = copy;
+
+    return copy;
 }
 
-// Fetches 2-byte instruction from RAM at memory address pointed by PC and PC + 1 (PC = program counter)
-// Increments PC by 2
-// used internally
-word fetchInstruction()
+static void fault(Chip8 *chip, int code);
+static void haltWithFault(Chip8 *chip, int code);
+
+// Writes value to RAM at address, addresses wrap around RAM_SIZE
+// faults the machine if a shared page could not be copied
+// CHIP_MemoryWritten must be called once the instruction is done writing
+void CHIP_WriteByte(Chip8 *chip, int address, byte value)
 {
-    word instruction;
-    
-    instruction = RAM[PC] << 8;
-    instruction = instruction | RAM[PC + 1];
-    
-    PC += 2;
+    address &= RAM_SIZE - 1;
 
-    return instruction;
-}
+    CHIP_Page *page = writablePage(chip, address / PAGE_SIZE);
 
-// Executes instruction
-// @param instruction - 2 byte long instruction to parse and execute
-void executeInstruction(word instruction)
-{   
-    
-    if (instruction == CLS)
-    {                   
-        clearScreen();
+    if (page == NULL)
+    {
+        fault(chip, CHIP_FAULT_OUT_OF_MEMORY);
+        return;
     }
-    else if (instruction == RET)
-    {   
-        word address;
-        address = pop();
-        PC = (address != -1) ? address : PC;
-    }    
-    else if (instruction == NOP)
+
+    page->data[address % PAGE_SIZE] = value;
+}
+
+// Copies size bytes from data to RAM starting at address, every page written is looked up once
+// returns 0, or -1 if a shared page could not be copied, the bytes before it are written then
+// CHIP_MemoryWritten must be called once the instruction is done writing
+int CHIP_StoreMemory(Chip8 *chip, int address, const byte *data, int size)
+{
+    for (int i = 0; i < size; )
     {
+        int target = (address + i) & (RAM_SIZE - 1);
+        int offset = target % PAGE_SIZE;
+        int count = (PAGE_SIZE - offset < size - i) ? PAGE_SIZE - offset : size - i;
+        CHIP_Page *page = writablePage(chip, target / PAGE_SIZE);
+
+        if (page == NULL)
+        {
+            return -1;
+        }
+
+        // byte copies, the registers stored were mostly written byte by byte just before
+        for (int end = i + count; i < end; i++, offset++)
+        {
+            page->data[offset] = data[i];
+        }
+    }
 
+    return 0;
+}
+
+// Copies size bytes of RAM starting at address to data
+void CHIP_ReadMemory(const Chip8 *chip, int address, byte *data, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        data[i] = CHIP_ReadByte(chip, address + i);
     }
-    else 
+}
+
+// Copies size bytes from data to RAM starting at address
+// page sized chunks that already hold the same bytes are skipped, so they stay shared
+// faults the machine with PC unchanged if a shared page could not be copied
+void CHIP_WriteMemory(Chip8 *chip, int address, const byte *data, int size)
+{
+    for (int i = 0; i < size; )
     {
-        // the following code uses flags to extract different nibbles from instructions
-        // example. 0xF000 - flag to extract most significant nibble
-        
-        word data;
-        byte x, y;        
+        int target = (address + i) & (RAM_SIZE - 1);
+        int offset = target % PAGE_SIZE;
+        int count = (PAGE_SIZE - offset < size - i) ? PAGE_SIZE - offset : size - i;
 
-        switch (instruction & 0xF000)
+        if (memcmp(chip->pages[target / PAGE_SIZE]->data + offset, data + i, count) != 0)
         {
-            // Get address and set PC to address
-            // on the next fetchInstruction() call program continues from address(PC)
-            case JP:
-                PC = instruction & 0x0FFF;
-                break;
-            
-            // Store PC to Stack and Jump to called routine address
-            case CALL:                
-                push(PC);            
-                PC = instruction & 0x0FFF;
-                break;
-            
-            case SE:      
-                x = (instruction & 0x0F00) >> 8;                    
-                data = instruction & 0x00FF;
-                if (V[x] == data)
-                    PC += 2;                
-                break;         
-            
-            case SNE:
-                x = (instruction & 0x0F00) >> 8;                        
-                data = instruction & 0x00FF;
-                if (V[x] != data)
-                    PC += 2;                
-                break;
-            
-            case SER:  
-                x = (instruction & 0x0F00) >> 8;
-                y = (instruction & 0x00F0) >> 4;                
-                if (V[x] == V[y])
-                    PC += 2;                
-                break;
+            CHIP_Page *page = writablePage(chip, target / PAGE_SIZE);
 
-            case LD:
-                x = (instruction & 0x0F00) >> 8;
-                data = instruction & 0xFF;
-                V[x] = data;
+            if (page == NULL)
+            {
+                haltWithFault(chip, CHIP_FAULT_OUT_OF_MEMORY);
                 break;
+            }
 
-            case ADD:                
-                x = (instruction & 0x0F00) >> 8;
-                data = instruction & 0x00FF;
-                V[x] += data;
-                break;
-            
-            case LDR:
-                x = (instruction & 0x0F00) >> 8;
-                y = (instruction & 0x00F0) >> 4;
+            memcpy(page->data + offset, data + i, count);
+        }
 
-                switch (instruction & 0xF00F)
-                {
-                    case LDR:                        
-                        V[x] = V[y];
-                        break;
-
-                    case OR:
-                        V[x] |= V[y];
-                        break;
-
-                    case AND:
-                        V[x] &= V[y];
-                        break;
-
-                    case XOR:
-                        V[x] ^= V[y];
-                        break;
-
-                    case ADDR:
-                    {   
-                        int sum = (int) V[x] + (int) V[y];
-
-                        if (sum > 0xFF)
-                        {
-                            V[15] = 1;
-                        }
-                        else
-                        {
-                            V[15] = 0;
-                        }
-
-                        V[x] += V[y];
-                        break;
-                    }
-
-                    case SUB:
-                        V[15] = V[x] > V[y] ? 1 : 0;
-                        V[x] = V[x] - V[y];                        
-                        break;
-
-                    case SHR:
-                        V[15] = V[x] & 0x1;
-                        V[x] = V[x] >> 1;
-                        break;
-                    
-                    case SUBN:
-                        V[15] = V[y] > V[x] ? 1 : 0;
-                        V[x] = V[y] - V[x];                        
-                        break;
-                    
-                    case SHL:
-                        V[15] = V[x] >> 7;
-                        V[x] = V[x] << 1;
-                        break;
-                    
-                    default:
-                        printf("Unknown instruction: %x\n", instruction);
-                        break;
-                }
-            
-            case SNER:
-                x = (instruction & 0x0F00) >> 8;
-                y = (instruction & 0x00F0) >> 4;                
-                if (V[x] != V[y])
-                    PC += 2;                                
-                break;
-            
-            case LDI:                 
-                data = instruction & 0x0FFF;
-                I = data;
-                break; 
-            
-            case RND:
-                x = (instruction & 0x0F00) >> 8;
-                data = instruction & 0x00FF;
-
-                V[x] = ((byte) rand()) & data;
-                break;
+        i += count;
+    }
 
+    CHIP_MemoryWritten(chip, address, size);
+}
 
-            // Draw sprite starting at coord (V[x], V[y])
-            case DRW:                
-                x = (instruction & 0x0F00) >> 8;
-                y = (instruction & 0x00F0) >> 4;
-                
-                byte n = (instruction & 0x000F);
-
-                byte row;
-
-                V[15] = 0;  // set collision flag to 0
-                
-                drawFlag = 1;
-
-                for (int iy = 0; iy < n; iy++)
-                {   
-                    // row contains 8 bits each bits represent a pixel
-                    row = RAM[I + iy];          
-
-                    for (int ix = 0; ix < 8; ix++)
-                    {                            
-                        // loop through row bits and copy to display 
-                        // row & (0x80 >> i) expands to row & 0b1000 0000 , row & 0b0100 0000, row & 0b0010 0000, row & 0b0001 0000, row & 0b0000 1000, row & 0b0000 0100, row & 0b0000 0010, row & 0b0000 0001
-                        if (row & (0x80 >> ix))
-                        {                               
-                            // collision detected                            
-                            if ( Display[ (V[x] + ix + (V[y] + iy) * WIDTH) ])
-                            {                                                                                       
-                                V[15] = 1;                                
-                            }
-                            
-                            // no collision
-                            Display[ (V[x] + ix + (V[y] + iy) * WIDTH) ] ^= 1;
-                            
-                                                        
-                        }    
-                    }
-                }
+// Sets all pixels of every plane of Display to BLACK
+void clearScreen(Chip8 *chip)
+{
+    memset(chip->Display, 0, sizeof(chip->Display));
 
-                break; 
-
-            case ECMDS:
-                x = (instruction & 0x0F00) >> 8;
-
-                switch (instruction & 0xF0FF)
-                {   
-                    // no waiting just check if key in V[x] is currently pressed and IF SO skip next instruction
-                    case SKP:                        
-                        if (Keyboard[ V[x] ])
-                        {
-                            PC += 2;
-                        }
-                        break;
-                    
-                    // no waiting just check if key in V[x] is currently pressed and if it is NOT skip next instruction
-                    case SKPN:
-                        if ( ! Keyboard[ V[x] ])
-                        {
-                            PC += 2;
-                        }
-                        break;
-                    
-                    default:
-                        printf("Unknown instruction: %x\n", instruction);
-                        break;
-                }
-                break;
+    chip->dirtyRows = ~0ULL;
+}
 
-            case FCMDS:
-
-                x = (instruction & 0x0F00) >> 8;
-
-                switch (instruction & 0xF0FF)
-                {   
-                    case LDDT:
-                        V[x] = DT;
-                        break;
-
-                    // Wait for key press
-                    case LDK:
-                    {
-                        byte keypressed = 0;
-
-                        for (int i=0; i<16; i++)
-                        {   
-                            if (Keyboard[i] != 0)
-                            {
-                                V[x] = i;
-                                keypressed = 1;
-                            }
-                        }
-
-                        // Keep PC unchanged untill key is pressed
-                        if (!keypressed)
-                        {
-                            //PC -= 2;                            
-                        }
-                        break;
-                    }
-
-                    case SETDT:
-                        DT = V[x];
-                        break;
-
-                    case SETST:
-                        ST = V[x];
-                        break;
-                    
-                    case ADDI:
-                        I += V[x];
-                        break;
-
-                    case LDCH:
-                        // V[x] - is char in range 0 to 15                        
-                        I = V[x] * 5;
-                        break;
-
-                    case BCD:                        
-                        RAM[I] = V[x] / 100;
-                        RAM[I + 1] = (V[x] % 100) / 10;
-                        RAM[I + 2] = V[x] % 10;
-                        break;
-
-                    case PUSHR:                                                
-                        for (int i = 0; i <= x; i++)
-                        {
-                            RAM[I + i] = V[i];
-                        }
-                        break;
-
-                    case POPR:
-                        for (int i = 0; i <= x; i++)
-                        {
-                            V[i] = RAM[I + i];
-                        }
-                        break;
-
-                    default:
-                        printf("Unknown instruction: %x\n", instruction);
-                        break;
+// Sets pixels of the selected planes to BLACK, only the words used by the current display mode are touched
+static void clearPlanes(Chip8 *chip)
+{
+    int height = CHIP_Height(chip);
+    int words = CHIP_Width(chip) / 64;
 
-                }
-                break;
-                
+    for (int plane = 0; plane < PLANE_COUNT; plane++)
+    {
+        if (!(chip->planes >> plane & 1))
+        {
+            continue;
+        }
 
-            default:
-                printf("Unknown instruction: %x\n", instruction);
-                break;
+        for (int row = 0; row < height; row++)
+        {
+            for (int i = 0; i < words; i++)
+            {
+                chip->Display[plane][row][i] = 0;
+            }
+        }
+    }
+
+    chip->dirtyRows = ~0ULL;
+}
+
+// Scrolls the selected planes by rows rows, down if rows is positive and up if it is negative
+// whole rows are moved, rows scrolled in are BLACK
+static void scrollVertical(Chip8 *chip, int rows)
+{
+    int height = CHIP_Height(chip);
+    int words = CHIP_Width(chip) / 64;
 
+    for (int plane = 0; plane < PLANE_COUNT; plane++)
+    {
+        if (!(chip->planes >> plane & 1))
+        {
+            continue;
+        }
+
+        for (int i = 0; i < height; i++)
+        {
+            // down walks from the bottom up so every source row is read before it is overwritten
+            int row = rows > 0 ? height - 1 - i : i;
+            int source = row - rows;
+
+            for (int w = 0; w < words; w++)
+            {
+                chip->Display[plane][row][w] = (source >= 0 && source < height) ? chip->Display[plane][source][w] : 0;
+            }
         }
     }
+
+    chip->drawFlag = 1;
+    chip->dirtyRows = ~0ULL;
 }
 
-// Should be called when chip8 is booted 
-// Resets memory, display, registers and stack to 0 
-// Sets PC to LOAD_ADDRESS
-void CHIP_Initalize()
-{   
-    // reset memory
-    for (int i=0; i < RAM_SIZE; i++)
+// Scrolls the selected planes 4 pixels right if right is set, else left
+// every row is shifted a word at a time, bits crossing the word boundary are carried between the two words
+static void scrollHorizontal(Chip8 *chip, int right)
+{
+    int height = CHIP_Height(chip);
+
+    for (int plane = 0; plane < PLANE_COUNT; plane++)
     {
-        RAM[i] = 0;
+        if (!(chip->planes >> plane & 1))
+        {
+            continue;
+        }
+
+        for (int row = 0; row < height; row++)
+        {
+            uint64_t *line = chip->Display[plane][row];
+
+            if (!chip->hires)
+            {
+                line[0] = right ? line[0] >> 4 : line[0] << 4;
+            }
+            else if (right)
+            {
+                line[1] = line[1] >> 4 | line[0] << 60;
+                line[0] >>= 4;
+            }
+            else
+            {
+                line[0] = line[0] << 4 | line[1] >> 60;
+                line[1] <<= 4;
+            }
+        }
     }
 
-    // reset stack
-    for (int i=0; i < STACK_SIZE; i++)
+    chip->drawFlag = 1;
+    chip->dirtyRows = ~0ULL;
+}
+
+// Halts the machine with fault code on the instruction at PC
+static void haltWithFault(Chip8 *chip, int code)
+{
+    // the rest of a batch runs the faulted instruction again, only the first run is counted
+    if (chip->halted != CHIP_HALT_FAULT)
+    {
+        CHIP_Diagnostic *diagnostic = &chip->diagnostics[code];
+
+        if (diagnostic->count++ == 0)
+        {
+            diagnostic->address = chip->PC;
+            diagnostic->instruction = CHIP_ReadByte(chip, chip->PC) << 8 | CHIP_ReadByte(chip, chip->PC + 1);
+        }
+    }
+
+    chip->halted = CHIP_HALT_FAULT;
+    chip->fault = code;
+}
+
+// Halts the machine with fault, called by a handler after PC moved past the faulting instruction
+// PC is moved back, so the instruction faults again if the machine is resumed
+static void fault(Chip8 *chip, int code)
+{
+    chip->PC -= 2;
+    haltWithFault(chip, code);
+}
+
+// Returns 1 if size bytes starting at I lie in the memory of the model, else faults the machine
+// one compare per instruction, the bytes themselves are masked by CHIP_ReadByte and CHIP_StoreMemory
+static inline int checkMemory(Chip8 *chip, int size)
+{
+    if (chip->I + size > chip->memorySize)
     {
-        Stack[i] = 0;
+        fault(chip, CHIP_FAULT_MEMORY);
+        return 0;
     }
 
-    // reset registers
-    for (int i=0; i < 16; i++)
+    return 1;
+}
+
+// pushes address to CHIP8 Stack
+// @param address - address to store in stack usually value of PC of caller routine
+// returns 0 and faults the machine if Stack is full
+int push(Chip8 *chip, word address)
+{
+    if (chip->SP >= STACK_SIZE)
     {
-        V[i] = 0;
+        fault(chip, CHIP_FAULT_STACK_OVERFLOW);
+        return 0;
     }
 
-    DT = ST = SP = I = 0;
-    PC = LOAD_ADDRESS;
+    chip->Stack[chip->SP] = address;
+    chip->SP++;
 
-    clearScreen();
+    return 1;
+}
 
-    // load fontset to memory
-    for (int i=0; i < 80; i++)
+// pops and returns address from CHIP8 Stack
+// faults the machine and returns the address of the RET instruction if Stack is empty or SP is out of range
+word pop(Chip8 *chip)
+{
+    if (chip->SP == 0 || chip->SP > STACK_SIZE)
     {
-        RAM[i] = CHIP_Fontset[i];
+        fault(chip, CHIP_FAULT_STACK_UNDERFLOW);
+        return chip->PC;
     }
+
+    chip->SP--;
+
+    return chip->Stack[chip->SP];
 }
 
-// Loads program to CHIP8 RAM from file
-int CHIP_LoadProgram(char *fname)
+// Skips the next instruction
+// XO-CHIP skips both words of F000 nnnn
+static inline void skipNext(Chip8 *chip)
+{
+    if (chip->model == CHIP_MODEL_XOCHIP && CHIP_ReadByte(chip, chip->PC) == 0xF0 && CHIP_ReadByte(chip, chip->PC + 1) == 0x00)
+    {
+        chip->PC += 2;
+    }
+
+    chip->PC += 2;
+}
+
+// Fetches 2-byte instruction from RAM at memory address pointed by PC and PC + 1 (PC = program counter)
+// Increments PC by 2
+// used internally
+word fetchInstruction(Chip8 *chip)
+{
+    word instruction;
+    
+    instruction = CHIP_ReadByte(chip, chip->PC) << 8;
+    instruction = instruction | CHIP_ReadByte(chip, chip->PC + 1);
+    
+    chip->PC += 2;
+
+    return instruction;
+}
+
+// Instruction handlers
+// every handler executes one decoded instruction, PC already points to the next instruction
+
+typedef void (*Handler)(Chip8 *chip, const CHIP_Op *op);
+
+static inline void execUnknown(Chip8 *chip, const CHIP_Op *op)
+{
+    fault(chip, CHIP_FAULT_ILLEGAL_OPCODE);
+}
+
+static inline void execNOP(Chip8 *chip, const CHIP_Op *op)
+{
+
+}
+
+static inline void execCLS(Chip8 *chip, const CHIP_Op *op)
+{
+    clearPlanes(chip);
+}
+
+static inline void execRET(Chip8 *chip, const CHIP_Op *op)
 {
-    FILE *fp;
-    int size;
+    chip->PC = pop(chip);
+}
 
-    fp = fopen(fname, "rb");
+// Get address and set PC to address
+// on the next fetchInstruction() call program continues from address(PC)
+static inline void execJP(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->PC = op->nnn;
+}
 
-    if (fp == NULL)
-    {                   
-        return -1;
+// Store PC to Stack and Jump to called routine address
+static inline void execCALL(Chip8 *chip, const CHIP_Op *op)
+{
+    if (push(chip, chip->PC))
+    {
+        chip->PC = op->nnn;
     }
+}
+
+static inline void execSE(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->V[op->x] == op->kk)
+        skipNext(chip);
+}
 
-    fseek(fp, 0L, SEEK_END);
-    size = (ftell(fp) < RAM_SIZE - LOAD_ADDRESS) ? ftell(fp) : RAM_SIZE - LOAD_ADDRESS;
-    fseek(fp, 0L, SEEK_SET);
+static inline void execSNE(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->V[op->x] != op->kk)
+        skipNext(chip);
+}
 
-    for (int i = 0; i < size; i++)
-    {           
-        RAM[PC + i] = getc(fp);
+static inline void execSER(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->V[op->x] == chip->V[op->y])
+        skipNext(chip);
+}
+
+static inline void execLD(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->V[op->x] = op->kk;
+}
+
+static inline void execADD(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->V[op->x] += op->kk;
+}
+
+static inline void execLDR(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->V[op->x] = chip->V[op->y];
+}
+
+static inline void execADDR(Chip8 *chip, const CHIP_Op *op)
+{
+    int sum = (int) chip->V[op->x] + (int) chip->V[op->y];
+
+    chip->V[op->x] = sum;
+    chip->V[15] = sum > 0xFF ? 1 : 0;
+}
+
+static inline void execSUB(Chip8 *chip, const CHIP_Op *op)
+{
+    byte flag = chip->V[op->x] > chip->V[op->y] ? 1 : 0;
+
+    chip->V[op->x] = chip->V[op->x] - chip->V[op->y];
+    chip->V[15] = flag;
+}
+
+static inline void execSUBN(Chip8 *chip, const CHIP_Op *op)
+{
+    byte flag = chip->V[op->y] > chip->V[op->x] ? 1 : 0;
+
+    chip->V[op->x] = chip->V[op->y] - chip->V[op->x];
+    chip->V[15] = flag;
+}
+
+static inline void execSNER(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->V[op->x] != chip->V[op->y])
+        skipNext(chip);
+}
+
+static inline void execLDI(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->I = op->nnn;
+}
+
+static inline void execRND(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->V[op->x] = CHIP_Random(chip) & op->kk;
+}
+
+// Places sprite row bits, width pixels wide, at column x of a 128-bit display row split in high and low words
+// x may be negative, pixels left of column 0 or right of column 127 are dropped
+static inline void placeSprite(uint64_t bits, int width, int x, uint64_t *high, uint64_t *low)
+{
+    uint64_t sprite = bits << (64 - width);
+
+    *high = 0;
+    *low = 0;
+
+    if (x < 0)
+    {
+        *high = sprite << -x;
+    }
+    else if (x == 0)
+    {
+        *high = sprite;
+    }
+    else if (x < 64)
+    {
+        *high = sprite >> x;
+        *low = sprite << (64 - x);
+    }
+    else
+    {
+        *low = sprite >> (x - 64);
     }
+}
 
-    fclose(fp);
+// no waiting just check if key in V[x] is currently pressed and IF SO skip next instruction
+// only the low nibble of V[x] selects the key, like CHIP_SetKey
+static inline void execSKP(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->Keyboard[ chip->V[op->x] & 0xF ])
+        skipNext(chip);
+}
 
-    return size;
+// no waiting just check if key in V[x] is currently pressed and if it is NOT skip next instruction
+static inline void execSKPN(Chip8 *chip, const CHIP_Op *op)
+{
+    if ( ! chip->Keyboard[ chip->V[op->x] & 0xF ])
+        skipNext(chip);
+}
 
+static inline void execLDDT(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->V[op->x] = chip->DT;
 }
 
-void CHIP_EmulateCycle()
+// Wait for key press
+static inline void execLDK(Chip8 *chip, const CHIP_Op *op)
 {
-    executeInstruction(fetchInstruction()); 
-    if (DT > 0)
-        DT--;
-    
-    if (ST > 0)
+    byte keypressed = 0;
+
+    for (int i=0; i<16; i++)
     {
-        ST--;
-        soundFlag = 1;
-    }        
-    
-    //print_chip_content();    
+        if (chip->Keyboard[i] != 0)
+        {
+            chip->V[op->x] = i;
+            keypressed = 1;
+        }
+    }
+
+    // Keep PC unchanged untill key is pressed
+    // the machine halts, so it stops running instructions until CHIP_SetKey wakes it
+    // the rest of the current batch runs this instruction again, which leaves the machine unchanged
+    if (!keypressed)
+    {
+        chip->PC -= 2;
+        chip->halted = CHIP_HALT_KEY;
+    }
+}
+
+static inline void execSETDT(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->DT = chip->V[op->x];
+}
+
+static inline void execSETST(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->ST = chip->V[op->x];
+}
+
+static inline void execADDI(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->I += chip->V[op->x];
+}
+
+// V[x] - is char in range 0 to 15
+static inline void execLDCH(Chip8 *chip, const CHIP_Op *op)
+{
+    chip->I = chip->V[op->x] * 5;
+}
+
+static inline void execBCD(Chip8 *chip, const CHIP_Op *op)
+{
+    if (!checkMemory(chip, 3))
+    {
+        return;
+    }
+
+    byte digits[3] = { chip->V[op->x] / 100, (chip->V[op->x] % 100) / 10, chip->V[op->x] % 10 };
+
+    if (CHIP_StoreMemory(chip, chip->I, digits, 3) < 0)
+    {
+        fault(chip, CHIP_FAULT_OUT_OF_MEMORY);
+        return;
+    }
+
+    CHIP_MemoryWritten(chip, chip->I, 3);
+}
+
+// SUPER-CHIP instructions
+// the CHIP-8 model executes them as unknown instructions
+
+static inline void execSCD(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    scrollVertical(chip, op->n);
+}
+
+static inline void execSCR(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    scrollHorizontal(chip, 1);
+}
+
+static inline void execSCL(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    scrollHorizontal(chip, 0);
+}
+
+// Stops the program - PC stays on the EXIT instruction and the machine halts for good
+static inline void execEXIT(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    chip->PC -= 2;
+    chip->halted = CHIP_HALT_EXIT;
+}
+
+static inline void execLOWRES(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    chip->hires = 0;
+    chip->drawFlag = 1;
+    clearScreen(chip);
+}
+
+static inline void execHIGHRES(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    chip->hires = 1;
+    chip->drawFlag = 1;
+    clearScreen(chip);
+}
+
+// V[x] - is digit in range 0 to 15, 8x10 sprites follow the 5 byte font
+static inline void execLDHF(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    chip->I = BIG_FONT_ADDRESS + (chip->V[op->x] & 0xF) * 10;
+}
+
+static inline void execSAVEF(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    memcpy(chip->flags, chip->V, op->x + 1);
+}
+
+static inline void execLOADF(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model == CHIP_MODEL_CHIP8)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    memcpy(chip->V, chip->flags, op->x + 1);
+}
+
+// XO-CHIP instructions
+// other models execute them as unknown instructions
+
+static inline void execSCU(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model != CHIP_MODEL_XOCHIP)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    scrollVertical(chip, -op->n);
+}
+
+// Copies Vx ... Vy to memory at I, registers are stored in reverse order when x > y, I is unchanged
+static inline void execSAVER(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model != CHIP_MODEL_XOCHIP)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    int step = op->x <= op->y ? 1 : -1;
+    int count = (op->x <= op->y ? op->y - op->x : op->x - op->y) + 1;
+
+    if (!checkMemory(chip, count))
+    {
+        return;
+    }
+
+    byte data[16];
+
+    for (int i = 0; i < count; i++)
+    {
+        data[i] = chip->V[op->x + i * step];
+    }
+
+    if (CHIP_StoreMemory(chip, chip->I, data, count) < 0)
+    {
+        fault(chip, CHIP_FAULT_OUT_OF_MEMORY);
+        return;
+    }
+
+    CHIP_MemoryWritten(chip, chip->I, count);
+}
+
+static inline void execLOADR(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model != CHIP_MODEL_XOCHIP)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    int step = op->x <= op->y ? 1 : -1;
+    int count = (op->x <= op->y ? op->y - op->x : op->x - op->y) + 1;
+
+    if (!checkMemory(chip, count))
+    {
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        chip->V[op->x + i * step] = CHIP_ReadByte(chip, chip->I + i);
+    }
+}
+
+// I = the word following the instruction, which is skipped
+static inline void execLDIL(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model != CHIP_MODEL_XOCHIP)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    chip->I = CHIP_ReadByte(chip, chip->PC) << 8 | CHIP_ReadByte(chip, chip->PC + 1);
+    chip->PC += 2;
+}
+
+static inline void execPLANE(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model != CHIP_MODEL_XOCHIP)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    chip->planes = op->x & 3;
+}
+
+static inline void execLDAUD(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model != CHIP_MODEL_XOCHIP)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    if (!checkMemory(chip, sizeof(chip->pattern)))
+    {
+        return;
+    }
+
+    CHIP_ReadMemory(chip, chip->I, chip->pattern, sizeof(chip->pattern));
+}
+
+static inline void execPITCH(Chip8 *chip, const CHIP_Op *op)
+{
+    if (chip->model != CHIP_MODEL_XOCHIP)
+    {
+        execUnknown(chip, op);
+        return;
+    }
+
+    chip->pitch = chip->V[op->x];
+}
+
+// Decoder tables
+// the first nibble selects an entry of primaryTable, groups sharing a first nibble are resolved by a secondary table
+
+#define OP_GROUP    0xFF    // primaryTable entry that needs a secondary table
+#define OP_EMPTY    0xFE    // decodeCache entry that is not decoded yet
+
+static byte primaryTable[16] =
+{
+    OP_GROUP, OP_JP, OP_CALL, OP_SE, OP_SNE, OP_GROUP, OP_LD, OP_ADD,
+    OP_GROUP, OP_SNER, OP_LDI, OP_JPV, OP_RND, OP_DRW, OP_GROUP, OP_GROUP
+};
+
+static byte group0Table[256];   // 00kk - indexed by lowest byte
+static byte group5Table[16];    // 5xyn - indexed by lowest nibble
+static byte group8Table[16];    // 8xyn - indexed by lowest nibble
+static byte groupETable[256];   // Exkk - indexed by lowest byte
+static byte groupFTable[256];   // Fxkk - indexed by lowest byte
+
+static CHIP_Op decodeTable[0x10000];    // every possible instruction pre-decoded, used by CHIP_DISPATCH_TABLE
+static atomic_int tablesState;          // 0 - not built, 1 - being built, 2 - ready
+
+// Fills secondary tables from the opcode defines in chip8.h
+static void buildSecondaryTables()
+{
+    group0Table[NOP & 0xFF] = OP_NOP;
+    group0Table[CLS & 0xFF] = OP_CLS;
+    group0Table[RET & 0xFF] = OP_RET;
+    group0Table[SCR & 0xFF] = OP_SCR;
+    group0Table[SCL & 0xFF] = OP_SCL;
+    group0Table[EXIT & 0xFF] = OP_EXIT;
+    group0Table[LOWRES & 0xFF] = OP_LOWRES;
+    group0Table[HIGHRES & 0xFF] = OP_HIGHRES;
+
+    // 00Cn and 00Dn take the row count in the lowest nibble
+    for (int n = 0; n < 16; n++)
+    {
+        group0Table[(SCD & 0xFF) | n] = OP_SCD;
+        group0Table[(SCU & 0xFF) | n] = OP_SCU;
+    }
+
+    group5Table[SER & 0xF] = OP_SER;
+    group5Table[SAVER & 0xF] = OP_SAVER;
+    group5Table[LOADR & 0xF] = OP_LOADR;
+
+    group8Table[LDR & 0xF] = OP_LDR;
+    group8Table[OR & 0xF] = OP_OR;
+    group8Table[AND & 0xF] = OP_AND;
+    group8Table[XOR & 0xF] = OP_XOR;
+    group8Table[ADDR & 0xF] = OP_ADDR;
+    group8Table[SUB & 0xF] = OP_SUB;
+    group8Table[SHR & 0xF] = OP_SHR;
+    group8Table[SUBN & 0xF] = OP_SUBN;
+    group8Table[SHL & 0xF] = OP_SHL;
+
+    groupETable[SKP & 0xFF] = OP_SKP;
+    groupETable[SKPN & 0xFF] = OP_SKPN;
+
+    groupFTable[LDDT & 0xFF] = OP_LDDT;
+    groupFTable[LDK & 0xFF] = OP_LDK;
+    groupFTable[SETDT & 0xFF] = OP_SETDT;
+    groupFTable[SETST & 0xFF] = OP_SETST;
+    groupFTable[ADDI & 0xFF] = OP_ADDI;
+    groupFTable[LDCH & 0xFF] = OP_LDCH;
+    groupFTable[BCD & 0xFF] = OP_BCD;
+    groupFTable[PUSHR & 0xFF] = OP_PUSHR;
+    groupFTable[POPR & 0xFF] = OP_POPR;
+    groupFTable[LDHF & 0xFF] = OP_LDHF;
+    groupFTable[SAVEF & 0xFF] = OP_SAVEF;
+    groupFTable[LOADF & 0xFF] = OP_LOADF;
+    groupFTable[LDIL & 0xFF] = OP_LDIL;
+    groupFTable[PLANE & 0xFF] = OP_PLANE;
+    groupFTable[LDAUD & 0xFF] = OP_LDAUD;
+    groupFTable[PITCH & 0xFF] = OP_PITCH;
+}
+
+// Decodes instruction through the primary and secondary tables
+// used by CHIP_DISPATCH_NIBBLE and to fill decodeTable
+static inline CHIP_Op decodeNibble(word instruction)
+{
+    // the following code uses flags to extract different nibbles from instructions
+    // example. 0xF000 - flag to extract most significant nibble
+    CHIP_Op op;
+
+    op.instruction = instruction;
+    op.nnn = instruction & 0x0FFF;
+    op.x = (instruction & 0x0F00) >> 8;
+    op.y = (instruction & 0x00F0) >> 4;
+    op.n = instruction & 0x000F;
+    op.kk = instruction & 0x00FF;
+    op.op = primaryTable[instruction >> 12];
+
+    if (op.op == OP_GROUP)
+    {
+        switch (instruction >> 12)
+        {
+            case 0x0:
+                // 0nnn (SYS) is not supported, only 00kk instructions are
+                op.op = op.x == 0 ? group0Table[op.kk] : OP_UNKNOWN;
+                break;
+
+            case 0x5:
+                op.op = group5Table[op.n];
+                break;
+
+            case 0x8:
+                op.op = group8Table[op.n];
+                break;
+
+            case 0xE:
+                op.op = groupETable[op.kk];
+                break;
+
+            default:
+                op.op = groupFTable[op.kk];
+
+                // F000 and F002 take no register
+                if ((op.op == OP_LDIL || op.op == OP_LDAUD) && op.x != 0)
+                {
+                    op.op = OP_UNKNOWN;
+                }
+                break;
+        }
+    }
+
+    return op;
+}
+
+// Builds decoder tables once per process, safe to call from several threads
+static void buildTables()
+{
+    int expected = 0;
+
+    if (atomic_load_explicit(&tablesState, memory_order_acquire) == 2)
+    {
+        return;
+    }
+
+    if (atomic_compare_exchange_strong(&tablesState, &expected, 1))
+    {
+        buildSecondaryTables();
+
+        memcpy(fontPage.data + FONT_ADDRESS, CHIP_Fontset, sizeof(CHIP_Fontset));
+        memcpy(fontPage.data + BIG_FONT_ADDRESS, CHIP_BigFontset, sizeof(CHIP_BigFontset));
+
+        for (int i = 0; i < 0x10000; i++)
+        {
+            decodeTable[i] = decodeNibble(i);
+        }
+
+        atomic_store_explicit(&tablesState, 2, memory_order_release);
+    }
+    else
+    {
+        // another thread is building the tables
+        while (atomic_load_explicit(&tablesState, memory_order_acquire) != 2)
+            ;
+    }
+}
+
+CHIP_Op CHIP_Decode(word instruction)
+{
+    buildTables();
+
+    return decodeTable[instruction];
+}
+
+// Must be called after size bytes of RAM starting at address are modified
+// marks the pages as dirty and drops cached decodings of every instruction overlapping the modified bytes
+void CHIP_MemoryWritten(Chip8 *chip, int address, int size)
+{
+    int last = (address + size - 1) / PAGE_SIZE;
+
+    // writes wrap around RAM_SIZE like the addresses
+    for (int page = address / PAGE_SIZE; page <= last; page++)
+    {
+        int index = page % PAGE_COUNT;
+
+        chip->dirtyPages[index / 64] |= 1ULL << (index % 64);
+    }
+
+    if (chip->blocks != NULL)
+    {
+        BLOCK_Invalidate(chip, address, size);
+    }
+
+    if (chip->decodeCache == NULL)
+    {
+        return;
+    }
+
+    // instruction starting one byte before address also contains a modified byte
+    int start = address > 0 ? address - 1 : 0;
+    int end = address + size < RAM_SIZE ? address + size : RAM_SIZE;
+
+    for (int i = start; i < end; i++)
+    {
+        chip->decodeCache[i].op = OP_EMPTY;
+    }
+}
+
+// Interpreters specialized for every quirks profile of quirks.h, see quirks.inc
+// quirks are compiled into the handlers, a profile is picked once per CHIP_EmulateCycles call
+
+#define QUIRKS_CONCAT(name, profile)    name##_##profile
+#define QUIRKS_EXPAND(name, profile)    QUIRKS_CONCAT(name, profile)
+#define QUIRKED(name)                   QUIRKS_EXPAND(name, QUIRKS_NAME)
+
+#define QUIRKS_NAME         VIP
+#include "quirks.inc"
+
+#define QUIRKS_NAME         CHIP48
+#include "quirks.inc"
+
+#define QUIRKS_NAME         SCHIP
+#include "quirks.inc"
+
+#define QUIRKS_NAME         MODERN
+#include "quirks.inc"
+
+typedef struct Interpreter
+{
+    const Handler *handlers;
+    void (*runTable)(Chip8 *chip, long cycles);
+    void (*runNibble)(Chip8 *chip, long cycles);
+    void (*runThreaded)(Chip8 *chip, long cycles);
+    void (*runCached)(Chip8 *chip, long cycles);
+#ifdef CHIP_PROFILE
+    void (*runProfiled)(Chip8 *chip, long cycles);
+#endif
+} Interpreter;
+
+#ifdef CHIP_PROFILE
+#define INTERPRETER(profile)    { handlers_##profile, runTable_##profile, runNibble_##profile, runThreaded_##profile, \
+                                  runCached_##profile, runProfiled_##profile }
+#else
+#define INTERPRETER(profile)    { handlers_##profile, runTable_##profile, runNibble_##profile, runThreaded_##profile, \
+                                  runCached_##profile }
+#endif
+
+// Interpreter for every CHIP_QUIRKS_ profile, order must match chip8.h
+static const Interpreter interpreters[CHIP_QUIRKS_COUNT] =
+{
+    INTERPRETER(VIP),
+    INTERPRETER(CHIP48),
+    INTERPRETER(SCHIP),
+    INTERPRETER(MODERN),
+};
+
+#undef INTERPRETER
+
+// Executes instruction
+// @param instruction - 2 byte long instruction to parse and execute
+void executeInstruction(Chip8 *chip, word instruction)
+{
+    const CHIP_Op *op = &decodeTable[instruction];
+
+    interpreters[chip->quirks].handlers[op->op](chip, op);
+}
+
+// Quirks profile every model starts with
+// CHIP-8 programs keep the SUPER-CHIP behavior this interpreter always had
+static const byte modelQuirks[CHIP_MODEL_COUNT] = { CHIP_QUIRKS_SCHIP, CHIP_QUIRKS_SCHIP, CHIP_QUIRKS_MODERN };
+
+// Should be called when chip8 is booted 
+// Resets memory, display, registers and stack to 0 
+// Sets PC to LOAD_ADDRESS
+void CHIP_Initalize(Chip8 *chip)
+{   
+    buildTables();
+
+    // reset memory to the shared fontset and zero pages
+    for (int i=0; i < PAGE_COUNT; i++)
+    {
+        releasePage(chip->pages[i]);
+        chip->pages[i] = (i == 0) ? &fontPage : &zeroPage;
+    }
+
+    // reset stack
+    for (int i=0; i < STACK_SIZE; i++)
+    {
+        chip->Stack[i] = 0;
+    }
+
+    // reset registers
+    for (int i=0; i < 16; i++)
+    {
+        chip->V[i] = 0;
+    }
+
+    chip->DT = chip->ST = chip->SP = chip->I = 0;
+    chip->PC = LOAD_ADDRESS;
+
+    chip->drawFlag = chip->soundFlag = 0;
+    chip->halted = CHIP_RUNNING;
+    chip->fault = CHIP_FAULT_NONE;
+    memset(chip->diagnostics, 0, sizeof(chip->diagnostics));
+    chip->dispatch = CHIP_DISPATCH_TABLE;
+    chip->cycles = 0;
+
+    CHIP_Seed(chip, 1);
+
+    for (int i=0; i < 16; i++)
+    {
+        chip->Keyboard[i] = 0;
+    }
+
+    // the model and the flag registers survive a reset, like the flags of a real calculator
+    if (chip->model >= CHIP_MODEL_COUNT)
+    {
+        chip->model = CHIP_MODEL_CHIP8;
+    }
+
+    chip->memorySize = chip->model == CHIP_MODEL_XOCHIP ? RAM_SIZE : CHIP8_RAM_SIZE;
+    chip->quirks = modelQuirks[chip->model];
+    chip->hires = 0;
+    chip->planes = 1;
+    chip->pitch = 64;
+    memset(chip->pattern, 0, sizeof(chip->pattern));
+
+    clearScreen(chip);
+
+    CHIP_MemoryWritten(chip, 0, RAM_SIZE);
+}
+
+// Releases memory owned by the machine
+// machine can be initialized again afterwards
+void CHIP_Free(Chip8 *chip)
+{
+    for (int i=0; i < PAGE_COUNT; i++)
+    {
+        releasePage(chip->pages[i]);
+        chip->pages[i] = NULL;
+    }
+
+    free(chip->decodeCache);
+    chip->decodeCache = NULL;
+
+    BLOCK_Free(chip);
+}
+
+// Makes child a copy of parent that shares all RAM pages with it
+// pages are copied only when one of the machines writes to them
+// child must be zeroed or released with CHIP_Free before
+void CHIP_Fork(Chip8 *child, Chip8 *parent)
+{
+    *child = *parent;
+
+    for (int i=0; i < PAGE_COUNT; i++)
+    {
+        retainPage(child->pages[i]);
+    }
+
+    // caches are per machine
+    child->decodeCache = NULL;
+    child->blocks = NULL;
+#ifdef CHIP_PROFILE
+    child->profile = NULL;
+#endif
+    CHIP_SetDispatch(child, parent->dispatch);
+}
+
+// Selects the model emulated by chip
+// RAM visible to programs follows the model, the display goes back to 64x32 on the first plane
+void CHIP_SetModel(Chip8 *chip, int model)
+{
+    chip->model = (model >= 0 && model < CHIP_MODEL_COUNT) ? model : CHIP_MODEL_CHIP8;
+    chip->memorySize = chip->model == CHIP_MODEL_XOCHIP ? RAM_SIZE : CHIP8_RAM_SIZE;
+    chip->quirks = modelQuirks[chip->model];
+    chip->hires = 0;
+    chip->planes = 1;
+
+    clearScreen(chip);
+
+    // translated code depends on the model
+    CHIP_MemoryWritten(chip, 0, RAM_SIZE);
+}
+
+// Selects the quirks profile of chip, should be called after CHIP_SetModel, which resets it to the model default
+void CHIP_SetQuirks(Chip8 *chip, int quirks)
+{
+    chip->quirks = (quirks >= 0 && quirks < CHIP_QUIRKS_COUNT) ? quirks : modelQuirks[chip->model];
+
+    // translated code depends on the profile
+    CHIP_MemoryWritten(chip, 0, RAM_SIZE);
+}
+
+// Returns the id from 0 to count - 1 whose name is name, -1 if there is none
+static int idByName(const char *name, const char *(*nameOf)(int), int count)
+{
+    for (int id = 0; id < count; id++)
+    {
+        if (strcmp(name, nameOf(id)) == 0)
+        {
+            return id;
+        }
+    }
+
+    return -1;
+}
+
+const char *CHIP_QuirksName(int quirks)
+{
+    switch (quirks)
+    {
+        case CHIP_QUIRKS_VIP:       return "vip";
+        case CHIP_QUIRKS_CHIP48:    return "chip48";
+        case CHIP_QUIRKS_SCHIP:     return "schip";
+        case CHIP_QUIRKS_MODERN:    return "modern";
+        default:                    return "unknown";
+    }
+}
+
+int CHIP_QuirksByName(const char *name)
+{
+    return idByName(name, CHIP_QuirksName, CHIP_QUIRKS_COUNT);
+}
+
+const char *CHIP_ModelName(int model)
+{
+    switch (model)
+    {
+        case CHIP_MODEL_CHIP8:      return "chip8";
+        case CHIP_MODEL_SCHIP:      return "schip";
+        case CHIP_MODEL_XOCHIP:     return "xochip";
+        default:                    return "unknown";
+    }
+}
+
+int CHIP_ModelByName(const char *name)
+{
+    return idByName(name, CHIP_ModelName, CHIP_MODEL_COUNT);
+}
+
+// Loads program to CHIP8 RAM from file
+// the file is mapped and copied to RAM in one go, ROMs bigger than CHIP_ProgramSize are truncated
+// returns size of the file, which is more than was loaded if it was truncated, or a negative CHIP_LOAD_ error
+int CHIP_LoadProgram(Chip8 *chip, const char *fname)
+{
+    MappedFile file;
+    int status = MAP_Open(&file, fname);
+
+    if (status == -1)
+    {
+        return CHIP_LOAD_OPEN_ERROR;
+    }
+
+    if (status != 0)
+    {
+        return CHIP_LOAD_READ_ERROR;
+    }
+
+    if (file.size > INT_MAX)
+    {
+        MAP_Close(&file);
+        return CHIP_LOAD_READ_ERROR;
+    }
+
+    int size = (int) file.size;
+
+    CHIP_LoadProgramMemory(chip, file.data, size);
+    MAP_Close(&file);
+
+    return size;
+}
+
+const char *CHIP_LoadError(const Chip8 *chip, int status)
+{
+    switch (status)
+    {
+        case CHIP_LOAD_OPEN_ERROR:  return "unable to open file";
+        case CHIP_LOAD_READ_ERROR:  return "unable to read file";
+        default:                    return status > CHIP_ProgramSize(chip) ? "program truncated" : "no error";
+    }
+}
+
+// Copies program image of size bytes from data to CHIP8 RAM
+// returns number of bytes loaded, programs bigger than the available memory are truncated
+int CHIP_LoadProgramMemory(Chip8 *chip, const byte *data, int size)
+{
+    if (size > CHIP_ProgramSize(chip))
+    {
+        size = CHIP_ProgramSize(chip);
+    }
+
+    CHIP_WriteMemory(chip, LOAD_ADDRESS, data, size);
+
+    return size;
+}
+
+// Seeds RND generator of the machine, machines with the same seed and input draw the same numbers
+void CHIP_Seed(Chip8 *chip, uint32_t seed)
+{
+    // xorshift state must not be 0
+    chip->random = seed != 0 ? seed : 0x9E3779B9;
+}
+
+// Returns next random byte of the machine (xorshift32)
+byte CHIP_Random(Chip8 *chip)
+{
+    uint32_t x = chip->random;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip->random = x;
+
+    return x >> 24;
+}
+
+// Selects instruction dispatch backend
+// should be called after CHIP_Initalize, which resets it to CHIP_DISPATCH_TABLE
+void CHIP_SetDispatch(Chip8 *chip, int dispatch)
+{
+    chip->dispatch = (dispatch >= 0 && dispatch < CHIP_DISPATCH_COUNT) ? dispatch : CHIP_DISPATCH_TABLE;
+
+    if (chip->dispatch == CHIP_DISPATCH_CACHED && chip->decodeCache == NULL)
+    {
+        chip->decodeCache = malloc(sizeof(CHIP_Op) * RAM_SIZE);
+        CHIP_MemoryWritten(chip, 0, RAM_SIZE);
+    }
+
+    if (chip->dispatch == CHIP_DISPATCH_BLOCKS && chip->blocks == NULL)
+    {
+        BLOCK_Create(chip);
+    }
+}
+
+const char *CHIP_OpName(int op)
+{
+    // order must match the enum in chip8.h
+    static const char *names[OP_COUNT] =
+    {
+        "UNKNOWN",
+        "NOP", "CLS", "RET", "JP", "CALL", "SE", "SNE", "SER", "LD", "ADD",
+        "LDR", "OR", "AND", "XOR", "ADDR", "SUB", "SHR", "SUBN", "SHL", "SNER",
+        "LDI", "RND", "DRW", "SKP", "SKPN",
+        "LDDT", "LDK", "SETDT", "SETST", "ADDI", "LDCH", "BCD", "PUSHR", "POPR",
+        "SCD", "SCR", "SCL", "EXIT", "LOWRES", "HIGHRES", "LDHF", "SAVEF", "LOADF",
+        "SCU", "SAVER", "LOADR", "LDIL", "PLANE", "LDAUD", "PITCH",
+        "JPV",
+    };
+
+    return (op >= 0 && op < OP_COUNT) ? names[op] : "UNKNOWN";
+}
+
+const char *CHIP_FaultName(int fault)
+{
+    switch (fault)
+    {
+        case CHIP_FAULT_NONE:               return "none";
+        case CHIP_FAULT_STACK_OVERFLOW:     return "stack overflow";
+        case CHIP_FAULT_STACK_UNDERFLOW:    return "stack underflow";
+        case CHIP_FAULT_ILLEGAL_OPCODE:     return "illegal opcode";
+        case CHIP_FAULT_MEMORY:             return "memory access out of bounds";
+        case CHIP_FAULT_OUT_OF_MEMORY:      return "out of host memory for a page copy";
+        default:                            return "unknown";
+    }
+}
+
+const char *CHIP_DispatchName(int dispatch)
+{
+    switch (dispatch)
+    {
+        case CHIP_DISPATCH_TABLE:       return "table";
+        case CHIP_DISPATCH_NIBBLE:      return "nibble";
+        case CHIP_DISPATCH_THREADED:    return "threaded";
+        case CHIP_DISPATCH_CACHED:      return "cached";
+        case CHIP_DISPATCH_BLOCKS:      return "blocks";
+        default:                        return "unknown";
+    }
+}
+
+int CHIP_DispatchByName(const char *name)
+{
+    return idByName(name, CHIP_DispatchName, CHIP_DISPATCH_COUNT);
+}
+
+// Runs one instruction
+// timers are not touched, they count down once per frame in CHIP_TickTimers
+void CHIP_EmulateCycle(Chip8 *chip)
+{
+    CHIP_EmulateCycles(chip, 1);
+}
+
+// Runs cycles instructions with the selected dispatch backend and the interpreter of the quirks profile
+void CHIP_EmulateCycles(Chip8 *chip, long cycles)
+{
+    const Interpreter *interpreter = &interpreters[chip->quirks];
+
+    // running the halting instruction again would not change the machine, only time passes
+    if (chip->halted)
+    {
+        chip->cycles += cycles;
+        return;
+    }
+
+#ifdef CHIP_PROFILE
+    if (chip->profile != NULL)
+    {
+        interpreter->runProfiled(chip, cycles);
+        chip->cycles += cycles;
+        return;
+    }
+#endif
+
+    switch (chip->dispatch)
+    {
+        case CHIP_DISPATCH_NIBBLE:
+            interpreter->runNibble(chip, cycles);
+            break;
+
+        case CHIP_DISPATCH_THREADED:
+            interpreter->runThreaded(chip, cycles);
+            break;
+
+        case CHIP_DISPATCH_CACHED:
+            interpreter->runCached(chip, cycles);
+            break;
+
+        case CHIP_DISPATCH_BLOCKS:
+            BLOCK_Run(chip, cycles);
+            break;
+
+        default:
+            interpreter->runTable(chip, cycles);
+            break;
+    }
+
+    chip->cycles += cycles;
+}
+
+byte CHIP_GetPixel(Chip8 *chip, int x, int y)
+{
+    byte color = 0;
+
+    for (int plane = 0; plane < PLANE_COUNT; plane++)
+    {
+        color |= (chip->Display[plane][y][x / 64] >> (63 - x % 64) & 1) << plane;
+    }
+
+    return color;
+}
+
+// Returns 64-bit FNV-1a hash of the display contents
+// only rows and words of the current display mode are hashed, the second plane only on XO-CHIP,
+// so 64x32 CHIP-8 displays hash the same as they always did
+uint64_t CHIP_HashDisplay(Chip8 *chip)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int planes = chip->model == CHIP_MODEL_XOCHIP ? PLANE_COUNT : 1;
+    int height = CHIP_Height(chip);
+    int words = CHIP_Width(chip) / 64;
+
+    for (int plane = 0; plane < planes; plane++)
+    {
+        for (int row = 0; row < height; row++)
+        {
+            for (int w = 0; w < words; w++)
+            {
+                for (int i = 0; i < 8; i++)
+                {
+                    hash ^= (chip->Display[plane][row][w] >> (i * 8)) & 0xFF;
+                    hash *= 0x100000001b3ULL;
+                }
+            }
+        }
+    }
+
+    return hash;
+}
+
+// Counts delay and sound timers down, must be called at 60 Hz
+// soundFlag tells whether the tone sounds during the frame that just ended
+void CHIP_TickTimers(Chip8 *chip)
+{
+    if (chip->DT > 0)
+        chip->DT--;
+
+    chip->soundFlag = chip->ST > 0;
+
+    if (chip->ST > 0)
+        chip->ST--;
+}
+
+// Runs one 60 Hz frame - instructionsPerFrame instructions followed by one timer tick
+void CHIP_RunFrame(Chip8 *chip, int instructionsPerFrame)
+{
+    CHIP_EmulateCycles(chip, instructionsPerFrame);
+    CHIP_TickTimers(chip);
+}
+
+// Runs one instruction with the reference interpreter whatever backend is selected
+// used by other execution engines for instructions they do not handle themselves
+// does not advance chip->cycles, the engine calling it accounts for the cycle
+void CHIP_Step(Chip8 *chip)
+{
+    interpreters[chip->quirks].runTable(chip, 1);
+}
+
+void CHIP_SetKey(Chip8 *chip, int key, int pressed)
+{
+    chip->Keyboard[key & 0xF] = pressed != 0;
+
+    // Fx0A runs again and takes the key
+    if (pressed && chip->halted == CHIP_HALT_KEY)
+    {
+        chip->halted = CHIP_RUNNING;
+    }
+}
+
+// Returns 1 if RAM of both machines holds the same bytes
+static int sameMemory(Chip8 *a, Chip8 *b)
+{
+    for (int i=0; i < PAGE_COUNT; i++)
+    {
+        if (a->pages[i] != b->pages[i] && memcmp(a->pages[i]->data, b->pages[i]->data, PAGE_SIZE) != 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Compares registers, stack, memory and display of two machines
+// returns 1 if they are equal
+int CHIP_CompareState(Chip8 *a, Chip8 *b)
+{
+    return memcmp(a->V, b->V, sizeof(a->V)) == 0 &&
+           a->DT == b->DT && a->ST == b->ST && a->SP == b->SP && a->PC == b->PC && a->I == b->I &&
+           a->random == b->random &&
+           a->model == b->model && a->hires == b->hires && a->planes == b->planes && a->pitch == b->pitch &&
+           memcmp(a->flags, b->flags, sizeof(a->flags)) == 0 &&
+           memcmp(a->pattern, b->pattern, sizeof(a->pattern)) == 0 &&
+           sameMemory(a, b) &&
+           memcmp(a->Stack, b->Stack, sizeof(a->Stack)) == 0 &&
+           memcmp(a->Display, b->Display, sizeof(a->Display)) == 0;
 }
 
 // used for debugging purpose
 // prints content of RAM(if content is not 0), registers and stack, display
-void print_chip_content()
+void print_chip_content(Chip8 *chip)
 {
     for(int i=0; i<RAM_SIZE; i++)
     {   
-        if (RAM[i] != 0)
-            printf("%d %d\n", i, RAM[i]);
+        if (CHIP_ReadByte(chip, i) != 0)
+            printf("%d %d\n", i, CHIP_ReadByte(chip, i));
     }
 
     printf("\n\nStack\n");
     for(int i=0; i<STACK_SIZE; i++)
     {
-        printf("%d ", Stack[i]);
+        printf("%d ", chip->Stack[i]);
     }
 
     printf("\n\nDisplay\n");
-    for(int i=0; i<WIDTH*HEIGHT; i++)
+    for(int i=0; i<CHIP_Width(chip)*CHIP_Height(chip); i++)
     {
-        printf("%d ", Display[i]);
+        printf("%d ", CHIP_GetPixel(chip, i % CHIP_Width(chip), i / CHIP_Width(chip)));
     }
 
     printf("\n\n");
     for (int i=0; i<16; i++)
     {
-        printf("V%X %x\n", i, V[i]);
+        printf("V%X %x\n", i, chip->V[i]);
     }
-    printf("\nDT %d\nST %d\n\nPC %d\nSP %d\n\nI %d\n", DT, ST, PC, SP, I);
+    printf("\nDT %d\nST %d\n\nPC %d\nSP %d\n\nI %d\n", chip->DT, chip->ST, chip->PC, chip->SP, chip->I);
 
 
 }
\ No newline at end of file
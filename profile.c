@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "profile.h"
+
+static int countPixels(uint64_t row)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(row);
+#else
+    int count = 0;
+
+    for (; row != 0; row &= row - 1)
+    {
+        count++;
+    }
+
+    return count;
+#endif
+}
+
+Profile *PROFILE_Create(void)
+{
+    Profile *profile = malloc(sizeof(Profile));
+
+    if (profile != NULL)
+    {
+        PROFILE_Reset(profile);
+    }
+
+    return profile;
+}
+
+void PROFILE_Free(Profile *profile)
+{
+    free(profile);
+}
+
+void PROFILE_Reset(Profile *profile)
+{
+    memset(profile, 0, sizeof(Profile));
+
+    profile->nodes[0].target = LOAD_ADDRESS;
+    profile->nodes[0].parent = -1;
+    profile->nodes[0].child = -1;
+    profile->nodes[0].sibling = -1;
+    profile->nodeCount = 1;
+
+    // resolve the call chain on the first instruction
+    profile->depth = -1;
+}
+
+void PROFILE_Attach(Chip8 *chip, Profile *profile)
+{
+    chip->profile = profile;
+
+    if (profile != NULL)
+    {
+        profile->depth = -1;
+    }
+}
+
+// Returns callee of node entered through target, adding it to the tree if it is new
+static int callee(Profile *profile, int node, word target)
+{
+    int last = -1;
+
+    for (int i = profile->nodes[node].child; i != -1; i = profile->nodes[i].sibling)
+    {
+        if (profile->nodes[i].target == target)
+        {
+            return i;
+        }
+
+        last = i;
+    }
+
+    if (profile->nodeCount == PROFILE_MAX_NODES)
+    {
+        return node;
+    }
+
+    int added = profile->nodeCount++;
+
+    profile->nodes[added].target = target;
+    profile->nodes[added].parent = node;
+    profile->nodes[added].child = -1;
+    profile->nodes[added].sibling = -1;
+    profile->nodes[added].instructions = 0;
+
+    if (last == -1)
+    {
+        profile->nodes[node].child = added;
+    }
+    else
+    {
+        profile->nodes[last].sibling = added;
+    }
+
+    return added;
+}
+
+// Walks the call tree along Stack - every entry is the return address of a CALL whose target names the frame
+static void resolveChain(Profile *profile, const Chip8 *chip)
+{
+    int node = 0;
+
+    for (int i = 0; i < chip->SP; i++)
+    {
+        word call = chip->Stack[i] - 2;
+        word target = (CHIP_ReadByte(chip, call) << 8 | CHIP_ReadByte(chip, call + 1)) & 0x0FFF;
+
+        node = callee(profile, node, target);
+    }
+
+    profile->node = node;
+    profile->depth = chip->SP;
+}
+
+void PROFILE_Record(Profile *profile, const Chip8 *chip, word pc, const CHIP_Op *op)
+{
+    if (profile->depth != chip->SP)
+    {
+        resolveChain(profile, chip);
+    }
+
+    profile->instructions++;
+    profile->opcodes[op->op]++;
+    profile->pcs[pc & (RAM_SIZE - 1)]++;
+    profile->nodes[profile->node].instructions++;
+
+    if (op->op == OP_CALL)
+    {
+        profile->calls[op->nnn]++;
+    }
+    else if (op->op == OP_DRW)
+    {
+        memcpy(profile->display, chip->Display, sizeof(profile->display));
+    }
+}
+
+void PROFILE_Retire(Profile *profile, const Chip8 *chip, const CHIP_Op *op)
+{
+    if (op->op == OP_DRW)
+    {
+        profile->draws++;
+        profile->spritePixels += (op->n == 0 && chip->model != CHIP_MODEL_CHIP8) ? 16 * 16 : op->n * 8;
+
+        const uint64_t *before = &profile->display[0][0][0];
+        const uint64_t *after = &chip->Display[0][0][0];
+
+        for (int i = 0; i < PLANE_COUNT * HEIGHT * ROW_WORDS; i++)
+        {
+            profile->changedPixels += countPixels(before[i] ^ after[i]);
+        }
+    }
+}
+
+int PROFILE_WriteCSV(const Profile *profile, FILE *fp)
+{
+    fprintf(fp, "kind,key,count\n");
+
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        if (profile->opcodes[op] != 0)
+        {
+            fprintf(fp, "opcode,%s,%llu\n", CHIP_OpName(op), (unsigned long long) profile->opcodes[op]);
+        }
+    }
+
+    for (int address = 0; address < RAM_SIZE; address++)
+    {
+        if (profile->pcs[address] != 0)
+        {
+            fprintf(fp, "pc,0x%03x,%llu\n", address, (unsigned long long) profile->pcs[address]);
+        }
+    }
+
+    for (int address = 0; address < RAM_SIZE; address++)
+    {
+        if (profile->calls[address] != 0)
+        {
+            fprintf(fp, "call,0x%03x,%llu\n", address, (unsigned long long) profile->calls[address]);
+        }
+    }
+
+    fprintf(fp, "draw,instructions,%llu\n", (unsigned long long) profile->draws);
+    fprintf(fp, "draw,sprite_pixels,%llu\n", (unsigned long long) profile->spritePixels);
+    fprintf(fp, "draw,changed_pixels,%llu\n", (unsigned long long) profile->changedPixels);
+
+    return ferror(fp) ? -1 : 0;
+}
+
+// Writes "key": count members of the nonzero entries of counts
+static void writeCounts(FILE *fp, const uint64_t *counts, int count, int addresses)
+{
+    const char *separator = "";
+
+    for (int i = 0; i < count; i++)
+    {
+        if (counts[i] == 0)
+        {
+            continue;
+        }
+
+        if (addresses)
+        {
+            fprintf(fp, "%s\n    \"0x%03x\": %llu", separator, i, (unsigned long long) counts[i]);
+        }
+        else
+        {
+            fprintf(fp, "%s\n    \"%s\": %llu", separator, CHIP_OpName(i), (unsigned long long) counts[i]);
+        }
+
+        separator = ",";
+    }
+}
+
+int PROFILE_WriteJSON(const Profile *profile, FILE *fp)
+{
+    fprintf(fp, "{\n  \"instructions\": %llu,\n  \"opcodes\": {", (unsigned long long) profile->instructions);
+    writeCounts(fp, profile->opcodes, OP_COUNT, 0);
+
+    fprintf(fp, "\n  },\n  \"pcs\": {");
+    writeCounts(fp, profile->pcs, RAM_SIZE, 1);
+
+    fprintf(fp, "\n  },\n  \"calls\": {");
+    writeCounts(fp, profile->calls, RAM_SIZE, 1);
+
+    fprintf(fp, "\n  },\n  \"draw\": {\n    \"instructions\": %llu,\n    \"sprite_pixels\": %llu,\n    \"changed_pixels\": %llu\n  }\n}\n",
+        (unsigned long long) profile->draws, (unsigned long long) profile->spritePixels,
+        (unsigned long long) profile->changedPixels);
+
+    return ferror(fp) ? -1 : 0;
+}
+
+// Writes frame names from the root down to node, separated by ';'
+static void writeChain(const Profile *profile, FILE *fp, int node)
+{
+    if (profile->nodes[node].parent != -1)
+    {
+        writeChain(profile, fp, profile->nodes[node].parent);
+        fprintf(fp, ";sub_%03x", profile->nodes[node].target);
+    }
+    else
+    {
+        fprintf(fp, "main");
+    }
+}
+
+int PROFILE_WriteFolded(const Profile *profile, FILE *fp)
+{
+    for (int node = 0; node < profile->nodeCount; node++)
+    {
+        if (profile->nodes[node].instructions != 0)
+        {
+            writeChain(profile, fp, node);
+            fprintf(fp, " %llu\n", (unsigned long long) profile->nodes[node].instructions);
+        }
+    }
+
+    return ferror(fp) ? -1 : 0;
+}
@@ -0,0 +1,72 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+#include "chip8.h"
+
+// Profiler
+// only built with -DCHIP_PROFILE, without it Chip8 has no profile field and CHIP_EmulateCycles has no hook
+// a machine with an attached profile runs on the table interpreter and reports every instruction to it
+
+// Most distinct call chains kept, deeper chains are counted in their last known caller
+#define PROFILE_MAX_NODES   4096
+
+// Call tree node - one per distinct chain of CALL targets from the program entry
+typedef struct ProfileNode
+{
+    word target;            // CALL target entering this node, LOAD_ADDRESS for the root
+    int parent;
+    int child;              // first callee, -1 if none
+    int sibling;            // next callee of the parent, -1 if none
+    uint64_t instructions;  // instructions executed with exactly this chain on the stack
+} ProfileNode;
+
+typedef struct Profile
+{
+    uint64_t instructions;
+    uint64_t opcodes[OP_COUNT];     // executions by OP_ id
+    uint64_t pcs[RAM_SIZE];         // executions by instruction address
+    uint64_t calls[RAM_SIZE];       // CALLs by target address
+
+    uint64_t draws;                 // DRW instructions
+    uint64_t spritePixels;          // sprite pixels drawn, 8 per sprite row
+    uint64_t changedPixels;         // display pixels flipped by DRW
+
+    ProfileNode nodes[PROFILE_MAX_NODES];
+    int nodeCount;
+    int node;                       // node of the current call chain
+    int depth;                      // SP the current node was resolved for
+
+    uint64_t display[PLANE_COUNT][HEIGHT][ROW_WORDS];   // Display before the DRW being executed
+} Profile;
+
+// Allocates an empty profile, returns NULL if out of memory
+Profile *PROFILE_Create(void);
+
+void PROFILE_Free(Profile *profile);
+
+// Clears all counters and the call tree
+void PROFILE_Reset(Profile *profile);
+
+// Attaches profile to chip, NULL detaches it
+// a profile may collect several runs of one machine but must not be attached to two running machines
+void PROFILE_Attach(Chip8 *chip, Profile *profile);
+
+// Called by the interpreter before instruction op at pc is executed
+void PROFILE_Record(Profile *profile, const Chip8 *chip, word pc, const CHIP_Op *op);
+
+// Called by the interpreter after op is executed
+void PROFILE_Retire(Profile *profile, const Chip8 *chip, const CHIP_Op *op);
+
+// Exports, return 0 on success or -1 on error
+
+// kind,key,count rows for opcodes, pcs, calls and draw totals
+int PROFILE_WriteCSV(const Profile *profile, FILE *fp);
+
+int PROFILE_WriteJSON(const Profile *profile, FILE *fp);
+
+// one "main;sub_2a0;sub_31c count" line per call chain, input for flamegraph.pl
+int PROFILE_WriteFolded(const Profile *profile, FILE *fp);
+
+#endif
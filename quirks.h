@@ -0,0 +1,51 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+#include "chip8.h"
+
+// Quirk settings of every CHIP_QUIRKS_ profile, the only place they are defined
+// QUIRKS_<name>(X) expands to X(name, shiftVy, memoryI, vfReset, wrap, jumpVx) for profile CHIP_QUIRKS_<name>
+//  shiftVy     8xy6 and 8xyE shift Vy into Vx instead of shifting Vx
+//  memoryI     Fx55 and Fx65 leave I unchanged (0), add x (1) or add x + 1 (2)
+//  vfReset     8xy1, 8xy2 and 8xy3 set VF to 0
+//  wrap        sprites wrap around the screen edges instead of being clipped
+//  jumpVx      Bxnn jumps to xnn + Vx instead of nnn + V0
+// processor.c compiles an interpreter for every profile from them with quirks.inc, engines translating code
+// look them up in QUIRKS_Profiles
+
+//                          name        shiftVy memoryI vfReset wrap    jumpVx
+#define QUIRKS_VIP(X)       X(VIP,      1,      2,      1,      0,      0)
+#define QUIRKS_CHIP48(X)    X(CHIP48,   0,      1,      0,      0,      1)
+#define QUIRKS_SCHIP(X)     X(SCHIP,    0,      0,      0,      0,      1)
+#define QUIRKS_MODERN(X)    X(MODERN,   1,      2,      0,      1,      0)
+
+#define QUIRKS_PROFILES(X)  QUIRKS_VIP(X) QUIRKS_CHIP48(X) QUIRKS_SCHIP(X) QUIRKS_MODERN(X)
+
+// One setting of a profile as a constant expression, also usable in #if - QUIRKS_SETTING(VIP, WRAP)
+#define QUIRKS_SETTING(name, setting)       QUIRKS_SELECT(name, setting)
+#define QUIRKS_SELECT(name, setting)        QUIRKS_##name(QUIRKS_##setting)
+
+#define QUIRKS_SHIFT_VY(name, shiftVy, memoryI, vfReset, wrap, jumpVx)   shiftVy
+#define QUIRKS_MEMORY_I(name, shiftVy, memoryI, vfReset, wrap, jumpVx)   memoryI
+#define QUIRKS_VF_RESET(name, shiftVy, memoryI, vfReset, wrap, jumpVx)   vfReset
+#define QUIRKS_WRAP(name, shiftVy, memoryI, vfReset, wrap, jumpVx)       wrap
+#define QUIRKS_JUMP_VX(name, shiftVy, memoryI, vfReset, wrap, jumpVx)    jumpVx
+
+// Settings of a profile as data, translated code gets them as operands and never checks the profile
+typedef struct Quirks
+{
+    byte shiftVy;
+    byte memoryI;
+    byte vfReset;
+    byte wrap;
+    byte jumpVx;
+} Quirks;
+
+#define QUIRKS_ENTRY(name, shiftVy, memoryI, vfReset, wrap, jumpVx) \
+    [CHIP_QUIRKS_##name] = { shiftVy, memoryI, vfReset, wrap, jumpVx },
+
+static const Quirks QUIRKS_Profiles[CHIP_QUIRKS_COUNT] = { QUIRKS_PROFILES(QUIRKS_ENTRY) };
+
+#undef QUIRKS_ENTRY
+
+#endif
@@ -0,0 +1,402 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+
+// Record layout
+//  RewindRegisters
+//  blocks, each a 2 byte index followed by runs up to the end of the block
+//      run - count of unchanged bytes to skip, count of changed bytes, the changed bytes XORed with the base
+// blocks 0 to PAGE_COUNT - 1 are the RAM pages, the ones after them Display
+// the base of a keyframe is zero, the base of any other frame is the frame before
+
+// Registers of a frame, at the start of every record
+typedef struct RewindRegisters
+{
+    byte V[16];
+    byte DT, ST, SP;
+    word PC, I;
+    word Stack[STACK_SIZE];
+    byte hires, planes, pitch;
+    byte flags[16];
+    byte pattern[16];
+    byte soundFlag;
+    byte halted, fault;
+    uint32_t random;
+    uint64_t cycles;
+    word blocks;        // blocks following the registers
+} RewindRegisters;
+
+_Static_assert(sizeof(RewindRegisters) <= 256, "registers do not fit REWIND_RECORD_MAX");
+_Static_assert(REWIND_BLOCK_SIZE == PAGE_SIZE, "a RAM page must be one block");
+
+Rewind *REWIND_Create(int frames, int interval, int arenaSize)
+{
+    if (frames <= 0 || interval <= 0 || arenaSize < REWIND_RECORD_MAX)
+    {
+        return NULL;
+    }
+
+    Rewind *rewind = calloc(1, sizeof(Rewind));
+
+    if (rewind == NULL)
+    {
+        return NULL;
+    }
+
+    rewind->capacity = frames;
+    rewind->interval = interval;
+    rewind->arenaSize = arenaSize;
+    rewind->frames = malloc(frames * sizeof(RewindFrame));
+    rewind->arena = malloc(arenaSize);
+    rewind->scratch = malloc(REWIND_RECORD_MAX);
+    rewind->memory = malloc(RAM_SIZE);
+
+    if (rewind->frames == NULL || rewind->arena == NULL || rewind->scratch == NULL || rewind->memory == NULL)
+    {
+        REWIND_Free(rewind);
+        return NULL;
+    }
+
+    REWIND_Reset(rewind);
+
+    return rewind;
+}
+
+void REWIND_Free(Rewind *rewind)
+{
+    if (rewind != NULL)
+    {
+        free(rewind->frames);
+        free(rewind->arena);
+        free(rewind->scratch);
+        free(rewind->memory);
+        free(rewind);
+    }
+}
+
+void REWIND_Reset(Rewind *rewind)
+{
+    rewind->first = 0;
+    rewind->count = 0;
+    rewind->position = -1;
+    rewind->head = 0;
+    rewind->used = 0;
+    rewind->model = -1;
+    rewind->quirks = -1;
+}
+
+int REWIND_Frames(const Rewind *rewind)
+{
+    return rewind->count;
+}
+
+static RewindFrame *frameAt(Rewind *rewind, int n)
+{
+    return &rewind->frames[(rewind->first + n) % rewind->capacity];
+}
+
+// Returns block n of the frame at position, a RAM page or a part of Display
+static byte *block(Rewind *rewind, int n)
+{
+    if (n < PAGE_COUNT)
+    {
+        return rewind->memory + n * REWIND_BLOCK_SIZE;
+    }
+
+    return (byte *) rewind->display + (n - PAGE_COUNT) * REWIND_BLOCK_SIZE;
+}
+
+// Appends block index holding data to out as runs of the bytes that differ from base, NULL base is zero
+// returns end of the output, out if no byte differs
+static byte *encodeBlock(byte *out, int index, const byte *data, const byte *base)
+{
+    byte diff[REWIND_BLOCK_SIZE];
+    byte changed = 0;
+
+    for (int i = 0; i < REWIND_BLOCK_SIZE; i++)
+    {
+        diff[i] = data[i] ^ (base != NULL ? base[i] : 0);
+        changed |= diff[i];
+    }
+
+    if (!changed)
+    {
+        return out;
+    }
+
+    *out++ = index & 0xFF;
+    *out++ = index >> 8;
+
+    for (int i = 0; i < REWIND_BLOCK_SIZE; )
+    {
+        int skip = 0;
+        int count = 0;
+
+        while (i + skip < REWIND_BLOCK_SIZE && skip < 255 && diff[i + skip] == 0)
+        {
+            skip++;
+        }
+
+        i += skip;
+
+        while (i + count < REWIND_BLOCK_SIZE && count < 255 && diff[i + count] != 0)
+        {
+            count++;
+        }
+
+        *out++ = skip;
+        *out++ = count;
+        memcpy(out, diff + i, count);
+        out += count;
+        i += count;
+    }
+
+    return out;
+}
+
+// XORs the blocks of record onto the frame at position
+static void applyRecord(Rewind *rewind, const byte *record, RewindRegisters *registers)
+{
+    const byte *p = record + sizeof(RewindRegisters);
+
+    memcpy(registers, record, sizeof(RewindRegisters));
+
+    for (int n = 0; n < registers->blocks; n++)
+    {
+        byte *data = block(rewind, p[0] | p[1] << 8);
+
+        p += 2;
+
+        for (int i = 0; i < REWIND_BLOCK_SIZE; )
+        {
+            int skip = *p++;
+            int count = *p++;
+
+            i += skip;
+
+            for (int j = 0; j < count; j++)
+            {
+                data[i++] ^= *p++;
+            }
+        }
+    }
+}
+
+// Writes the record of chip into scratch, a keyframe holds every block, other frames the dirty pages and Display
+// returns size of the record
+static int encodeFrame(Rewind *rewind, const Chip8 *chip, int keyframe)
+{
+    RewindRegisters registers;
+    byte *out = rewind->scratch + sizeof(RewindRegisters);
+    byte *start;
+
+    memset(&registers, 0, sizeof(registers));
+    memcpy(registers.V, chip->V, 16);
+    registers.DT = chip->DT;
+    registers.ST = chip->ST;
+    registers.SP = chip->SP;
+    registers.PC = chip->PC;
+    registers.I = chip->I;
+    memcpy(registers.Stack, chip->Stack, sizeof(registers.Stack));
+    registers.hires = chip->hires;
+    registers.planes = chip->planes;
+    registers.pitch = chip->pitch;
+    memcpy(registers.flags, chip->flags, 16);
+    memcpy(registers.pattern, chip->pattern, 16);
+    registers.soundFlag = chip->soundFlag;
+    registers.halted = chip->halted;
+    registers.fault = chip->fault;
+    registers.random = chip->random;
+    registers.cycles = chip->cycles;
+
+    for (int page = 0; page < PAGE_COUNT; page++)
+    {
+        if (keyframe || (chip->dirtyPages[page / 64] >> (page % 64) & 1))
+        {
+            start = out;
+            out = encodeBlock(out, page, chip->pages[page]->data, keyframe ? NULL : block(rewind, page));
+            registers.blocks += out != start;
+        }
+    }
+
+    for (int n = PAGE_COUNT; n < REWIND_BLOCK_COUNT; n++)
+    {
+        const byte *display = (const byte *) chip->Display + (n - PAGE_COUNT) * REWIND_BLOCK_SIZE;
+
+        start = out;
+        out = encodeBlock(out, n, display, keyframe ? NULL : block(rewind, n));
+        registers.blocks += out != start;
+    }
+
+    memcpy(rewind->scratch, &registers, sizeof(registers));
+
+    return out - rewind->scratch;
+}
+
+// Drops the oldest frame and the frames that depend on it
+static void dropOldest(Rewind *rewind)
+{
+    do
+    {
+        rewind->used -= frameAt(rewind, 0)->size;
+        rewind->first = (rewind->first + 1) % rewind->capacity;
+        rewind->count--;
+        rewind->position--;
+    }
+    while (rewind->count > 0 && frameAt(rewind, 0)->sinceKeyframe != 0);
+}
+
+// Returns arena offset of size free bytes after the newest record, dropping the oldest frames until they fit
+// records are contiguous, one that does not fit the end of the arena starts again at its beginning
+static int reserve(Rewind *rewind, int size)
+{
+    while (rewind->count > 0)
+    {
+        int tail = frameAt(rewind, 0)->offset;
+
+        if (rewind->head > tail && rewind->arenaSize - rewind->head >= size)
+        {
+            return rewind->head;
+        }
+
+        if (rewind->head > tail && tail >= size)
+        {
+            return 0;
+        }
+
+        if (rewind->head < tail && tail - rewind->head >= size)
+        {
+            return rewind->head;
+        }
+
+        dropOldest(rewind);
+    }
+
+    return size <= rewind->arenaSize ? 0 : -1;
+}
+
+int REWIND_Push(Rewind *rewind, Chip8 *chip)
+{
+    if (chip->model != rewind->model || chip->quirks != rewind->quirks)
+    {
+        REWIND_Reset(rewind);
+        rewind->model = chip->model;
+        rewind->quirks = chip->quirks;
+    }
+
+    // frames after a seek are replaced by the new one
+    while (rewind->count > rewind->position + 1)
+    {
+        rewind->used -= frameAt(rewind, rewind->count - 1)->size;
+        rewind->count--;
+    }
+
+    if (rewind->count > 0)
+    {
+        RewindFrame *newest = frameAt(rewind, rewind->count - 1);
+        rewind->head = newest->offset + newest->size;
+    }
+
+    if (rewind->count == rewind->capacity)
+    {
+        dropOldest(rewind);
+    }
+
+    int sinceKeyframe = rewind->count > 0 ? frameAt(rewind, rewind->count - 1)->sinceKeyframe + 1 : 0;
+    int keyframe = sinceKeyframe == 0 || sinceKeyframe >= rewind->interval;
+    int size = encodeFrame(rewind, chip, keyframe);
+    int offset = reserve(rewind, size);
+
+    // dropping made room by removing the frame the difference is based on
+    if (offset == 0 && !keyframe && rewind->count == 0)
+    {
+        keyframe = 1;
+        size = encodeFrame(rewind, chip, keyframe);
+        offset = reserve(rewind, size);
+    }
+
+    if (offset == -1)
+    {
+        REWIND_Reset(rewind);
+        return -1;
+    }
+
+    memcpy(rewind->arena + offset, rewind->scratch, size);
+
+    RewindFrame *frame = frameAt(rewind, rewind->count);
+
+    frame->offset = offset;
+    frame->size = size;
+    frame->sinceKeyframe = keyframe ? 0 : sinceKeyframe;
+
+    rewind->count++;
+    rewind->position = rewind->count - 1;
+    rewind->head = offset + size;
+    rewind->used += size;
+
+    // the frame at position is now the state of chip
+    for (int page = 0; page < PAGE_COUNT; page++)
+    {
+        if (keyframe || (chip->dirtyPages[page / 64] >> (page % 64) & 1))
+        {
+            memcpy(block(rewind, page), chip->pages[page]->data, PAGE_SIZE);
+        }
+    }
+
+    memcpy(rewind->display, chip->Display, sizeof(rewind->display));
+    memset(chip->dirtyPages, 0, sizeof(chip->dirtyPages));
+
+    return 0;
+}
+
+int REWIND_Seek(Rewind *rewind, Chip8 *chip, int back)
+{
+    if (back < 0 || back >= rewind->count)
+    {
+        return -1;
+    }
+
+    int target = rewind->count - 1 - back;
+    int keyframe = target - frameAt(rewind, target)->sinceKeyframe;
+    RewindRegisters registers;
+
+    memset(rewind->memory, 0, RAM_SIZE);
+    memset(rewind->display, 0, sizeof(rewind->display));
+
+    for (int n = keyframe; n <= target; n++)
+    {
+        applyRecord(rewind, rewind->arena + frameAt(rewind, n)->offset, &registers);
+    }
+
+    rewind->position = target;
+
+    memcpy(chip->V, registers.V, 16);
+    chip->DT = registers.DT;
+    chip->ST = registers.ST;
+    chip->SP = registers.SP;
+    chip->PC = registers.PC;
+    chip->I = registers.I;
+    memcpy(chip->Stack, registers.Stack, sizeof(chip->Stack));
+    chip->hires = registers.hires;
+    chip->planes = registers.planes;
+    chip->pitch = registers.pitch;
+    memcpy(chip->flags, registers.flags, 16);
+    memcpy(chip->pattern, registers.pattern, 16);
+    chip->soundFlag = registers.soundFlag;
+    chip->halted = registers.halted;
+    chip->fault = registers.fault;
+    chip->random = registers.random;
+    chip->cycles = registers.cycles;
+
+    // unchanged pages stay shared, Display is redrawn in full
+    CHIP_WriteMemory(chip, 0, rewind->memory, RAM_SIZE);
+    memcpy(chip->Display, rewind->display, sizeof(chip->Display));
+    chip->drawFlag = 1;
+    chip->dirtyRows = ~0ULL;
+
+    // the frame at position is the state of chip
+    memset(chip->dirtyPages, 0, sizeof(chip->dirtyPages));
+
+    return 0;
+}
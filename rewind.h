@@ -0,0 +1,72 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "chip8.h"
+
+// Rewind buffer
+// keeps the last frames of one machine in a ring of records inside an arena allocated by REWIND_Create
+// every interval frames a keyframe holds RAM and Display, the frames in between hold the XOR of RAM and
+// Display with the frame before, with runs of unchanged bytes left out
+// only RAM pages marked in dirtyPages since the last push are compared, pushing and seeking allocate nothing
+
+// RAM and Display are stored in blocks of REWIND_BLOCK_SIZE bytes
+// largest record of one frame - registers, then every block changed in every other byte
+#define REWIND_BLOCK_SIZE   256
+#define REWIND_BLOCK_COUNT  (PAGE_COUNT + PLANE_COUNT * HEIGHT * ROW_WORDS * 8 / REWIND_BLOCK_SIZE)
+#define REWIND_RECORD_MAX   (256 + REWIND_BLOCK_COUNT * (2 + 3 * REWIND_BLOCK_SIZE / 2 + 2))
+
+// Frame of the ring
+typedef struct RewindFrame
+{
+    int offset;         // record in the arena
+    int size;           // bytes of the record
+    int sinceKeyframe;  // frames since the last keyframe, 0 for a keyframe
+} RewindFrame;
+
+typedef struct Rewind
+{
+    int capacity;           // most frames held
+    int interval;           // frames between keyframes
+    RewindFrame *frames;    // ring of capacity frames
+    int first;              // oldest frame
+    int count;              // frames held
+    int position;           // frame the machine was last pushed or seeked to, counted from first
+
+    byte *arena;
+    int arenaSize;
+    int head;               // arena offset of the next record
+    int used;               // bytes of all records held
+
+    byte *scratch;          // record being written, REWIND_RECORD_MAX bytes
+    byte *memory;           // RAM of the frame at position
+    uint64_t display[PLANE_COUNT][HEIGHT][ROW_WORDS];   // Display of the frame at position
+
+    int model;              // CHIP_MODEL_ and CHIP_QUIRKS_ of the frames held
+    int quirks;
+} Rewind;
+
+// Allocates a buffer of frames frames with a keyframe every interval frames and records in arenaSize bytes
+// returns NULL if out of memory or arenaSize is smaller than REWIND_RECORD_MAX
+Rewind *REWIND_Create(int frames, int interval, int arenaSize);
+
+void REWIND_Free(Rewind *rewind);
+
+// Drops all frames, the next push stores a keyframe
+void REWIND_Reset(Rewind *rewind);
+
+// Stores the state of chip as the newest frame, called once per frame after it ran
+// frames after a seek position are dropped first, the oldest frames are dropped when the ring or arena is full
+// a keyframe is dropped together with the frames that depend on it
+// returns 0, or -1 if the record does not fit the arena, which leaves the buffer empty
+int REWIND_Push(Rewind *rewind, Chip8 *chip);
+
+// Returns number of frames held
+int REWIND_Frames(const Rewind *rewind);
+
+// Restores chip to the frame back frames before the newest, 0 is the newest
+// frames stay in the buffer until the next push, so a seek may go forward again
+// Keyboard is left as is, model and quirks must be those of the frames
+// returns 0, or -1 if back is not in range 0 to REWIND_Frames - 1
+int REWIND_Seek(Rewind *rewind, Chip8 *chip, int back);
+
+#endif
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "library.h"
+
+void usage()
+{
+    fprintf(stderr,
+        "usage: romlib build DIRECTORY PACK   index every ROM of DIRECTORY into PACK\n"
+        "       romlib list PACK              print hash, size and name of every ROM in PACK\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 4 && strcmp(argv[1], "build") == 0)
+    {
+        int count = LIBRARY_Build(argv[2], argv[3]);
+
+        if (count == -1)
+        {
+            fprintf(stderr, "Unable to build %s from %s\n", argv[3], argv[2]);
+            return 1;
+        }
+
+        printf("%d ROMs\n", count);
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "list") == 0)
+    {
+        Library library;
+        LibraryROM rom;
+
+        if (LIBRARY_Open(&library, argv[2]) != 0)
+        {
+            fprintf(stderr, "Unable to open pack %s\n", argv[2]);
+            return 1;
+        }
+
+        for (int i = 0; i < library.count; i++)
+        {
+            LIBRARY_Get(&library, i, &rom);
+            printf("%016llx %6d %.*s%s\n", (unsigned long long) rom.hash, rom.size, rom.nameLength, rom.name,
+                rom.size > CHIP8_RAM_SIZE - LOAD_ADDRESS ? " (XO-CHIP only)" : "");
+        }
+
+        LIBRARY_Close(&library);
+        return 0;
+    }
+
+    usage();
+    return 2;
+}
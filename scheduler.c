@@ -0,0 +1,115 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "scheduler.h"
+
+#define FRAME_SECONDS   (1.0 / SCHED_FRAME_RATE)
+
+// Deadlines missed by more than this many frames are dropped
+#define MAX_LAG_FRAMES  4
+
+double SCHED_Now()
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double) counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+// Sleeps until wall clock time deadline
+static void sleepUntil(double deadline)
+{
+#ifdef _WIN32
+    double remaining = deadline - SCHED_Now();
+
+    if (remaining > 0)
+    {
+        Sleep((DWORD) (remaining * 1000));
+    }
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t) deadline;
+    ts.tv_nsec = (long) ((deadline - ts.tv_sec) * 1e9);
+
+    // absolute deadline, so an interrupted sleep just resumes
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+        ;
+#endif
+}
+
+void SCHED_Init(Scheduler *scheduler, int instructionsPerFrame, int mode)
+{
+    scheduler->instructionsPerFrame = instructionsPerFrame;
+    scheduler->mode = mode;
+    scheduler->spinSeconds = 0.002;
+    scheduler->deadline = SCHED_Now() + FRAME_SECONDS;
+    scheduler->frames = 0;
+    scheduler->lateFrames = 0;
+    scheduler->haltedFrames = 0;
+}
+
+void SCHED_RunFrame(Scheduler *scheduler, Chip8 *chip)
+{
+    // a halted machine only ticks its timers
+    if (chip->halted)
+    {
+        scheduler->haltedFrames++;
+    }
+
+    CHIP_RunFrame(chip, scheduler->instructionsPerFrame);
+    scheduler->frames++;
+}
+
+int SCHED_Idle(const Chip8 *chip)
+{
+    return chip->halted && chip->DT == 0 && chip->ST == 0;
+}
+
+void SCHED_WaitFrame(Scheduler *scheduler)
+{
+    if (scheduler->mode == SCHED_UNTHROTTLED)
+    {
+        return;
+    }
+
+    double now = SCHED_Now();
+
+    if (now >= scheduler->deadline)
+    {
+        scheduler->lateFrames++;
+
+        if (now - scheduler->deadline > MAX_LAG_FRAMES * FRAME_SECONDS)
+        {
+            scheduler->deadline = now;
+        }
+    }
+    else if (scheduler->mode == SCHED_SLEEP)
+    {
+        sleepUntil(scheduler->deadline);
+    }
+    else
+    {
+        if (scheduler->deadline - now > scheduler->spinSeconds)
+        {
+            sleepUntil(scheduler->deadline - scheduler->spinSeconds);
+        }
+
+        while (SCHED_Now() < scheduler->deadline)
+            ;
+    }
+
+    scheduler->deadline += FRAME_SECONDS;
+}
@@ -0,0 +1,43 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "chip8.h"
+
+// Frame scheduler
+// runs a fixed number of instructions per 60 Hz frame, ticks timers once per frame and paces frames to wall clock time
+
+#define SCHED_FRAME_RATE    60
+
+// Pacing modes
+#define SCHED_UNTHROTTLED   0   // no waiting, frames run back to back (batch and benchmark use)
+#define SCHED_SLEEP         1   // sleep until the frame deadline, cheapest but subject to OS timer slack
+#define SCHED_SPIN_SLEEP    2   // sleep until shortly before the deadline then spin, precise at small CPU cost
+
+typedef struct Scheduler
+{
+    int instructionsPerFrame;
+    int mode;               // SCHED_ pacing mode
+    double spinSeconds;     // how long before the deadline SCHED_SPIN_SLEEP stops sleeping
+    double deadline;        // wall clock time the next frame is due
+    long frames;            // frames run so far
+    long lateFrames;        // deadlines that had already passed when SCHED_WaitFrame was called
+    long haltedFrames;      // frames the machine spent halted, which run no instructions
+} Scheduler;
+
+// Returns monotonic wall clock time in seconds
+double SCHED_Now();
+
+void SCHED_Init(Scheduler *scheduler, int instructionsPerFrame, int mode);
+
+// Runs one frame on chip - instructionsPerFrame instructions and one timer tick
+void SCHED_RunFrame(Scheduler *scheduler, Chip8 *chip);
+
+// Returns 1 if frames of chip change nothing until a key is pressed - it waits in Fx0A or has exited,
+// and its timers are stopped, so a host may stop running frames until the next key event
+int SCHED_Idle(const Chip8 *chip);
+
+// Waits until the next frame is due according to the pacing mode
+// a host stall longer than a few frames resynchronizes the deadline instead of running a burst of catch-up frames
+void SCHED_WaitFrame(Scheduler *scheduler);
+
+#endif
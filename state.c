@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// State blob layout, all multi-byte values little endian
+//  0   magic "C8ST"
+//  4   version (2 bytes)
+//  6   model
+//  7   V0 to VF, DT, ST, SP
+//  26  PC, I (2 bytes each)
+//  30  Stack (STACK_SIZE * 2 bytes)
+//  ..  hires, planes, pitch
+//  ..  flag registers (16 bytes)
+//  ..  audio pattern (16 bytes)
+//  ..  RAM (memory size of the model - 4 KiB, 64 KiB for XO-CHIP)
+//  ..  Display (PLANE_COUNT * HEIGHT * ROW_WORDS * 8 bytes)
+//  ..  Keyboard (16 bytes)
+//  ..  RND generator state (4 bytes)
+//  ..  cycles (8 bytes)
+
+static const byte stateMagic[4] = { 'C', '8', 'S', 'T' };
+
+static byte *putWord(byte *p, word value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static const byte *getWord(const byte *p, word *value)
+{
+    *value = p[0] | p[1] << 8;
+    return p + 2;
+}
+
+// Writes size bytes of value, least significant first
+static byte *putInteger(byte *p, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        *p++ = value >> (i * 8);
+    }
+    return p;
+}
+
+static const byte *getInteger(const byte *p, uint64_t *value, int size)
+{
+    *value = 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        *value |= (uint64_t) *p++ << (i * 8);
+    }
+    return p;
+}
+
+// Returns RAM saved with a machine of model
+static int memorySize(int model)
+{
+    return model == CHIP_MODEL_XOCHIP ? RAM_SIZE : CHIP8_RAM_SIZE;
+}
+
+int CHIP_StateSize(const Chip8 *chip)
+{
+    return CHIP_STATE_HEADER + memorySize(chip->model) + CHIP_STATE_TAIL;
+}
+
+// Serializes machine state into buffer
+// returns number of bytes written (CHIP_StateSize) or -1 if buffer is too small
+int CHIP_SaveState(Chip8 *chip, byte *buffer, int size)
+{
+    byte *p = buffer;
+    int ram = memorySize(chip->model);
+
+    if (size < CHIP_StateSize(chip))
+    {
+        return -1;
+    }
+
+    memcpy(p, stateMagic, 4);
+    p = putWord(p + 4, CHIP_STATE_VERSION);
+    *p++ = chip->model;
+
+    memcpy(p, chip->V, 16);
+    p += 16;
+    *p++ = chip->DT;
+    *p++ = chip->ST;
+    *p++ = chip->SP;
+
+    p = putWord(p, chip->PC);
+    p = putWord(p, chip->I);
+
+    for (int i = 0; i < STACK_SIZE; i++)
+    {
+        p = putWord(p, chip->Stack[i]);
+    }
+
+    *p++ = chip->hires;
+    *p++ = chip->planes;
+    *p++ = chip->pitch;
+    memcpy(p, chip->flags, 16);
+    p += 16;
+    memcpy(p, chip->pattern, 16);
+    p += 16;
+
+    CHIP_ReadMemory(chip, 0, p, ram);
+    p += ram;
+
+    for (int plane = 0; plane < PLANE_COUNT; plane++)
+    {
+        for (int row = 0; row < HEIGHT; row++)
+        {
+            for (int w = 0; w < ROW_WORDS; w++)
+            {
+                p = putInteger(p, chip->Display[plane][row][w], 8);
+            }
+        }
+    }
+
+    memcpy(p, chip->Keyboard, 16);
+    p += 16;
+
+    p = putInteger(p, chip->random, 4);
+    p = putInteger(p, chip->cycles, 8);
+
+    return p - buffer;
+}
+
+// Restores machine state from a blob written by CHIP_SaveState
+// returns 0 on success or -1 if buffer does not hold a valid state of this version, chip is then unchanged
+int CHIP_LoadState(Chip8 *chip, const byte *buffer, int size)
+{
+    static const byte zeros[RAM_SIZE - CHIP8_RAM_SIZE];
+    const byte *p = buffer;
+    word version;
+
+    if (size < CHIP_STATE_HEADER || memcmp(p, stateMagic, 4) != 0)
+    {
+        return -1;
+    }
+
+    p = getWord(p + 4, &version);
+
+    int model = *p++;
+
+    if (version != CHIP_STATE_VERSION || model >= CHIP_MODEL_COUNT ||
+        size < CHIP_STATE_HEADER + memorySize(model) + CHIP_STATE_TAIL)
+    {
+        return -1;
+    }
+
+    // registers the engines index with are checked before anything is restored
+    int sp = p[16 + 2];
+    int hires = p[16 + 3 + 4 + STACK_SIZE * 2];
+    int planes = p[16 + 3 + 4 + STACK_SIZE * 2 + 1];
+
+    if (sp > STACK_SIZE || hires > 1 || planes > (1 << PLANE_COUNT) - 1)
+    {
+        return -1;
+    }
+
+    // the blob holds no quirks profile, a machine of another model gets the default of the model
+    if (model != chip->model)
+    {
+        chip->model = model;
+        CHIP_SetQuirks(chip, -1);
+    }
+
+    chip->memorySize = memorySize(model);
+
+    memcpy(chip->V, p, 16);
+    p += 16;
+    chip->DT = *p++;
+    chip->ST = *p++;
+    chip->SP = *p++;
+
+    p = getWord(p, &chip->PC);
+    p = getWord(p, &chip->I);
+
+    for (int i = 0; i < STACK_SIZE; i++)
+    {
+        p = getWord(p, &chip->Stack[i]);
+    }
+
+    chip->hires = *p++;
+    chip->planes = *p++;
+    chip->pitch = *p++;
+    memcpy(chip->flags, p, 16);
+    p += 16;
+    memcpy(chip->pattern, p, 16);
+    p += 16;
+
+    // only pages that differ from the current contents are written, unchanged pages stay shared
+    // RAM above a smaller model is cleared, so it does not keep data of an earlier program
+    CHIP_WriteMemory(chip, 0, p, chip->memorySize);
+    p += chip->memorySize;
+
+    if (chip->memorySize < RAM_SIZE)
+    {
+        CHIP_WriteMemory(chip, chip->memorySize, zeros, RAM_SIZE - chip->memorySize);
+    }
+
+    uint64_t value;
+
+    for (int plane = 0; plane < PLANE_COUNT; plane++)
+    {
+        for (int row = 0; row < HEIGHT; row++)
+        {
+            for (int w = 0; w < ROW_WORDS; w++)
+            {
+                p = getInteger(p, &chip->Display[plane][row][w], 8);
+            }
+        }
+    }
+
+    memcpy(chip->Keyboard, p, 16);
+    p += 16;
+
+    p = getInteger(p, &value, 4);
+    chip->random = value;
+    p = getInteger(p, &chip->cycles, 8);
+
+    chip->drawFlag = 1;
+    chip->dirtyRows = ~0ULL;
+
+    // a halting instruction halts the machine again when it runs
+    chip->halted = CHIP_RUNNING;
+    chip->fault = CHIP_FAULT_NONE;
+
+    return 0;
+}
+
+// Writes machine state to file
+// returns 0 on success or -1 on error
+int CHIP_SaveStateFile(Chip8 *chip, const char *fname)
+{
+    // XO-CHIP states are too big for the stack
+    byte *buffer = malloc(CHIP_STATE_SIZE);
+    FILE *fp = fopen(fname, "wb");
+
+    if (buffer == NULL || fp == NULL)
+    {
+        free(buffer);
+
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+
+        return -1;
+    }
+
+    int size = CHIP_SaveState(chip, buffer, CHIP_STATE_SIZE);
+    int written = fwrite(buffer, 1, size, fp);
+
+    free(buffer);
+
+    return (fclose(fp) == 0 && written == size) ? 0 : -1;
+}
+
+// Reads machine state from file written by CHIP_SaveStateFile
+// returns 0 on success or -1 on error
+int CHIP_LoadStateFile(Chip8 *chip, const char *fname)
+{
+    byte *buffer = malloc(CHIP_STATE_SIZE);
+    FILE *fp = fopen(fname, "rb");
+
+    if (buffer == NULL || fp == NULL)
+    {
+        free(buffer);
+
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+
+        return -1;
+    }
+
+    int size = fread(buffer, 1, CHIP_STATE_SIZE, fp);
+    fclose(fp);
+
+    int status = CHIP_LoadState(chip, buffer, size);
+
+    free(buffer);
+
+    return status;
+}
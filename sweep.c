@@ -0,0 +1,701 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "chip8.h"
+#include "batch.h"
+#include "scheduler.h"
+#include "library.h"
+
+// ROM compatibility sweep
+// runs every ROM of a directory for a fixed budget on a pool of threads, hashes Display at checkpoints
+// and compares the hashes against a golden database written by an earlier sweep with --update
+
+// Budget when not given
+#define DEFAULT_FRAMES      1200
+#define DEFAULT_IPF         10
+#define DEFAULT_CHECKPOINT  60
+
+// Slowest ROMs listed after the results
+#define SLOWEST_COUNT       5
+
+// Result of a ROM compared with the golden database
+#define SWEEP_NEW           0   // ROM not in the database
+#define SWEEP_MATCH         1
+#define SWEEP_MISMATCH      2
+#define SWEEP_LOAD_ERROR    3
+
+typedef struct Options
+{
+    char *directory;
+    char *golden;       // golden database, NULL to only run the ROMs
+    int update;         // write the hashes of this sweep to the golden database
+    long frames;
+    int ipf;            // instructions per frame
+    int checkpoint;     // frames between display hashes
+    int dispatch;
+    int threads;
+    uint32_t seed;
+} Options;
+
+// Sweep of one ROM
+typedef struct Result
+{
+    char *name;                 // file name in the directory
+    uint64_t romHash;           // LIBRARY_Hash of the file
+    int size;                   // bytes of the file
+    int truncated;              // file is bigger than the memory of the model
+    int model;
+    uint64_t *hashes;           // Display hash at every checkpoint
+    int hashCount;
+    int fault;                  // CHIP_FAULT_ that halted the machine at the end
+    long faultFrame;            // frame the machine faulted in
+    CHIP_Diagnostic diagnostics[CHIP_FAULT_COUNT];
+    double seconds;
+    int status;                 // SWEEP_ result
+    long mismatchFrame;         // checkpoint of the first hash that differs from the database
+} Result;
+
+// ROM of the golden database
+typedef struct Golden
+{
+    uint64_t romHash;
+    int model;              // the same ROM may run as several models
+    uint64_t *hashes;
+    int hashCount;
+    char *name;
+} Golden;
+
+typedef struct Sweep
+{
+    Options *options;
+    Result *results;
+    int count;
+} Sweep;
+
+void usage()
+{
+    fprintf(stderr,
+        "usage: chip8-sweep DIRECTORY [options]\n"
+        "  --golden F       compare display hashes with golden database F\n"
+        "  --update         write the hashes of this sweep to the golden database\n"
+        "  --frames N       run N frames of every ROM (default %d)\n"
+        "  --ipf N          instructions per frame (default %d)\n"
+        "  --checkpoint N   frames between display hashes (default %d)\n"
+        "  --dispatch NAME  table, nibble, threaded, cached or blocks\n"
+        "  --threads N      worker threads (default all cores)\n"
+        "  --seed N         seed of the RND generator (default 1)\n"
+        "ROMs ending in .sc8 run as SUPER-CHIP, .xo8 as XO-CHIP, all others as CHIP-8\n",
+        DEFAULT_FRAMES, DEFAULT_IPF, DEFAULT_CHECKPOINT);
+    exit(2);
+}
+
+// Prints that name is no known kind of setting and exits
+void unknown(const char *kind, const char *name)
+{
+    fprintf(stderr, "Unknown %s: %s\n", kind, name);
+    exit(2);
+}
+
+// Returns model of a ROM from its extension - .sc8 for SUPER-CHIP, .xo8 for XO-CHIP, CHIP-8 otherwise
+int modelFromName(const char *fname)
+{
+    const char *extension = strrchr(fname, '.');
+
+    if (extension != NULL && strcmp(extension, ".sc8") == 0)
+        return CHIP_MODEL_SCHIP;
+
+    if (extension != NULL && strcmp(extension, ".xo8") == 0)
+        return CHIP_MODEL_XOCHIP;
+
+    return CHIP_MODEL_CHIP8;
+}
+
+static int compareNames(const void *a, const void *b)
+{
+    return strcmp(((const Result *) a)->name, ((const Result *) b)->name);
+}
+
+// Collects the file names of directory sorted by name, hidden files left out
+// returns number of ROMs or -1 on error
+int listROMs(const char *directory, Result **results)
+{
+    DIR *dir = opendir(directory);
+    struct dirent *item;
+    int count = 0, capacity = 0;
+
+    *results = NULL;
+
+    if (dir == NULL)
+    {
+        return -1;
+    }
+
+    while ((item = readdir(dir)) != NULL)
+    {
+        if (item->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            Result *grown = realloc(*results, capacity * sizeof(Result));
+
+            if (grown == NULL)
+            {
+                closedir(dir);
+                return -1;
+            }
+
+            *results = grown;
+        }
+
+        memset(&(*results)[count], 0, sizeof(Result));
+        (*results)[count].name = malloc(strlen(item->d_name) + 1);
+
+        if ((*results)[count].name == NULL)
+        {
+            closedir(dir);
+            return -1;
+        }
+
+        strcpy((*results)[count].name, item->d_name);
+        count++;
+    }
+
+    closedir(dir);
+
+    if (count > 0)
+    {
+        qsort(*results, count, sizeof(Result), compareNames);
+    }
+
+    return count;
+}
+
+// Runs one ROM for the whole budget, hashing Display every checkpoint frames
+void sweepROM(int index, void *context)
+{
+    Sweep *sweep = context;
+    Options *options = sweep->options;
+    Result *result = &sweep->results[index];
+    char path[4096];
+    MappedFile file;
+    Chip8 *chip = calloc(1, sizeof(Chip8));
+
+    snprintf(path, sizeof(path), "%s/%s", options->directory, result->name);
+
+    result->hashes = malloc((options->frames / options->checkpoint + 1) * sizeof(uint64_t));
+    result->model = modelFromName(result->name);
+
+    // directories and other special files cannot be mapped and are reported as load errors
+    if (chip == NULL || result->hashes == NULL || MAP_Open(&file, path) != 0)
+    {
+        result->status = SWEEP_LOAD_ERROR;
+        free(chip);
+        return;
+    }
+
+    if (file.size > 0x7FFFFFFF)
+    {
+        result->status = SWEEP_LOAD_ERROR;
+        MAP_Close(&file);
+        free(chip);
+        return;
+    }
+
+    double start = SCHED_Now();
+
+    result->romHash = LIBRARY_Hash(file.data, file.size);
+    result->size = (int) file.size;
+
+    CHIP_Initalize(chip);
+    CHIP_SetModel(chip, result->model);
+    CHIP_LoadProgramMemory(chip, file.data, result->size);
+    result->truncated = result->size > CHIP_ProgramSize(chip);
+    CHIP_SetDispatch(chip, options->dispatch);
+    CHIP_Seed(chip, options->seed);
+    MAP_Close(&file);
+
+    for (long frame = 1; frame <= options->frames; frame++)
+    {
+        CHIP_RunFrame(chip, options->ipf);
+
+        if (chip->fault != CHIP_FAULT_NONE && result->fault == CHIP_FAULT_NONE)
+        {
+            result->fault = chip->fault;
+            result->faultFrame = frame;
+        }
+
+        if (frame % options->checkpoint == 0)
+        {
+            result->hashes[result->hashCount++] = CHIP_HashDisplay(chip);
+        }
+    }
+
+    result->seconds = SCHED_Now() - start;
+    memcpy(result->diagnostics, chip->diagnostics, sizeof(result->diagnostics));
+
+    CHIP_Free(chip);
+    free(chip);
+}
+
+static int compareGolden(const void *a, const void *b)
+{
+    const Golden *x = a;
+    const Golden *y = b;
+
+    if (x->romHash != y->romHash)
+    {
+        return x->romHash < y->romHash ? -1 : 1;
+    }
+
+    return x->model - y->model;
+}
+
+// Golden database
+//  # comment lines
+//  settings frames ipf checkpoint seed
+//  rom-hash model count hash... name, one line per ROM and model
+// settings, CHIP_MODEL_ and counts are decimal, hashes hex
+
+// Reads a line of any length into line, which is grown as needed
+// returns 0 or -1 at the end of the file or on error
+static int readLine(FILE *fp, char **line, size_t *capacity)
+{
+    size_t length = 0;
+
+    for (;;)
+    {
+        if (*capacity - length < 2)
+        {
+            size_t grown = *capacity ? *capacity * 2 : 4096;
+            char *buffer = realloc(*line, grown);
+
+            if (buffer == NULL)
+            {
+                return -1;
+            }
+
+            *line = buffer;
+            *capacity = grown;
+        }
+
+        if (fgets(*line + length, (int) (*capacity - length), fp) == NULL)
+        {
+            return length > 0 ? 0 : -1;
+        }
+
+        length += strlen(*line + length);
+
+        if ((*line)[length - 1] == '\n')
+        {
+            return 0;
+        }
+    }
+}
+
+// Reads golden database fname into golden, settings must match options
+// with --update a database of other settings is dropped, the sweep then writes it anew
+// returns number of ROMs, 0 if the file does not exist, or -1 on error
+int loadGolden(const char *fname, const Options *options, Golden **golden)
+{
+    FILE *fp = fopen(fname, "r");
+    char *line = NULL;
+    size_t capacity = 0;
+    int count = 0, entries = 0;
+    int status = 0, dropped = 0;
+
+    *golden = NULL;
+
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    // a line holds one hash per checkpoint, it has no length limit
+    while (status == 0 && !dropped && readLine(fp, &line, &capacity) == 0)
+    {
+        long frames;
+        int ipf, checkpoint;
+        unsigned long seed;
+        unsigned long long romHash;
+        int model, hashCount, used;
+
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (line[0] == '#' || line[0] == '\0')
+        {
+            continue;
+        }
+
+        if (sscanf(line, "settings %ld %d %d %lu", &frames, &ipf, &checkpoint, &seed) == 4)
+        {
+            if (frames != options->frames || ipf != options->ipf || checkpoint != options->checkpoint ||
+                seed != options->seed)
+            {
+                fprintf(stderr, "%s was written with --frames %ld --ipf %d --checkpoint %d --seed %lu%s\n",
+                    fname, frames, ipf, checkpoint, seed, options->update ? ", replacing it" : "");
+                dropped = options->update;
+                status = dropped ? 0 : -1;
+            }
+
+            continue;
+        }
+
+        if (sscanf(line, "%llx %d %d%n", &romHash, &model, &hashCount, &used) != 3 || hashCount < 0 ||
+            hashCount > 0x100000)
+        {
+            status = -1;
+            break;
+        }
+
+        if (count == entries)
+        {
+            entries = entries ? entries * 2 : 256;
+            Golden *grown = realloc(*golden, entries * sizeof(Golden));
+
+            if (grown == NULL)
+            {
+                status = -1;
+                break;
+            }
+
+            *golden = grown;
+        }
+
+        Golden *entry = &(*golden)[count++];
+        char *p = line + used;
+
+        entry->romHash = romHash;
+        entry->model = model;
+        entry->hashCount = hashCount;
+        entry->hashes = malloc((hashCount + 1) * sizeof(uint64_t));
+        entry->name = NULL;
+
+        for (int i = 0; entry->hashes != NULL && i < hashCount; i++)
+        {
+            unsigned long long hash;
+
+            if (sscanf(p, " %llx%n", &hash, &used) != 1)
+            {
+                status = -1;
+                break;
+            }
+
+            entry->hashes[i] = hash;
+            p += used;
+        }
+
+        if (entry->hashes == NULL || (entry->name = malloc(strlen(p) + 1)) == NULL)
+        {
+            status = -1;
+            break;
+        }
+
+        strcpy(entry->name, *p == ' ' ? p + 1 : p);
+    }
+
+    free(line);
+    fclose(fp);
+
+    // hashes of other settings would never match
+    if (dropped)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            free((*golden)[i].hashes);
+            free((*golden)[i].name);
+        }
+
+        free(*golden);
+        *golden = NULL;
+        count = 0;
+    }
+
+    if (status == 0 && count > 0)
+    {
+        qsort(*golden, count, sizeof(Golden), compareGolden);
+    }
+
+    return status == 0 ? count : -1;
+}
+
+// Writes the ROMs of results and the ROMs of golden that were not swept to fname
+// returns 0 on success or -1 on error
+int saveGolden(const char *fname, const Options *options, const Sweep *sweep, const Golden *golden, int goldenCount)
+{
+    FILE *fp = fopen(fname, "w");
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    fprintf(fp, "# chip8-sweep golden database\n");
+    fprintf(fp, "settings %ld %d %d %lu\n", options->frames, options->ipf, options->checkpoint,
+        (unsigned long) options->seed);
+
+    for (int i = 0; i < sweep->count; i++)
+    {
+        const Result *result = &sweep->results[i];
+
+        if (result->status == SWEEP_LOAD_ERROR)
+        {
+            continue;
+        }
+
+        fprintf(fp, "%016llx %d %d", (unsigned long long) result->romHash, result->model, result->hashCount);
+
+        for (int n = 0; n < result->hashCount; n++)
+        {
+            fprintf(fp, " %016llx", (unsigned long long) result->hashes[n]);
+        }
+
+        fprintf(fp, " %s\n", result->name);
+    }
+
+    for (int i = 0; i < goldenCount; i++)
+    {
+        int swept = 0;
+
+        for (int n = 0; n < sweep->count && !swept; n++)
+        {
+            swept = sweep->results[n].status != SWEEP_LOAD_ERROR && sweep->results[n].romHash == golden[i].romHash &&
+                sweep->results[n].model == golden[i].model;
+        }
+
+        if (swept)
+        {
+            continue;
+        }
+
+        fprintf(fp, "%016llx %d %d", (unsigned long long) golden[i].romHash, golden[i].model, golden[i].hashCount);
+
+        for (int n = 0; n < golden[i].hashCount; n++)
+        {
+            fprintf(fp, " %016llx", (unsigned long long) golden[i].hashes[n]);
+        }
+
+        fprintf(fp, " %s\n", golden[i].name);
+    }
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+// Sets status of result from the golden database
+void compareResult(Result *result, const Golden *golden, int goldenCount, int checkpoint)
+{
+    Golden key;
+
+    if (result->status == SWEEP_LOAD_ERROR)
+    {
+        return;
+    }
+
+    key.romHash = result->romHash;
+    key.model = result->model;
+
+    const Golden *entry = goldenCount > 0 ? bsearch(&key, golden, goldenCount, sizeof(Golden), compareGolden) : NULL;
+
+    if (entry == NULL)
+    {
+        result->status = SWEEP_NEW;
+        return;
+    }
+
+    result->status = SWEEP_MATCH;
+
+    for (int i = 0; i < result->hashCount || i < entry->hashCount; i++)
+    {
+        if (i >= result->hashCount || i >= entry->hashCount || result->hashes[i] != entry->hashes[i])
+        {
+            result->status = SWEEP_MISMATCH;
+            result->mismatchFrame = (long) (i + 1) * checkpoint;
+            return;
+        }
+    }
+}
+
+// Prints one line per ROM - status, runtime, name, then the faults the machine counted
+void printResult(const Result *result)
+{
+    static const char *statusNames[] = { "new", "ok", "MISMATCH", "ERROR" };
+
+    printf("%-8s %9.3f ms  %-7s %s", statusNames[result->status], result->seconds * 1000,
+        CHIP_ModelName(result->model), result->name);
+
+    if (result->status == SWEEP_MISMATCH)
+    {
+        printf("  differs at frame %ld", result->mismatchFrame);
+    }
+
+    if (result->status == SWEEP_LOAD_ERROR)
+    {
+        printf("  unable to read file");
+    }
+
+    if (result->truncated)
+    {
+        printf("  program truncated");
+    }
+
+    putchar('\n');
+
+    for (int fault = 1; fault < CHIP_FAULT_COUNT; fault++)
+    {
+        const CHIP_Diagnostic *diagnostic = &result->diagnostics[fault];
+
+        if (diagnostic->count > 0)
+        {
+            printf("         %s x%u, first at 0x%03x (%04x)\n", CHIP_FaultName(fault), diagnostic->count,
+                diagnostic->address, diagnostic->instruction);
+        }
+    }
+
+    if (result->fault != CHIP_FAULT_NONE)
+    {
+        printf("         halted at frame %ld\n", result->faultFrame);
+    }
+}
+
+static int compareSeconds(const void *a, const void *b)
+{
+    double x = (*(const Result **) a)->seconds;
+    double y = (*(const Result **) b)->seconds;
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options = { NULL, NULL, 0, DEFAULT_FRAMES, DEFAULT_IPF, DEFAULT_CHECKPOINT, CHIP_DISPATCH_TABLE, 0, 1 };
+    Sweep sweep;
+    Golden *golden = NULL;
+    int goldenCount = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            options.update = 1;
+        else if (argv[i][0] != '-')
+            options.directory = argv[i];
+        else if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argv[i], "--golden") == 0)
+            options.golden = argv[++i];
+        else if (strcmp(argv[i], "--frames") == 0)
+            options.frames = atol(argv[++i]);
+        else if (strcmp(argv[i], "--ipf") == 0)
+            options.ipf = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--checkpoint") == 0)
+            options.checkpoint = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dispatch") == 0)
+        {
+            if ((options.dispatch = CHIP_DispatchByName(argv[++i])) < 0)
+                unknown("dispatch backend", argv[i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0)
+            options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0)
+            options.seed = strtoul(argv[++i], NULL, 0);
+        else
+            usage();
+    }
+
+    if (options.directory == NULL || options.frames <= 0 || options.ipf <= 0 || options.checkpoint <= 0 ||
+        (options.update && options.golden == NULL))
+    {
+        usage();
+    }
+
+    sweep.options = &options;
+    sweep.count = listROMs(options.directory, &sweep.results);
+
+    if (sweep.count == -1)
+    {
+        fprintf(stderr, "Unable to read directory %s\n", options.directory);
+        return 1;
+    }
+
+    if (options.golden != NULL && (goldenCount = loadGolden(options.golden, &options, &golden)) == -1)
+    {
+        fprintf(stderr, "Unable to read golden database %s\n", options.golden);
+        return 1;
+    }
+
+    double start = SCHED_Now();
+    BATCH_ForEach(sweep.count, options.threads, sweepROM, &sweep);
+    double elapsed = SCHED_Now() - start;
+
+    int counts[4] = { 0 };
+    int faulted = 0;
+    Result **slowest = malloc((sweep.count + 1) * sizeof(Result *));
+
+    for (int i = 0; i < sweep.count; i++)
+    {
+        Result *result = &sweep.results[i];
+
+        compareResult(result, golden, goldenCount, options.checkpoint);
+        printResult(result);
+
+        counts[result->status]++;
+        faulted += result->fault != CHIP_FAULT_NONE;
+
+        if (slowest != NULL)
+        {
+            slowest[i] = result;
+        }
+    }
+
+    if (slowest != NULL && sweep.count > 0)
+    {
+        qsort(slowest, sweep.count, sizeof(Result *), compareSeconds);
+        printf("\nslowest\n");
+
+        for (int i = 0; i < sweep.count && i < SLOWEST_COUNT; i++)
+        {
+            printf("%9.3f ms  %s\n", slowest[i]->seconds * 1000, slowest[i]->name);
+        }
+    }
+
+    printf("\n%d ROMs, %d ok, %d mismatched, %d new, %d unreadable, %d faulted\n",
+        sweep.count, counts[SWEEP_MATCH], counts[SWEEP_MISMATCH], counts[SWEEP_NEW], counts[SWEEP_LOAD_ERROR], faulted);
+    printf("dispatch %s\nframes %ld\nseconds %.6f\n", CHIP_DispatchName(options.dispatch), options.frames, elapsed);
+
+    int status = counts[SWEEP_MISMATCH] > 0 ? 1 : 0;
+
+    if (options.update)
+    {
+        if (saveGolden(options.golden, &options, &sweep, golden, goldenCount) == -1)
+        {
+            fprintf(stderr, "Unable to write golden database %s\n", options.golden);
+            status = 1;
+        }
+        else
+        {
+            printf("updated %s\n", options.golden);
+        }
+    }
+
+    for (int i = 0; i < goldenCount; i++)
+    {
+        free(golden[i].hashes);
+        free(golden[i].name);
+    }
+
+    for (int i = 0; i < sweep.count; i++)
+    {
+        free(sweep.results[i].hashes);
+        free(sweep.results[i].name);
+    }
+
+    free(golden);
+    free(slowest);
+    free(sweep.results);
+
+    return status;
+}
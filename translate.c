@@ -0,0 +1,694 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "analysis.h"
+#include "quirks.h"
+
+// Ahead-of-time translator
+// writes the code of a ROM found by the static analysis as C source for the runtime in aot.c, see aot.h
+//
+// every instruction of a block is emitted twice - a fast copy that runs when the whole rest of the block fits
+// the instruction budget, and a checked copy that counts the budget down before every instruction
+// every instruction address gets an entry that picks one of them, so a budget may end anywhere in a block
+
+typedef struct Translator
+{
+    const Analysis *analysis;
+    const Quirks *quirks;
+    FILE *fp;
+    int loop;   // start of the block being written if it jumps back to it, -1 otherwise
+} Translator;
+
+void usage()
+{
+    fprintf(stderr,
+        "usage: chip8-translate ROM [options]\n"
+        "  --model NAME     chip8, schip or xochip (default chip8)\n"
+        "  --quirks NAME    vip, chip48, schip or modern (default of the model)\n"
+        "  -o F             write the C source to F instead of stdout\n");
+    exit(2);
+}
+
+// Prints that name is no known kind of setting and exits
+void unknown(const char *kind, const char *name)
+{
+    fprintf(stderr, "Unknown %s: %s\n", kind, name);
+    exit(2);
+}
+
+// Writes a jump to target, straight to its block when it starts one
+static void emitJump(Translator *t, int target)
+{
+    // PC wraps around after the last address like in the interpreter
+    target &= RAM_SIZE - 1;
+
+    // the block running cannot have gone stale, a store into it leaves through dispatch
+    if (target == t->loop)
+    {
+        fprintf(t->fp, "    goto L_%03x;\n", target);
+    }
+    else if (ANALYSIS_FindBlock(t->analysis, target) >= 0)
+    {
+        fprintf(t->fp, "    goto E_%03x;\n", target);
+    }
+    else
+    {
+        fprintf(t->fp, "    pc = 0x%03x;\n    goto dispatch;\n", target);
+    }
+}
+
+// Writes a run of the instruction at address on the interpreter
+// only the registers it reads are stored and only the ones it writes are loaded again
+static void emitStep(Translator *t, int address, const CHIP_Op *op)
+{
+    FILE *fp = t->fp;
+
+    if (op->op == OP_DRW)
+    {
+        fprintf(fp, "    chip->V[%d] = V%X;\n    chip->V[%d] = V%X;\n", op->x, op->x, op->y, op->y);
+    }
+
+    if (op->op == OP_DRW || op->op == OP_LDAUD)
+    {
+        fprintf(fp, "    chip->I = I;\n");
+    }
+
+    fprintf(fp, "    chip->PC = 0x%03x;\n    CHIP_Step(chip);\n", address);
+
+    if (op->op == OP_DRW)
+    {
+        fprintf(fp, "    VF = chip->V[15];\n");
+    }
+
+    // Fx0A halts until a key is pressed, Fxx02 faults past the memory of the model
+    if (op->op == OP_LDK)
+    {
+        fprintf(fp, "    V%X = chip->V[%d];\n", op->x, op->x);
+    }
+
+    if (op->op == OP_LDK || op->op == OP_LDAUD)
+    {
+        fprintf(fp, "    if (chip->halted)\n    {\n        pc = chip->PC;\n        goto done;\n    }\n");
+    }
+}
+
+// Writes the check of a store of size bytes at I that leaves the block if it hit code
+// refund is the number of instructions of the block after the store taken from the budget in advance
+static void emitWritten(Translator *t, const char *size, int next, int refund, int increment)
+{
+    fprintf(t->fp, "    if (AOT_Written(machine, I, %s))\n    {\n", size);
+
+    if (increment)
+    {
+        fprintf(t->fp, "        I += %d;\n", increment);
+    }
+
+    if (refund)
+    {
+        fprintf(t->fp, "        left += %d;\n", refund);
+    }
+
+    fprintf(t->fp, "        pc = 0x%03x;\n        goto dispatch;\n    }\n", next);
+}
+
+// Writes a store of count bytes at I, values is the comma separated list of their expressions
+// refund is as in emitWritten, a page that could not be copied leaves the instruction to the backend to fault
+static void emitStore(Translator *t, int address, int refund, int count, const char *values)
+{
+    FILE *fp = t->fp;
+
+    fprintf(fp, "    {\n        const byte data[%d] = { %s };\n\n", count, values);
+    fprintf(fp, "        if (CHIP_StoreMemory(chip, I, data, %d) < 0)\n        {\n", count);
+    fprintf(fp, "            left += %d;\n            pc = 0x%03x;\n            goto slow;\n        }\n    }\n",
+        refund + 1, address);
+}
+
+// Writes the statements of the instruction at address
+// returns 1 if control never falls through to the next instruction
+static int emitInstruction(Translator *t, int address, int refund)
+{
+    FILE *fp = t->fp;
+    CHIP_Op op = ANALYSIS_Decode(t->analysis, address);
+    int next = address + ANALYSIS_InstructionSize(t->analysis, address);
+    int x = op.x, y = op.y;
+    int source = t->quirks->shiftVy ? y : x;
+    int increment = t->quirks->memoryI ? x + t->quirks->memoryI - 1 : 0;
+    int memorySize = t->analysis->memorySize;
+    char values[64];
+    int length = 0;
+
+    switch (op.op)
+    {
+        case OP_NOP:
+            return 0;
+
+        case OP_LD:
+            fprintf(fp, "    V%X = 0x%02x;\n", x, op.kk);
+            return 0;
+
+        case OP_ADD:
+            fprintf(fp, "    V%X += 0x%02x;\n", x, op.kk);
+            return 0;
+
+        case OP_LDR:
+            fprintf(fp, "    V%X = V%X;\n", x, y);
+            return 0;
+
+        case OP_OR: case OP_AND: case OP_XOR:
+            fprintf(fp, "    V%X %c= V%X;\n", x, op.op == OP_OR ? '|' : op.op == OP_AND ? '&' : '^', y);
+
+            if (t->quirks->vfReset)
+            {
+                fprintf(fp, "    VF = 0;\n");
+            }
+            return 0;
+
+        case OP_ADDR:
+            fprintf(fp, "    { byte f = V%X + V%X > 0xFF; V%X += V%X; VF = f; }\n", x, y, x, y);
+            return 0;
+
+        case OP_SUB:
+            fprintf(fp, "    { byte f = V%X > V%X; V%X -= V%X; VF = f; }\n", x, y, x, y);
+            return 0;
+
+        case OP_SUBN:
+            fprintf(fp, "    { byte f = V%X > V%X; V%X = V%X - V%X; VF = f; }\n", y, x, x, y, x);
+            return 0;
+
+        case OP_SHR:
+            fprintf(fp, "    { byte f = V%X & 0x1; V%X = V%X >> 1; VF = f; }\n", source, x, source);
+            return 0;
+
+        case OP_SHL:
+            fprintf(fp, "    { byte f = V%X >> 7; V%X = V%X << 1; VF = f; }\n", source, x, source);
+            return 0;
+
+        case OP_LDI:
+            fprintf(fp, "    I = 0x%03x;\n", op.nnn);
+            return 0;
+
+        case OP_LDIL:
+            fprintf(fp, "    I = 0x%04x;\n", t->analysis->memory[(address + 2) & (RAM_SIZE - 1)] << 8 |
+                t->analysis->memory[(address + 3) & (RAM_SIZE - 1)]);
+            return 0;
+
+        case OP_ADDI:
+            fprintf(fp, "    I += V%X;\n", x);
+            return 0;
+
+        case OP_LDCH:
+            fprintf(fp, "    I = V%X * 5;\n", x);
+            return 0;
+
+        case OP_LDHF:
+            fprintf(fp, "    I = BIG_FONT_ADDRESS + (V%X & 0xF) * 10;\n", x);
+            return 0;
+
+        case OP_RND:
+            fprintf(fp, "    V%X = CHIP_Random(chip) & 0x%02x;\n", x, op.kk);
+            return 0;
+
+        case OP_LDDT:
+            fprintf(fp, "    V%X = chip->DT;\n", x);
+            return 0;
+
+        case OP_SETDT:
+            fprintf(fp, "    chip->DT = V%X;\n", x);
+            return 0;
+
+        case OP_SETST:
+            fprintf(fp, "    chip->ST = V%X;\n", x);
+            return 0;
+
+        case OP_SAVEF:
+            for (int i = 0; i <= x; i++)
+            {
+                fprintf(fp, "    chip->flags[%d] = V%X;\n", i, i);
+            }
+            return 0;
+
+        case OP_LOADF:
+            for (int i = 0; i <= x; i++)
+            {
+                fprintf(fp, "    V%X = chip->flags[%d];\n", i, i);
+            }
+            return 0;
+
+        case OP_PLANE:
+            fprintf(fp, "    chip->planes = %d;\n", x & 3);
+            return 0;
+
+        case OP_PITCH:
+            fprintf(fp, "    chip->pitch = V%X;\n", x);
+            return 0;
+
+        // accesses past the memory of the model are left to the interpreter to fault
+        case OP_BCD:
+            fprintf(fp, "    if (I + 3 > 0x%x)\n        STEP(0x%03x);\n", memorySize, address);
+            snprintf(values, sizeof(values), "V%X / 100, (V%X %% 100) / 10, V%X %% 10", x, x, x);
+            emitStore(t, address, refund, 3, values);
+            fprintf(fp, "    CHIP_MemoryWritten(chip, I, 3);\n");
+            emitWritten(t, "3", next, refund, 0);
+            return 0;
+
+        case OP_PUSHR:
+        {
+            char size[8];
+
+            snprintf(size, sizeof(size), "%d", x + 1);
+            fprintf(fp, "    if (I + %d > 0x%x)\n        STEP(0x%03x);\n", x + 1, memorySize, address);
+
+            for (int i = 0; i <= x; i++)
+            {
+                length += snprintf(values + length, sizeof(values) - length, "%sV%X", i ? ", " : "", i);
+            }
+
+            emitStore(t, address, refund, x + 1, values);
+
+            fprintf(fp, "    CHIP_MemoryWritten(chip, I, %d);\n", x + 1);
+            emitWritten(t, size, next, refund, increment);
+
+            if (increment)
+            {
+                fprintf(fp, "    I += %d;\n", increment);
+            }
+            return 0;
+        }
+
+        case OP_POPR:
+            fprintf(fp, "    if (I + %d > 0x%x)\n        STEP(0x%03x);\n", x + 1, memorySize, address);
+
+            for (int i = 0; i <= x; i++)
+            {
+                fprintf(fp, "    V%X = CHIP_ReadByte(chip, I + %d);\n", i, i);
+            }
+
+            if (increment)
+            {
+                fprintf(fp, "    I += %d;\n", increment);
+            }
+            return 0;
+
+        case OP_SAVER: case OP_LOADR:
+        {
+            int step = x <= y ? 1 : -1;
+            int count = (x <= y ? y - x : x - y) + 1;
+
+            fprintf(fp, "    if (I + %d > 0x%x)\n        STEP(0x%03x);\n", count, memorySize, address);
+
+            if (op.op == OP_LOADR)
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    fprintf(fp, "    V%X = CHIP_ReadByte(chip, I + %d);\n", x + i * step, i);
+                }
+                return 0;
+            }
+
+            char size[8];
+
+            snprintf(size, sizeof(size), "%d", count);
+            for (int i = 0; i < count; i++)
+            {
+                length += snprintf(values + length, sizeof(values) - length, "%sV%X", i ? ", " : "", x + i * step);
+            }
+
+            emitStore(t, address, refund, count, values);
+
+            fprintf(fp, "    CHIP_MemoryWritten(chip, I, %d);\n", count);
+            emitWritten(t, size, next, refund, 0);
+            return 0;
+        }
+
+        case OP_JP:
+            emitJump(t, op.nnn);
+            return 1;
+
+        case OP_CALL:
+            fprintf(fp, "    if (chip->SP >= STACK_SIZE)\n        STEP(0x%03x);\n", address);
+            fprintf(fp, "    chip->Stack[chip->SP++] = 0x%03x;\n", next);
+            emitJump(t, op.nnn);
+            return 1;
+
+        case OP_RET:
+            fprintf(fp, "    if (chip->SP == 0 || chip->SP > STACK_SIZE)\n        STEP(0x%03x);\n", address);
+            fprintf(fp, "    pc = chip->Stack[--chip->SP];\n    goto dispatch;\n");
+            return 1;
+
+        case OP_JPV:
+            fprintf(fp, "    pc = 0x%03x + V%X;\n    goto dispatch;\n", op.nnn, t->quirks->jumpVx ? x : 0);
+            return 1;
+
+        case OP_SE: case OP_SNE: case OP_SER: case OP_SNER: case OP_SKP: case OP_SKPN:
+        {
+            char condition[64];
+
+            switch (op.op)
+            {
+                case OP_SE:     snprintf(condition, sizeof(condition), "V%X == 0x%02x", x, op.kk); break;
+                case OP_SNE:    snprintf(condition, sizeof(condition), "V%X != 0x%02x", x, op.kk); break;
+                case OP_SER:    snprintf(condition, sizeof(condition), "V%X == V%X", x, y); break;
+                case OP_SNER:   snprintf(condition, sizeof(condition), "V%X != V%X", x, y); break;
+                case OP_SKP:    snprintf(condition, sizeof(condition), "chip->Keyboard[V%X & 0xF]", x); break;
+                default:        snprintf(condition, sizeof(condition), "!chip->Keyboard[V%X & 0xF]", x); break;
+            }
+
+            fprintf(fp, "    if (%s)\n    {\n", condition);
+
+            // XO-CHIP skips both words of F000 nnnn, the next instruction may have been overwritten since
+            // unless its block is still live
+            if (t->analysis->model == CHIP_MODEL_XOCHIP)
+            {
+                int skipped = ANALYSIS_FindBlock(t->analysis, next);
+                int target = next + ANALYSIS_InstructionSize(t->analysis, next);
+
+                if (skipped >= 0 && ANALYSIS_FindBlock(t->analysis, target) >= 0)
+                {
+                    fprintf(fp, "        if (!stale[%d])\n            goto E_%03x;\n", skipped, target);
+                }
+
+                fprintf(fp, "        pc = CHIP_ReadByte(chip, 0x%03x) == 0xF0 && CHIP_ReadByte(chip, 0x%03x) == 0x00 ? "
+                    "0x%03x : 0x%03x;\n        goto dispatch;\n", next, next + 1, next + 4, next + 2);
+            }
+            else if (ANALYSIS_FindBlock(t->analysis, next + 2) >= 0)
+            {
+                fprintf(fp, "        goto E_%03x;\n", next + 2);
+            }
+            else
+            {
+                fprintf(fp, "        pc = 0x%03x;\n        goto dispatch;\n", next + 2);
+            }
+
+            fprintf(fp, "    }\n");
+            emitJump(t, next);
+            return 1;
+        }
+
+        // EXIT and unknown instructions always halt
+        case OP_EXIT: case OP_UNKNOWN:
+            fprintf(fp, "    STEP(0x%03x);\n    goto done;\n", address);
+            return 1;
+
+        // drawing, scrolling, key waits and audio patterns run on the interpreter
+        case OP_CLS: case OP_DRW: case OP_LDK: case OP_SCD: case OP_SCR: case OP_SCL: case OP_LOWRES: case OP_HIGHRES:
+        case OP_SCU: case OP_LDAUD:
+            emitStep(t, address, &op);
+            return 0;
+
+        default:
+            fprintf(fp, "    STEP(0x%03x);\n", address);
+            return 0;
+    }
+}
+
+// Writes block n - the entry of its first instruction, the fast copy, the checked copy and
+// the entries of the other instructions
+static void emitBlock(Translator *t, int n)
+{
+    const AnalysisBlock *block = &t->analysis->blocks[n];
+    FILE *fp = t->fp;
+    char text[64];
+    int remaining = block->instructions;
+    int terminated = 0;
+
+    fprintf(fp, "\n    // block %d, 0x%03x - 0x%03x\n", n, block->start, block->end);
+
+    t->loop = -1;
+
+    for (int pc = block->start; pc < block->end; pc += ANALYSIS_InstructionSize(t->analysis, pc))
+    {
+        CHIP_Op op = ANALYSIS_Decode(t->analysis, pc);
+
+        if ((op.op == OP_JP || op.op == OP_CALL) && op.nnn == block->start)
+        {
+            t->loop = block->start;
+        }
+    }
+
+    for (int pc = block->start; pc < block->end; pc += ANALYSIS_InstructionSize(t->analysis, pc))
+    {
+        if (pc == block->start)
+        {
+            fprintf(fp, "E_%03x:\n", pc);
+            fprintf(fp, "    if (stale[%d])\n    {\n        pc = 0x%03x;\n        goto slow;\n    }\n", n, pc);
+
+            if (t->loop == pc)
+            {
+                fprintf(fp, "L_%03x:\n", pc);
+            }
+
+            fprintf(fp, "    if (left < %d)\n        goto C_%03x;\n    left -= %d;\n", remaining, pc, remaining);
+        }
+        else
+        {
+            fprintf(fp, "F_%03x:\n", pc);
+        }
+
+        ANALYSIS_Format(t->analysis, pc, text, sizeof(text));
+        fprintf(fp, "    // 0x%03x  %s\n", pc, text);
+
+        remaining--;
+        terminated = emitInstruction(t, pc, remaining);
+    }
+
+    if (!terminated)
+    {
+        emitJump(t, block->end);
+    }
+
+    fprintf(fp, "\n");
+
+    for (int pc = block->start; pc < block->end; pc += ANALYSIS_InstructionSize(t->analysis, pc))
+    {
+        fprintf(fp, "C_%03x:\n", pc);
+        fprintf(fp, "    if (left == 0)\n    {\n        pc = 0x%03x;\n        goto done;\n    }\n    left--;\n", pc);
+        terminated = emitInstruction(t, pc, 0);
+    }
+
+    if (!terminated)
+    {
+        emitJump(t, block->end);
+    }
+
+    remaining = block->instructions;
+
+    for (int pc = block->start; pc < block->end; pc += ANALYSIS_InstructionSize(t->analysis, pc))
+    {
+        if (pc != block->start)
+        {
+            fprintf(fp, "\nE_%03x:\n", pc);
+            fprintf(fp, "    if (stale[%d])\n    {\n        pc = 0x%03x;\n        goto slow;\n    }\n", n, pc);
+            fprintf(fp, "    if (left < %d)\n        goto C_%03x;\n    left -= %d;\n    goto F_%03x;\n",
+                remaining, pc, remaining, pc);
+        }
+
+        remaining--;
+    }
+}
+
+// Writes the translated program
+int translate(Translator *t, const char *name, int quirks)
+{
+    const Analysis *analysis = t->analysis;
+    FILE *fp = t->fp;
+    int size = analysis->programEnd - LOAD_ADDRESS;
+    int instructions = 0;
+
+    for (int n = 0; n < analysis->blockCount; n++)
+    {
+        instructions += analysis->blocks[n].instructions;
+    }
+
+    fprintf(fp, "// Translated from %s by chip8-translate, do not edit\n", name);
+    fprintf(fp, "// %s model, %s quirks, %d blocks, %d instructions\n\n", CHIP_ModelName(analysis->model),
+        CHIP_QuirksName(quirks), analysis->blockCount, instructions);
+    fprintf(fp, "#include \"aot.h\"\n\n");
+
+    fprintf(fp, "static const byte rom[%d] =\n{", size > 0 ? size : 1);
+
+    for (int i = 0; i < size; i++)
+    {
+        fprintf(fp, "%s0x%02x,", i % 16 ? " " : "\n    ", analysis->memory[LOAD_ADDRESS + i]);
+    }
+
+    fprintf(fp, "\n};\n\nstatic const AOT_Block blocks[%d] =\n{\n", analysis->blockCount > 0 ? analysis->blockCount : 1);
+
+    for (int n = 0; n < analysis->blockCount; n++)
+    {
+        fprintf(fp, "    { 0x%03x, 0x%03x },\n", analysis->blocks[n].start, analysis->blocks[n].end);
+    }
+
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "#define LOAD()  ");
+
+    for (int i = 0; i < 16; i++)
+    {
+        fprintf(fp, "V%X = chip->V[%d]; ", i, i);
+    }
+
+    fprintf(fp, "I = chip->I; pc = chip->PC\n#define STORE() ");
+
+    for (int i = 0; i < 16; i++)
+    {
+        fprintf(fp, "chip->V[%d] = V%X; ", i, i);
+    }
+
+    fprintf(fp, "chip->I = I; chip->PC = pc\n\n");
+    fprintf(fp,
+        "// Runs the instruction at address on the interpreter, leaves if it halted the machine\n"
+        "#define STEP(address)   do { pc = (address); STORE(); CHIP_Step(chip); LOAD(); if (chip->halted) goto done; } while (0)\n\n");
+
+    fprintf(fp,
+        "static void run(AOT_Machine *machine, long cycles)\n"
+        "{\n"
+        "    Chip8 *chip = machine->chip;\n"
+        "    const byte *stale = machine->stale;\n"
+        "    byte V0, V1, V2, V3, V4, V5, V6, V7, V8, V9, VA, VB, VC, VD, VE, VF;\n"
+        "    word I, pc;\n"
+        "    long left = cycles;\n\n"
+        "    LOAD();\n"
+        "    goto dispatch;\n");
+
+    for (int n = 0; n < analysis->blockCount; n++)
+    {
+        emitBlock(t, n);
+    }
+
+    fprintf(fp, "\ndispatch:\n    switch (pc)\n    {\n");
+
+    for (int n = 0; n < analysis->blockCount; n++)
+    {
+        const AnalysisBlock *block = &analysis->blocks[n];
+
+        for (int pc = block->start; pc < block->end; pc += ANALYSIS_InstructionSize(analysis, pc))
+        {
+            fprintf(fp, "        case 0x%03x: goto E_%03x;\n", pc, pc);
+        }
+    }
+
+    fprintf(fp,
+        "    }\n\n"
+        "    // address not translated or in a stale block, the backend runs until PC is on live code again\n"
+        "slow:\n"
+        "    if (left == 0)\n"
+        "        goto done;\n"
+        "    STORE();\n"
+        "    left -= AOT_Interpret(machine, left);\n"
+        "    LOAD();\n"
+        "    if (chip->halted)\n"
+        "        goto done;\n"
+        "    goto dispatch;\n\n"
+        "done:\n"
+        "    STORE();\n"
+        "}\n\n");
+
+    fprintf(fp, "const AOT_Program AOT_program =\n{\n    \"");
+
+    for (const char *c = name; *c; c++)
+    {
+        fprintf(fp, (*c == '"' || *c == '\\') ? "\\%c" : "%c", *c);
+    }
+
+    fprintf(fp, "\", %d, %d, rom, %d, blocks, %d, run\n};\n", analysis->model, quirks, size, analysis->blockCount);
+
+    return ferror(fp) ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char *rom = NULL, *output = NULL;
+    int model = CHIP_MODEL_CHIP8;
+    int quirks = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '-')
+            rom = argv[i];
+        else if (i + 1 >= argc)
+            usage();
+        else if (strcmp(argv[i], "--model") == 0)
+        {
+            if ((model = CHIP_ModelByName(argv[++i])) < 0)
+                unknown("model", argv[i]);
+        }
+        else if (strcmp(argv[i], "--quirks") == 0)
+        {
+            if ((quirks = CHIP_QuirksByName(argv[++i])) < 0)
+                unknown("quirks profile", argv[i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+            output = argv[++i];
+        else
+            usage();
+    }
+
+    if (rom == NULL)
+    {
+        usage();
+    }
+
+    Chip8 *chip = calloc(1, sizeof(Chip8));
+    Analysis *analysis = calloc(1, sizeof(Analysis));
+
+    if (chip == NULL || analysis == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    CHIP_Initalize(chip);
+    CHIP_SetModel(chip, model);
+
+    if (quirks != -1)
+    {
+        CHIP_SetQuirks(chip, quirks);
+    }
+
+    int size = CHIP_LoadProgram(chip, rom);
+
+    if (size < 0)
+    {
+        fprintf(stderr, "%s: %s\n", rom, CHIP_LoadError(chip, size));
+        return 1;
+    }
+
+    if (size > CHIP_ProgramSize(chip))
+    {
+        fprintf(stderr, "%s: %s, loaded %d of %d bytes\n", rom, CHIP_LoadError(chip, size), CHIP_ProgramSize(chip),
+            size);
+    }
+
+    if (ANALYSIS_Run(analysis, chip, size) != 0)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    FILE *fp = output != NULL ? fopen(output, "w") : stdout;
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Unable to write %s\n", output);
+        return 1;
+    }
+
+    const char *name = strrchr(rom, '/') != NULL ? strrchr(rom, '/') + 1 : rom;
+    Translator translator = { analysis, &QUIRKS_Profiles[chip->quirks], fp, -1 };
+    int status = translate(&translator, name, chip->quirks);
+
+    if ((output != NULL && fclose(fp) != 0) || status != 0)
+    {
+        fprintf(stderr, "Unable to write %s\n", output != NULL ? output : "output");
+        return 1;
+    }
+
+    ANALYSIS_Free(analysis);
+    free(analysis);
+    CHIP_Free(chip);
+    free(chip);
+
+    return 0;
+}